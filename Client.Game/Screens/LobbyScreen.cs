@@ -25,6 +25,10 @@ namespace ClientGame
         private readonly List<string> chatLog = new();
         private readonly ConcurrentQueue<string> queue = new();
 
+        /* Présence : version de la dernière photo / du dernier delta appliqué
+         * (-1 = photo PLAYERS pas encore reçue, deltas ignorés)            */
+        private long presenceVer   = -1;
+
         private int  selectedIndex = 0;
         private bool inviteLatch   = false;
         private bool showingPrompt = false;   /* popup d’invitation */
@@ -91,13 +95,40 @@ namespace ClientGame
                     return;
                 }
 
-                /* ► mises à jour classiques */
-                if (msg.StartsWith("UPDATE_LIST:", StringComparison.OrdinalIgnoreCase))
+                /* ► présence : photo complète puis deltas versionnés */
+                if (msg.StartsWith("PLAYERS:", StringComparison.OrdinalIgnoreCase))
                 {
-                    players.Clear();
-                    players.AddRange(msg["UPDATE_LIST:".Length..]
-                                     .Split(',', StringSplitOptions.RemoveEmptyEntries));
-                    if (selectedIndex >= players.Count) selectedIndex = players.Count - 1;
+                    var p = msg.Split(':', 3);
+                    if (p.Length == 3 && long.TryParse(p[1], out var ver))
+                    {
+                        presenceVer = ver;
+                        players.Clear();
+                        players.AddRange(p[2].Split(',', StringSplitOptions.RemoveEmptyEntries));
+                        if (selectedIndex >= players.Count) selectedIndex = players.Count - 1;
+                    }
+                }
+                else if (msg.StartsWith("PLAYER_JOIN:", StringComparison.OrdinalIgnoreCase) ||
+                         msg.StartsWith("PLAYER_LEAVE:", StringComparison.OrdinalIgnoreCase))
+                {
+                    var p = msg.Split(':', 3);
+                    if (p.Length == 3 && long.TryParse(p[1], out var ver) && presenceVer >= 0)
+                    {
+                        if (ver == presenceVer + 1)
+                        {
+                            presenceVer = ver;
+                            if (p[0].Equals("PLAYER_JOIN", StringComparison.OrdinalIgnoreCase))
+                            { if (!players.Contains(p[2])) players.Add(p[2]); }
+                            else
+                                players.Remove(p[2]);
+                            if (selectedIndex >= players.Count) selectedIndex = players.Count - 1;
+                        }
+                        else if (ver > presenceVer + 1)
+                        {
+                            /* delta manqué : on redemande la photo */
+                            presenceVer = -1;
+                            net.SendLine("LIST");
+                        }
+                    }
                 }
                 else if (msg.StartsWith("CHAT:", StringComparison.OrdinalIgnoreCase))
                 {
@@ -121,6 +152,10 @@ namespace ClientGame
                         prevKb = kb; prevMs = ms;
                         return;
                     }
+                    /* refus ou expiration : l’invitation affichée n’est plus valable */
+                    if (p.Length == 3 && showingPrompt &&
+                        p[1].Equals(inviter, StringComparison.OrdinalIgnoreCase))
+                        showingPrompt = false;
                 }
                 else if (msg.StartsWith("QUERY1_RESULT:", StringComparison.OrdinalIgnoreCase))
                     queryResult = msg["QUERY1_RESULT:".Length..];
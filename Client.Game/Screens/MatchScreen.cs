@@ -31,6 +31,15 @@ namespace ClientGame
         private Dictionary<string, int>     playerHealth    = new();
         private Dictionary<string, int>     prevHealth      = new();
 
+        /* interpolation : le serveur n’envoie l’état que s’il a changé, à
+           10–60 Hz selon la connexion ; on glisse de l’affichage courant
+           vers le nouvel état sur l’écart de ticks annoncé (TICK:)      */
+        private const float ServerTickHz = 60f;
+        private Dictionary<int, Vector2>    projFrom = new(), projTo = new();
+        private Dictionary<string, Vector2> posFrom  = new(), posTo  = new();
+        private float lerpT = 1f, lerpDur = 1f / ServerTickHz;
+        private long  lastTick = -1, pendingTick = -1;
+
         private bool   stateReceived = false;
         private bool   gameOver      = false;
         private string gameOverText  = string.Empty;
@@ -86,7 +95,13 @@ namespace ClientGame
             {
                 var msg = raw.Trim();
 
-                if (msg.StartsWith("STATE:", StringComparison.OrdinalIgnoreCase))
+                if (msg.StartsWith("TICK:", StringComparison.OrdinalIgnoreCase))
+                {
+                    var p = msg.Split(':');
+                    if (p.Length >= 2 && long.TryParse(p[1], out var t))
+                        pendingTick = t;
+                }
+                else if (msg.StartsWith("STATE:", StringComparison.OrdinalIgnoreCase))
                     ParseState(msg["STATE:".Length..]);
 
                 else if (msg.StartsWith("FIRE_ACK:", StringComparison.OrdinalIgnoreCase))
@@ -108,6 +123,12 @@ namespace ClientGame
                 }
             }
 
+            if (lerpT < 1f)
+            {
+                lerpT = Math.Min(1f, lerpT + dt / lerpDur);
+                Interpolate();
+            }
+
             if (!stateReceived) { prevKb = kb; return; }
 
             /* -------- Détection locale (secours) -------- */
@@ -136,6 +157,9 @@ namespace ClientGame
                     playerPositions.Clear();
                     playerHealth.Clear();
                     projectiles.Clear();
+                    posTo.Clear();
+                    projTo.Clear();
+                    lastTick = pendingTick = -1;
                     stateReceived = false;
 
                     /* Vide les messages restants pour éviter les re-triggers */
@@ -267,7 +291,9 @@ namespace ClientGame
                         float.TryParse(v[2], out var y))
                         newProj[id] = new Vector2(x, y);
                 }
-            projectiles = newProj;
+            projFrom    = projectiles;
+            projTo      = newProj;
+            projectiles = new Dictionary<int, Vector2>(newProj.Count);
 
             /* HP */
             var newHP = new Dictionary<string, int>();
@@ -288,11 +314,38 @@ namespace ClientGame
                     if (kv.Length == 3 &&
                         float.TryParse(kv[1], out var x) &&
                         float.TryParse(kv[2], out var y))
-                        playerPositions[kv[0]] = new Vector2(x, y);
+                    {
+                        var target = new Vector2(x, y);
+                        posFrom[kv[0]] = playerPositions.TryGetValue(kv[0], out var cur) ? cur : target;
+                        posTo[kv[0]]   = target;
+                    }
                 }
 
-            if (playerPositions.TryGetValue(me, out var myPos))
+            /* durée du glissement : ticks écoulés depuis l’état précédent */
+            if (pendingTick > lastTick && lastTick >= 0)
+                lerpDur = Math.Min(pendingTick - lastTick, 6) / ServerTickHz;
+            lastTick = pendingTick;
+            lerpT    = 0f;
+            Interpolate();
+
+            /* notre avion : pas de glissement, la position serveur prime */
+            if (posTo.TryGetValue(me, out var myPos))
+            {
+                playerPositions[me] = myPos;
                 isRightPlayer = myPos.X > 280;
+            }
+        }
+
+        private void Interpolate()
+        {
+            foreach (var kv in posTo)
+                if (kv.Key != me)
+                    playerPositions[kv.Key] = Vector2.Lerp(posFrom[kv.Key], kv.Value, lerpT);
+
+            foreach (var kv in projTo)
+                projectiles[kv.Key] = projFrom.TryGetValue(kv.Key, out var from)
+                    ? Vector2.Lerp(from, kv.Value, lerpT)
+                    : kv.Value;
         }
 
         private void ParseFireAck(string data)
@@ -4,7 +4,9 @@
 #include <mysql/mysql.h>      /* toujours AVANT tout MYSQL*          */
 #include <stdio.h>
 #include <string.h>
-#include <unistd.h>           /* write()                             */
+/* Conn / connSend() : fournis par server.c (file sortante non bloquante)
+ * DbConn / dbExec()  : db_pool.c, requêtes préparées par connexion
+ * LbRow / LbGame     : leaderboard.c, qui garde les classements en cache */
 
 #ifndef BUFFER_SIZE           /* récupéré depuis le serveur          */
 #define BUFFER_SIZE 2048
@@ -16,195 +18,223 @@
 /* ─────────────────────────────────────────────────────────────── */
 /*  REGISTER                                                      */
 /* ─────────────────────────────────────────────────────────────── */
-void registerUser(MYSQL *conn,
+void registerUser(DbConn *db,
                   const char *username,
                   const char *email,
                   const char *password,
-                  int client_socket)
+                  Conn *client)
 {
-    char sql[512];
-    snprintf(sql, sizeof(sql),
-             "INSERT INTO players (username, email, password) "
-             "VALUES ('%s', '%s', '%s')",
-             username, email, password);
-
-    if (mysql_query(conn, sql)) {
-        fprintf(stderr, "(REGISTER) %s\n", mysql_error(conn));
-        write(client_socket, "Registration failed\n", 20);
-    } else
-        write(client_socket, "Registration successful\n", 24);
+    MYSQL_BIND p[3];
+    unsigned long l[3];
+    bindStr(&p[0], username, &l[0]);
+    bindStr(&p[1], email,    &l[1]);
+    bindStr(&p[2], password, &l[2]);
+
+    if (!dbExec(db, ST_REGISTER, p, "REGISTER"))
+        connSend(client, "Registration failed\n", 20);
+    else
+        connSend(client, "Registration successful\n", 24);
 }
 
 /* ─────────────────────────────────────────────────────────────── */
 /*  LOGIN                                                          */
 /* ─────────────────────────────────────────────────────────────── */
-void loginUser(MYSQL *conn,
+void loginUser(DbConn *db,
                const char *username,
                const char *password,
-               int  client_socket,
+               Conn *client,
                char *loggedInUser,
                int  *isLoggedIn)
 {
     *isLoggedIn = 0;
     loggedInUser[0] = '\0';
 
-    char sql[512];
-    snprintf(sql, sizeof(sql),
-             "SELECT id_player, username "
-             "FROM players "
-             "WHERE username='%s' AND password='%s'",
-             username, password);
-
-    if (mysql_query(conn, sql)) {
-        fprintf(stderr, "(LOGIN-query) %s\n", mysql_error(conn));
-        write(client_socket, "Login query failed\n", 19);
-        return;
-    }
-
-    MYSQL_RES *res = mysql_store_result(conn);
-    if (!res) {
-        fprintf(stderr, "(LOGIN-store) %s\n", mysql_error(conn));
-        write(client_socket, "Login failed\n", 13);
+    MYSQL_BIND p[2];
+    unsigned long l[2];
+    bindStr(&p[0], username, &l[0]);
+    bindStr(&p[1], password, &l[1]);
+
+    MYSQL_STMT *st = dbExec(db, ST_LOGIN, p, "LOGIN-query");
+    if (!st) { connSend(client, "Login query failed\n", 19); return; }
+
+    int  id;
+    char name[USERNAME_LEN];
+    unsigned long nameLen;
+    my_bool nul[2];
+    MYSQL_BIND r[2];
+    bindOutInt(&r[0], &id, &nul[0]);
+    bindOutStr(&r[1], name, sizeof(name), &nameLen, &nul[1]);
+
+    if (mysql_stmt_bind_result(st, r) || mysql_stmt_store_result(st)) {
+        fprintf(stderr, "(LOGIN-store) %s\n", mysql_stmt_error(st));
+        mysql_stmt_free_result(st);
+        connSend(client, "Login failed\n", 13);
         return;
     }
 
-    if (mysql_num_rows(res) > 0) {
-        MYSQL_ROW row = mysql_fetch_row(res);
-        strncpy(loggedInUser, row[1], USERNAME_LEN - 1);
+    int rc = mysql_stmt_fetch(st);
+    mysql_stmt_free_result(st);
+    if (rc == 0 || rc == MYSQL_DATA_TRUNCATED) {
+        fixStr(name, sizeof(name), nameLen, nul[1]);
+        snprintf(loggedInUser, USERNAME_LEN, "%s", name);
         *isLoggedIn = 1;
-        write(client_socket, "Login successful\n", 17);
+        connSend(client, "Login successful\n", 17);
 
         /* met à jour last_login */
-        snprintf(sql, sizeof(sql),
-                 "UPDATE players SET last_login = NOW() "
-                 "WHERE username='%s'", username);
-        mysql_query(conn, sql);
+        dbExec(db, ST_TOUCH_LOGIN, p, "LOGIN-touch");
     } else
-        write(client_socket, "Invalid credentials\n", 20);
-
-    mysql_free_result(res);
+        connSend(client, "Invalid credentials\n", 20);
 }
 
 /* ─────────────────────────────────────────────────────────────── */
 /*  LOGOUT  (simple accusé + mise à jour last_login)              */
 /* ─────────────────────────────────────────────────────────────── */
-void logoutUser(MYSQL *conn,
+void logoutUser(DbConn *db,
                 const char *username,
-                int client_socket)
+                Conn *client)
 {
-    char sql[256];
-    snprintf(sql, sizeof(sql),
-             "UPDATE players SET last_login = NOW() "
-             "WHERE username='%s'", username);
-    mysql_query(conn, sql);
-    write(client_socket, "Logout successful\n", 18);
+    MYSQL_BIND p[1];
+    unsigned long l;
+    bindStr(&p[0], username, &l);
+    dbExec(db, ST_TOUCH_LOGIN, p, "LOGOUT");
+    connSend(client, "Logout successful\n", 18);
 }
 
 /* ─────────────────────────────────────────────────────────────── */
 /*  DELETE ACCOUNT                                                */
 /*      – supprime le joueur → déclenche   ON DELETE CASCADE      */
 /* ─────────────────────────────────────────────────────────────── */
-void deleteAccount(MYSQL *conn,
+void deleteAccount(DbConn *db,
                    const char *username,
-                   int client_socket)
+                   Conn *client)
 {
-    char sql[256];
-    snprintf(sql, sizeof(sql),
-             "DELETE FROM players WHERE username='%s'", username);
-
-    if (mysql_query(conn, sql)) {
-        fprintf(stderr, "(DELETE) %s\n", mysql_error(conn));
-        write(client_socket, "Account deletion failed\n", 24);
-    } else
-        write(client_socket, "Account deleted\n", 16);
+    MYSQL_BIND p[1];
+    unsigned long l;
+    bindStr(&p[0], username, &l);
+
+    if (!dbExec(db, ST_DELETE, p, "DELETE"))
+        connSend(client, "Account deletion failed\n", 24);
+    else
+        connSend(client, "Account deleted\n", 16);
 }
 
 /* ─────────────────────────────────────────────────────────────── */
-/*  QUERY 1 : Top 5 joueurs par total_score                       */
+/*  Exécute une requête de lecture et lie ses colonnes             */
 /* ─────────────────────────────────────────────────────────────── */
-void queryOne(MYSQL *conn, int client_socket)
+static MYSQL_STMT *queryRows(DbConn *db, int id, MYSQL_BIND *p,
+                             MYSQL_BIND *r, const char *tag)
 {
-    const char *sql =
-        "SELECT username, total_score "
-        "FROM players "
-        "ORDER BY total_score DESC "
-        "LIMIT 5";
-
-    if (mysql_query(conn, sql)) { write(client_socket, "Query1 failed\n", 14); return; }
-    MYSQL_RES *res = mysql_store_result(conn);
-    if (!res)       { write(client_socket, "Query1 failed\n", 14); return; }
-
-    char response[BUFFER_SIZE] = "Top 5 players by score:";
-    MYSQL_ROW row;
-    while ((row = mysql_fetch_row(res))) {
-        char part[128];
-        snprintf(part, sizeof(part), " | User:%s Score:%s", row[0], row[1]);
-        strncat(response, part, sizeof(response) - strlen(response) - 1);
+    MYSQL_STMT *st = dbExec(db, id, p, tag);
+    if (!st) return NULL;
+    if (mysql_stmt_bind_result(st, r) || mysql_stmt_store_result(st)) {
+        fprintf(stderr, "(%s-store) %s\n", tag, mysql_stmt_error(st));
+        mysql_stmt_free_result(st);
+        return NULL;
     }
-    mysql_free_result(res);
+    return st;
+}
 
-    char msg[BUFFER_SIZE + 32];
-    snprintf(msg, sizeof(msg), "QUERY1_RESULT:%s\n", response);
-    write(client_socket, msg, strlen(msg));
+static int fetchRow(MYSQL_STMT *st)
+{
+    int rc = mysql_stmt_fetch(st);
+    return rc == 0 || rc == MYSQL_DATA_TRUNCATED;
 }
 
 /* ─────────────────────────────────────────────────────────────── */
-/*  QUERY 2 : 5 dernières parties                                 */
+/*  Chargement des classements (cache de leaderboard.c)            */
+/*      renvoient le nombre de lignes, -1 si la requête échoue     */
 /* ─────────────────────────────────────────────────────────────── */
-void queryTwo(MYSQL *conn, int client_socket)
+
+/* QUERY 1 : Top joueurs par total_score */
+int loadTopScore(DbConn *db, LbRow *out, int max)
 {
-    const char *sql =
-        "SELECT id_game, name, status, winner_id "
-        "FROM game "
-        "ORDER BY created_at DESC "
-        "LIMIT 5";
-
-    if (mysql_query(conn, sql)) { write(client_socket, "Query2 failed\n", 14); return; }
-    MYSQL_RES *res = mysql_store_result(conn);
-    if (!res)       { write(client_socket, "Query2 failed\n", 14); return; }
-
-    char response[BUFFER_SIZE] = "Last 5 games:";
-    MYSQL_ROW row;
-    while ((row = mysql_fetch_row(res))) {
-        char part[160];
-        snprintf(part, sizeof(part),
-                 " | GameID:%s Name:%s Status:%s Winner:%s",
-                 row[0], row[1], row[2], row[3] ? row[3] : "NULL");
-        strncat(response, part, sizeof(response) - strlen(response) - 1);
+    char name[USERNAME_LEN];
+    int  score;
+    unsigned long nameLen;
+    my_bool nul[2];
+    MYSQL_BIND r[2];
+    bindOutStr(&r[0], name, sizeof(name), &nameLen, &nul[0]);
+    bindOutInt(&r[1], &score, &nul[1]);
+
+    MYSQL_STMT *st = queryRows(db, ST_TOP_SCORE, NULL, r, "QUERY1");
+    if (!st) return -1;
+    int n = 0;
+    while (n < max && fetchRow(st)) {
+        fixStr(name, sizeof(name), nameLen, nul[0]);
+        strcpy(out[n].name, name);
+        out[n++].val = nul[1] ? 0 : score;
     }
-    mysql_free_result(res);
+    mysql_stmt_free_result(st);
+    return n;
+}
 
-    char msg[BUFFER_SIZE + 32];
-    snprintf(msg, sizeof(msg), "QUERY2_RESULT:%s\n", response);
-    write(client_socket, msg, strlen(msg));
+/* QUERY 2 : dernières parties */
+int loadLastGames(DbConn *db, LbGame *out, int max)
+{
+    int  gid, winner;
+    char name[LB_GAME_NAME], status[LB_STATUS_LEN];
+    unsigned long nameLen, statusLen;
+    my_bool nul[4];
+    MYSQL_BIND r[4];
+    bindOutInt(&r[0], &gid, &nul[0]);
+    bindOutStr(&r[1], name,   sizeof(name),   &nameLen,   &nul[1]);
+    bindOutStr(&r[2], status, sizeof(status), &statusLen, &nul[2]);
+    bindOutInt(&r[3], &winner, &nul[3]);
+
+    MYSQL_STMT *st = queryRows(db, ST_LAST_GAMES, NULL, r, "QUERY2");
+    if (!st) return -1;
+    int n = 0;
+    while (n < max && fetchRow(st)) {
+        fixStr(name,   sizeof(name),   nameLen,   nul[1]);
+        fixStr(status, sizeof(status), statusLen, nul[2]);
+        out[n].id     = gid;
+        out[n].winner = nul[3] ? 0 : winner;       /* 0 ⇒ NULL */
+        strcpy(out[n].name, name);
+        strcpy(out[n++].status, status);
+    }
+    mysql_stmt_free_result(st);
+    return n;
 }
 
-/* ─────────────────────────────────────────────────────────────── */
-/*  QUERY 3 : Top 5 joueurs par kills                              */
-/* ─────────────────────────────────────────────────────────────── */
-void queryThree(MYSQL *conn, int client_socket)
+/* QUERY 3 : Top joueurs par kills */
+int loadTopKills(DbConn *db, LbRow *out, int max)
 {
-    const char *sql =
-        "SELECT p.username, h.kills "
-        "FROM history h "
-        "JOIN players p ON p.id_player = h.id_player "
-        "ORDER BY h.kills DESC "
-        "LIMIT 5";
-
-    if (mysql_query(conn, sql)) { write(client_socket, "Query3 failed\n", 14); return; }
-    MYSQL_RES *res = mysql_store_result(conn);
-    if (!res)       { write(client_socket, "Query3 failed\n", 14); return; }
-
-    char response[BUFFER_SIZE] = "Top 5 players by kills:";
-    MYSQL_ROW row;
-    while ((row = mysql_fetch_row(res))) {
-        char part[128];
-        snprintf(part, sizeof(part), " | User:%s Kills:%s", row[0], row[1]);
-        strncat(response, part, sizeof(response) - strlen(response) - 1);
+    char name[USERNAME_LEN];
+    int  kills;
+    unsigned long nameLen;
+    my_bool nul[2];
+    MYSQL_BIND r[2];
+    bindOutStr(&r[0], name, sizeof(name), &nameLen, &nul[0]);
+    bindOutInt(&r[1], &kills, &nul[1]);
+
+    MYSQL_STMT *st = queryRows(db, ST_TOP_KILLS, NULL, r, "QUERY3");
+    if (!st) return -1;
+    int n = 0;
+    while (n < max && fetchRow(st)) {
+        fixStr(name, sizeof(name), nameLen, nul[0]);
+        strcpy(out[n].name, name);
+        out[n++].val = nul[1] ? 0 : kills;
     }
-    mysql_free_result(res);
+    mysql_stmt_free_result(st);
+    return n;
+}
 
-    char msg[BUFFER_SIZE + 32];
-    snprintf(msg, sizeof(msg), "QUERY3_RESULT:%s\n", response);
-    write(client_socket, msg, strlen(msg));
+/* id et total_score d’un joueur, relus après écriture d’un lot */
+int loadPlayerScore(DbConn *db, const char *username, int *id, int *score)
+{
+    MYSQL_BIND p[1];
+    unsigned long l;
+    bindStr(&p[0], username, &l);
+    my_bool nul[2];
+    MYSQL_BIND r[2];
+    bindOutInt(&r[0], id, &nul[0]);
+    bindOutInt(&r[1], score, &nul[1]);
+
+    MYSQL_STMT *st = queryRows(db, ST_PLAYER_SCORE, p, r, "player-score");
+    if (!st) return -1;
+    int ok = fetchRow(st);
+    mysql_stmt_free_result(st);
+    if (!ok) return -1;
+    if (nul[1]) *score = 0;
+    return 0;
 }
@@ -0,0 +1,409 @@
+/* ==================================================================
+ *          POOL DE CONNEXIONS MYSQL  – partagé par tous les threads
+ *
+ *  Le nombre de connexions suit la concurrence des requêtes, plus le
+ *  nombre de joueurs connectés : un thread emprunte une connexion le
+ *  temps d’une commande puis la rend.
+ *   – ouverture paresseuse, ping si inactive depuis DB_PING_IDLE_S
+ *   – connexion perdue (erreur client 2xxx) ⇒ fermée, rouverte au
+ *     prochain emprunt
+ *   – attente bornée (DB_POOL_WAIT_MS) et mesurée
+ *   – chaque connexion garde ses requêtes préparées (dbExec), jamais
+ *     de SQL construit par concaténation
+ *
+ *  Les threads I/O n’empruntent jamais : leurs commandes SQL passent
+ *  par une file servie par DB_WORKERS threads (dbSubmit), qui rendent
+ *  la main au thread I/O une fois la requête faite.
+ * ================================================================== */
+#include <mysql/mysql.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DB_POOL_SIZE     8        /* défaut, DOGFIGHT_DB_POOL         */
+#define DB_POOL_WAIT_MS  2000     /* emprunt abandonné au-delà        */
+#define DB_PING_IDLE_S   30       /* ping avant réutilisation         */
+#define DB_SLOW_WAIT_MS  100      /* attente signalée sur stderr      */
+#define DB_WORKERS       4        /* défaut, DOGFIGHT_DB_WORKERS      */
+
+/* requêtes préparées, une fois par connexion, au premier usage */
+enum {
+    ST_LOGIN,           /* username, password  → id_player, username  */
+    ST_TOUCH_LOGIN,     /* username                                   */
+    ST_REGISTER,        /* username, email, password                  */
+    ST_DELETE,          /* username                                   */
+    ST_TOP_SCORE,       /*                     → username, total_score */
+    ST_LAST_GAMES,      /*  → id_game, name, status, winner_id        */
+    ST_TOP_KILLS,       /*                     → username, kills      */
+    ST_PLAYER_SCORE,    /* username            → id_player, total_score */
+    ST_COUNT
+};
+
+static const char *const g_stmtSql[ST_COUNT] = {
+    [ST_LOGIN]       = "SELECT id_player, username FROM players "
+                       "WHERE username=? AND password=?",
+    [ST_TOUCH_LOGIN] = "UPDATE players SET last_login = NOW() WHERE username=?",
+    [ST_REGISTER]    = "INSERT INTO players (username, email, password) VALUES (?,?,?)",
+    [ST_DELETE]      = "DELETE FROM players WHERE username=?",
+    [ST_TOP_SCORE]   = "SELECT username, total_score FROM players "
+                       "ORDER BY total_score DESC LIMIT 5",
+    [ST_LAST_GAMES]  = "SELECT id_game, name, status, winner_id FROM game "
+                       "ORDER BY created_at DESC LIMIT 5",
+    [ST_TOP_KILLS]   = "SELECT p.username, h.kills FROM history h "
+                       "JOIN players p ON p.id_player = h.id_player "
+                       "ORDER BY h.kills DESC LIMIT 5",
+    [ST_PLAYER_SCORE]= "SELECT id_player, total_score FROM players WHERE username=?",
+};
+
+/* requêtes multi-lignes (persist.c) : head + row (sep row)* + tail,
+ * préparées par paquets de 2^k lignes, k ≤ DB_ROWS_LOG, et gardées
+ * comme les autres                                                  */
+#define DB_ROWS_LOG      5        /* paquets de 1 à 32 lignes          */
+
+enum {
+    RW_GAME_INSERT,     /* a, b                       → id par ligne  */
+    RW_GAME_END,        /* id_game, winner|NULL                       */
+    RW_HIST_INSERT,     /* username, id_game, kills, deaths, score    */
+    RW_SCORE_ADD,       /* points, username — un vainqueur par ligne  */
+    RW_COUNT
+};
+
+static const struct { const char *head, *row, *sep, *tail; int params; }
+g_rowSql[RW_COUNT] = {
+    [RW_GAME_INSERT] = { "INSERT INTO game(name,status) VALUES",
+                         "(CONCAT('Duel ',?,' vs ',?),'in_progress')", ",", "", 2 },
+    [RW_GAME_END]    = { "UPDATE game g JOIN (",
+                         "SELECT CAST(? AS SIGNED) AS id, ? AS w", " UNION ALL ",
+                         ") t ON g.id_game=t.id SET g.status='finished', g.winner_id="
+                         "COALESCE((SELECT id_player FROM players WHERE username=t.w),"
+                         "g.winner_id)", 2 },
+    [RW_HIST_INSERT] = { "INSERT INTO history(id_player,id_game,kills,deaths,score) VALUES",
+                         "((SELECT id_player FROM players WHERE username=?),?,?,?,?)",
+                         ",", "", 5 },
+    [RW_SCORE_ADD]   = { "UPDATE players p JOIN (",
+                         "SELECT CAST(? AS SIGNED) AS pts, ? AS u", " UNION ALL ",
+                         ") t ON p.username=t.u SET p.total_score=p.total_score+t.pts", 2 },
+};
+
+typedef struct {
+    MYSQL      *mysql;
+    MYSQL_STMT *stmt[ST_COUNT];
+    MYSQL_STMT *rows[RW_COUNT][DB_ROWS_LOG + 1];
+    int         broken;            /* erreur client : à rouvrir          */
+    time_t      lastUse;
+    int         index;
+} DbConn;
+
+typedef struct {
+    uint64_t acquired;            /* emprunts réussis                 */
+    uint64_t timeouts;            /* emprunts abandonnés              */
+    uint64_t reconnects;          /* connexions (ré)ouvertes          */
+    uint64_t connectFails;        /* ouvertures échouées              */
+    uint64_t waitNsTotal, waitNsMax;
+} DbPoolStats;
+
+static DbConn         *g_pool;
+static int            *g_poolFree;          /* pile d’indices libres */
+static int             g_poolSize, g_poolFreeCount;
+static pthread_mutex_t m_pool = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  c_pool = PTHREAD_COND_INITIALIZER;
+static DbPoolStats     g_poolStats;
+
+/* Travail SQL confié aux workers : run() reçoit une connexion du pool
+ * (NULL si aucune n’a pu être obtenue), qui est rendue après son retour */
+typedef struct DbJob {
+    struct DbJob *next;
+    void (*run)(struct DbJob*, DbConn*);
+} DbJob;
+
+static DbJob          *g_jobHead, *g_jobTail;
+static pthread_mutex_t m_jobs = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  c_jobs = PTHREAD_COND_INITIALIZER;
+
+static MYSQL *open_db(void);
+void metDb(int, uint64_t);                  /* metrics.c */
+DbConn *dbAcquire(void);
+void    dbRelease(DbConn *d);
+
+static void *dbWorker(void *arg)
+{
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&m_jobs);
+        while (!g_jobHead) pthread_cond_wait(&c_jobs, &m_jobs);
+        DbJob *j = g_jobHead;
+        g_jobHead = j->next;
+        if (!g_jobHead) g_jobTail = NULL;
+        pthread_mutex_unlock(&m_jobs);
+
+        DbConn *d = dbAcquire();
+        j->run(j, d);                       /* j peut être libéré ici */
+        dbRelease(d);
+    }
+    return NULL;
+}
+
+/* jamais bloquant : appelé depuis les threads I/O */
+void dbSubmit(DbJob *j)
+{
+    j->next = NULL;
+    pthread_mutex_lock(&m_jobs);
+    if (g_jobTail) g_jobTail->next = j; else g_jobHead = j;
+    g_jobTail = j;
+    pthread_cond_signal(&c_jobs);
+    pthread_mutex_unlock(&m_jobs);
+}
+
+/* ferme la connexion et toutes ses requêtes préparées */
+static void dbDrop(DbConn *d)
+{
+    for (int i = 0; i < ST_COUNT; i++)
+        if (d->stmt[i]) { mysql_stmt_close(d->stmt[i]); d->stmt[i] = NULL; }
+    for (int i = 0; i < RW_COUNT; i++)
+        for (int k = 0; k <= DB_ROWS_LOG; k++)
+            if (d->rows[i][k]) { mysql_stmt_close(d->rows[i][k]); d->rows[i][k] = NULL; }
+    if (d->mysql) mysql_close(d->mysql);
+    d->mysql  = NULL;
+    d->broken = 0;
+}
+
+/* workers : une connexion chacun au plus, plus l’écrivain de persist.c */
+void dbPoolInit(int size, int workers)
+{
+    mysql_library_init(0, NULL, NULL);      /* avant tout mysql_init() concurrent */
+    if (workers < 1) workers = DB_WORKERS;
+    g_poolSize = size > 0 ? size : DB_POOL_SIZE;
+    if (g_poolSize < workers + 1) g_poolSize = workers + 1;
+    g_pool     = calloc(g_poolSize, sizeof(DbConn));
+    g_poolFree = calloc(g_poolSize, sizeof(int));
+    for (int i = 0; i < g_poolSize; i++) {
+        g_pool[i].index = i;
+        g_poolFree[g_poolFreeCount++] = i;
+    }
+    for (int i = 0; i < workers; i++) {
+        pthread_t tid;
+        pthread_create(&tid, NULL, dbWorker, NULL);
+        pthread_detach(tid);
+    }
+}
+
+static int64_t elapsedNs(const struct timespec *a, const struct timespec *b)
+{
+    return (int64_t)(b->tv_sec - a->tv_sec) * 1000000000LL + (b->tv_nsec - a->tv_nsec);
+}
+
+/* connexion saine ou NULL (pool saturé trop longtemps / base injoignable) */
+DbConn *dbAcquire(void)
+{
+    struct timespec t0, dl, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    clock_gettime(CLOCK_REALTIME, &dl);             /* horloge de cond_timedwait */
+    dl.tv_sec  += DB_POOL_WAIT_MS / 1000;
+    dl.tv_nsec += (DB_POOL_WAIT_MS % 1000) * 1000000L;
+    if (dl.tv_nsec >= 1000000000L) { dl.tv_sec++; dl.tv_nsec -= 1000000000L; }
+
+    pthread_mutex_lock(&m_pool);
+    while (!g_poolFreeCount)
+        if (pthread_cond_timedwait(&c_pool, &m_pool, &dl) != 0 && !g_poolFreeCount) {
+            g_poolStats.timeouts++;
+            pthread_mutex_unlock(&m_pool);
+            fprintf(stderr, "db pool: saturé (%d connexions)\n", g_poolSize);
+            return NULL;
+        }
+    DbConn *d = &g_pool[g_poolFree[--g_poolFreeCount]];
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    uint64_t w = (uint64_t)elapsedNs(&t0, &t1);
+    g_poolStats.acquired++;
+    g_poolStats.waitNsTotal += w;
+    if (w > g_poolStats.waitNsMax) g_poolStats.waitNsMax = w;
+    pthread_mutex_unlock(&m_pool);
+
+    if (w > DB_SLOW_WAIT_MS * 1000000ULL)
+        fprintf(stderr, "db pool: attente %llu ms\n", (unsigned long long)(w / 1000000));
+
+    /* contrôle de santé hors verrou */
+    time_t now = time(NULL);
+    if (d->mysql && now - d->lastUse > DB_PING_IDLE_S && mysql_ping(d->mysql))
+        dbDrop(d);
+    if (!d->mysql) {
+        d->mysql = open_db();
+        pthread_mutex_lock(&m_pool);
+        if (d->mysql) g_poolStats.reconnects++;
+        else          g_poolStats.connectFails++;
+        pthread_mutex_unlock(&m_pool);
+    }
+    if (!d->mysql) {
+        pthread_mutex_lock(&m_pool);
+        g_poolFree[g_poolFreeCount++] = d->index;
+        pthread_cond_signal(&c_pool);
+        pthread_mutex_unlock(&m_pool);
+        return NULL;
+    }
+    d->lastUse = now;
+    return d;
+}
+
+void dbRelease(DbConn *d)
+{
+    if (!d) return;
+    /* CR_* (2000+) : la connexion elle-même est en cause */
+    if (d->broken || mysql_errno(d->mysql) >= 2000) dbDrop(d);
+    d->lastUse = time(NULL);
+    pthread_mutex_lock(&m_pool);
+    g_poolFree[g_poolFreeCount++] = d->index;
+    pthread_cond_signal(&c_pool);
+    pthread_mutex_unlock(&m_pool);
+}
+
+void dbPoolStats(DbPoolStats *out, int *size, int *idle)
+{
+    pthread_mutex_lock(&m_pool);
+    *out  = g_poolStats;
+    *size = g_poolSize;
+    *idle = g_poolFreeCount;
+    pthread_mutex_unlock(&m_pool);
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Requêtes préparées                                             */
+/* ─────────────────────────────────────────────────────────────── */
+static void bindStr(MYSQL_BIND *b, const char *s, unsigned long *len)
+{
+    memset(b, 0, sizeof(*b));
+    *len = s ? strlen(s) : 0;
+    b->buffer_type   = s ? MYSQL_TYPE_STRING : MYSQL_TYPE_NULL;
+    b->buffer        = (void *)s;
+    b->buffer_length = *len;
+    b->length        = len;
+}
+
+static void bindInt(MYSQL_BIND *b, int *v)
+{
+    memset(b, 0, sizeof(*b));
+    b->buffer_type = MYSQL_TYPE_LONG;
+    b->buffer      = v;
+}
+
+/* résultat texte : buf fixe, tronqué à cap-1 octets, toujours terminé */
+static void bindOutStr(MYSQL_BIND *b, char *buf, unsigned long cap,
+                       unsigned long *len, my_bool *null)
+{
+    memset(b, 0, sizeof(*b));
+    b->buffer_type   = MYSQL_TYPE_STRING;
+    b->buffer        = buf;
+    b->buffer_length = cap;
+    b->length        = len;
+    b->is_null       = null;
+}
+
+static void bindOutInt(MYSQL_BIND *b, int *v, my_bool *null)
+{
+    memset(b, 0, sizeof(*b));
+    b->buffer_type = MYSQL_TYPE_LONG;
+    b->buffer      = v;
+    b->is_null     = null;
+}
+
+static void fixStr(char *buf, unsigned long cap, unsigned long len, my_bool null)
+{
+    buf[null ? 0 : (len < cap ? len : cap - 1)] = '\0';
+}
+
+/* prépare au besoin, lie les paramètres, exécute (durée → metDb).
+ * NULL en cas d’échec (message sur stderr, étiqueté par tag)          */
+static MYSQL_STMT *dbExec(DbConn *d, int id, MYSQL_BIND *params, const char *tag)
+{
+    MYSQL_STMT *st = d->stmt[id];
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (!st) {
+        if (!(st = mysql_stmt_init(d->mysql))) { d->broken = 1; return NULL; }
+        if (mysql_stmt_prepare(st, g_stmtSql[id], strlen(g_stmtSql[id]))) {
+            fprintf(stderr, "(%s-prepare) %s\n", tag, mysql_stmt_error(st));
+            if (mysql_stmt_errno(st) >= 2000) d->broken = 1;
+            mysql_stmt_close(st);
+            return NULL;
+        }
+        d->stmt[id] = st;
+    }
+    if ((params && mysql_stmt_bind_param(st, params)) || mysql_stmt_execute(st)) {
+        fprintf(stderr, "(%s) %s\n", tag, mysql_stmt_error(st));
+        if (mysql_stmt_errno(st) >= 2000) d->broken = 1;
+        mysql_stmt_reset(st);
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    metDb(id, (uint64_t)elapsedNs(&t0, &t1));
+    return st;
+}
+
+/* requête multi-lignes id pour 2^k lignes, préparée au premier usage */
+static MYSQL_STMT *dbRowsStmt(DbConn *d, int id, int k, const char *tag)
+{
+    MYSQL_STMT *st = d->rows[id][k];
+    if (st) return st;
+
+    size_t n = (size_t)1 << k;
+    size_t len = strlen(g_rowSql[id].head) + strlen(g_rowSql[id].tail) + 1
+               + n * (strlen(g_rowSql[id].row) + strlen(g_rowSql[id].sep));
+    char *sql = malloc(len), *p = sql;
+    if (!sql) return NULL;
+    p += sprintf(p, "%s", g_rowSql[id].head);
+    for (size_t i = 0; i < n; i++)
+        p += sprintf(p, "%s%s", i ? g_rowSql[id].sep : "", g_rowSql[id].row);
+    strcpy(p, g_rowSql[id].tail);
+
+    if (!(st = mysql_stmt_init(d->mysql))) { d->broken = 1; free(sql); return NULL; }
+    if (mysql_stmt_prepare(st, sql, strlen(sql))) {
+        fprintf(stderr, "(%s-prepare) %s\n", tag, mysql_stmt_error(st));
+        if (mysql_stmt_errno(st) >= 2000) d->broken = 1;
+        mysql_stmt_close(st);
+        free(sql);
+        return NULL;
+    }
+    free(sql);
+    return d->rows[id][k] = st;
+}
+
+/* n lignes de g_rowSql[id] (params : n × .params liaisons), en paquets
+ * 2^k décroissants : au plus DB_ROWS_LOG + 1 exécutions au-delà des
+ * paquets pleins. ids ≠ NULL (INSERT) : ids[i] = id AUTO_INCREMENT de
+ * la ligne i — consécutifs dans un INSERT à nombre de lignes connu
+ * (InnoDB, auto_increment_increment = 1). -1 en cas d’échec.          */
+static int dbExecRows(DbConn *d, int id, MYSQL_BIND *params, int n, int *ids,
+                      const char *tag)
+{
+    int k = DB_ROWS_LOG;
+    for (int done = 0; done < n; ) {
+        while ((1 << k) > n - done) k--;
+        int m = 1 << k;
+        MYSQL_STMT *st = dbRowsStmt(d, id, k, tag);
+        if (!st) return -1;
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (mysql_stmt_bind_param(st, params + done * g_rowSql[id].params)
+            || mysql_stmt_execute(st)) {
+            fprintf(stderr, "(%s) %s\n", tag, mysql_stmt_error(st));
+            if (mysql_stmt_errno(st) >= 2000) d->broken = 1;
+            mysql_stmt_reset(st);
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        metDb(ST_COUNT + id, (uint64_t)elapsedNs(&t0, &t1));
+        if (ids) {
+            if (mysql_stmt_affected_rows(st) != (my_ulonglong)m) {
+                fprintf(stderr, "(%s) %llu lignes sur %d\n", tag,
+                        (unsigned long long)mysql_stmt_affected_rows(st), m);
+                return -1;
+            }
+            int first = (int)mysql_stmt_insert_id(st);
+            for (int i = 0; i < m; i++) ids[done + i] = first + i;
+        }
+        done += m;
+    }
+    return 0;
+}
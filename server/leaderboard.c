@@ -0,0 +1,242 @@
+/* ==================================================================
+ *          CLASSEMENTS EN MÉMOIRE  – QUERY1 / QUERY2 / QUERY3
+ *
+ *  Le lobby interroge ces classements en boucle : les réponses sont
+ *  gardées toutes prêtes (OutBuf partagé, une référence par client)
+ *  et servies sans aller-retour MySQL.
+ *   – chargement complet au démarrage, ou au premier QUERY après une
+ *     invalidation (suppression de compte, base absente au boot) :
+ *     ce QUERY-là passe par un worker SQL, jamais par le thread I/O
+ *   – mise à jour incrémentale par le thread écrivain (persist.c),
+ *     une fois le lot validé en base
+ *  g_lbGen compte les modifications : un rechargement ne remplace le
+ *  cache que si rien n’a bougé pendant qu’il lisait la base.
+ * ================================================================== */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef USERNAME_LEN
+#define USERNAME_LEN 50
+#endif
+
+#define LB_TOP          5             /* lignes par classement           */
+#define LB_GAME_NAME    (2*USERNAME_LEN + 16)
+#define LB_STATUS_LEN   16
+
+typedef struct { char name[USERNAME_LEN]; int val; } LbRow;
+
+typedef struct {
+    int  id, winner;                  /* winner : id_player, 0 ⇒ NULL    */
+    char name[LB_GAME_NAME];
+    char status[LB_STATUS_LEN];
+} LbGame;
+
+enum { LB_SCORE, LB_GAMES, LB_KILLS, LB_COUNT };
+
+static struct {
+    LbRow   score[LB_TOP]; int nScore;
+    LbGame  games[LB_TOP]; int nGames;
+    LbRow   kills[LB_TOP]; int nKills;
+    OutBuf *line[LB_COUNT];           /* réponses pré-rendues             */
+} g_lb;
+static int             g_lbValid;
+static unsigned        g_lbGen;
+static pthread_mutex_t m_lb = PTHREAD_MUTEX_INITIALIZER;
+
+int loadTopScore(DbConn*, LbRow*, int);
+int loadLastGames(DbConn*, LbGame*, int);
+int loadTopKills(DbConn*, LbRow*, int);
+int loadPlayerScore(DbConn*, const char*, int*, int*);
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Rendu  (m_lb tenu)                                             */
+/* ─────────────────────────────────────────────────────────────── */
+static void lbSetLine(int which, const char *msg, int len)
+{
+    OutBuf *b = outNew(msg, len);
+    if (!b) return;
+    outRelease(g_lb.line[which]);
+    g_lb.line[which] = b;
+}
+
+static void lbRender(int which)
+{
+    char msg[BUFFER_SIZE + 32];
+    int  n = 0;
+    size_t cap = sizeof(msg) - 1;            /* place pour le '\n' final */
+
+    switch (which) {
+    case LB_SCORE:
+        n = snprintf(msg, cap, "QUERY1_RESULT:Top 5 players by score:");
+        for (int i = 0; i < g_lb.nScore && (size_t)n < cap; i++)
+            n += snprintf(msg + n, cap - n, " | User:%s Score:%d",
+                          g_lb.score[i].name, g_lb.score[i].val);
+        break;
+    case LB_GAMES:
+        n = snprintf(msg, cap, "QUERY2_RESULT:Last 5 games:");
+        for (int i = 0; i < g_lb.nGames && (size_t)n < cap; i++) {
+            LbGame *g = &g_lb.games[i];
+            char w[16] = "NULL";
+            if (g->winner) snprintf(w, sizeof(w), "%d", g->winner);
+            n += snprintf(msg + n, cap - n,
+                          " | GameID:%d Name:%s Status:%s Winner:%s",
+                          g->id, g->name, g->status, w);
+        }
+        break;
+    case LB_KILLS:
+        n = snprintf(msg, cap, "QUERY3_RESULT:Top 5 players by kills:");
+        for (int i = 0; i < g_lb.nKills && (size_t)n < cap; i++)
+            n += snprintf(msg + n, cap - n, " | User:%s Kills:%d",
+                          g_lb.kills[i].name, g_lb.kills[i].val);
+        break;
+    }
+    if ((size_t)n >= cap) n = (int)cap - 1;
+    msg[n++] = '\n';
+    lbSetLine(which, msg, n);
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Chargement depuis la base                                      */
+/* ─────────────────────────────────────────────────────────────── */
+static int lbLoad(DbConn *db)
+{
+    pthread_mutex_lock(&m_lb);
+    unsigned gen = g_lbGen;
+    pthread_mutex_unlock(&m_lb);
+
+    LbRow  score[LB_TOP], kills[LB_TOP];
+    LbGame games[LB_TOP];
+    int ns = loadTopScore(db, score, LB_TOP);
+    int ng = ns < 0 ? -1 : loadLastGames(db, games, LB_TOP);
+    int nk = ng < 0 ? -1 : loadTopKills(db, kills, LB_TOP);
+    if (nk < 0) return -1;
+
+    pthread_mutex_lock(&m_lb);
+    if (gen == g_lbGen || !g_lbValid) {
+        memcpy(g_lb.score, score, sizeof(score)); g_lb.nScore = ns;
+        memcpy(g_lb.games, games, sizeof(games)); g_lb.nGames = ng;
+        memcpy(g_lb.kills, kills, sizeof(kills)); g_lb.nKills = nk;
+        for (int w = 0; w < LB_COUNT; w++) lbRender(w);
+        g_lbValid = gen == g_lbGen;        /* sinon : rechargé au prochain QUERY */
+    }
+    pthread_mutex_unlock(&m_lb);
+    return 0;
+}
+
+void lbInit(void)
+{
+    DbConn *db = dbAcquire();
+    if (!db || lbLoad(db) < 0)
+        fprintf(stderr, "leaderboard: base indisponible, chargement différé\n");
+    dbRelease(db);
+}
+
+static void lbSend(Conn *c, int which)
+{
+    pthread_mutex_lock(&m_lb);
+    OutBuf *b = g_lb.line[which];
+    if (b) __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&m_lb);
+    if (!b) return;
+    connQueueBuf(c, b, MSG_CTRL);
+    outRelease(b);
+    connFlush(c);
+}
+
+/* QUERYn : réponse du cache ; -1 s’il est froid (à recharger via lbReload) */
+int lbServe(Conn *c, int which)
+{
+    pthread_mutex_lock(&m_lb);
+    int valid = g_lbValid;
+    pthread_mutex_unlock(&m_lb);
+    if (!valid) return -1;
+    lbSend(c, which);
+    return 0;
+}
+
+/* worker SQL : recharge le cache puis répond, même s’il a de nouveau
+ * été invalidé entre-temps (la réponse reflète la base relue)        */
+void lbReload(DbConn *db, Conn *c, int which)
+{
+    if (lbLoad(db) < 0) {
+        connSend(c, which == LB_SCORE ? "Query1 failed\n" :
+                    which == LB_GAMES ? "Query2 failed\n" : "Query3 failed\n", 14);
+        return;
+    }
+    lbSend(c, which);
+}
+
+void lbInvalidate(void)
+{
+    pthread_mutex_lock(&m_lb);
+    g_lbValid = 0;
+    g_lbGen++;
+    pthread_mutex_unlock(&m_lb);
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Mises à jour incrémentales  (thread écrivain, après COMMIT)    */
+/* ─────────────────────────────────────────────────────────────── */
+
+/* insère / remplace dans un top trié décroissant.
+ * same : une ligne par nom (scores) ou une ligne par partie (kills) */
+static int lbMerge(LbRow *t, int *n, const char *name, int val, int same)
+{
+    int i = *n;
+    if (same)
+        for (int j = 0; j < *n; j++)
+            if (strcmp(t[j].name, name) == 0) { i = j; break; }
+    if (i == *n) {                                   /* nouvelle ligne */
+        if (*n == LB_TOP && t[LB_TOP-1].val >= val) return 0;
+        if (*n < LB_TOP) (*n)++;
+        i = *n - 1;
+    }
+    for (; i > 0 && t[i-1].val < val; i--) t[i] = t[i-1];
+    strncpy(t[i].name, name, USERNAME_LEN - 1);
+    t[i].name[USERNAME_LEN - 1] = '\0';
+    t[i].val = val;
+    return 1;
+}
+
+void lbGameStarted(int id, const char *a, const char *b)
+{
+    pthread_mutex_lock(&m_lb);
+    g_lbGen++;
+    if (g_lbValid) {
+        if (g_lb.nGames < LB_TOP) g_lb.nGames++;
+        memmove(&g_lb.games[1], &g_lb.games[0], (g_lb.nGames - 1) * sizeof(LbGame));
+        LbGame *g = &g_lb.games[0];
+        g->id = id; g->winner = 0;
+        snprintf(g->name, sizeof(g->name), "Duel %s vs %s", a, b);
+        strcpy(g->status, "in_progress");
+        lbRender(LB_GAMES);
+    }
+    pthread_mutex_unlock(&m_lb);
+}
+
+/* winner == NULL : match nul, seul le statut change */
+void lbGameEnded(int id, const char *winner, int winnerId, int winnerScore,
+                 const char *loser)
+{
+    pthread_mutex_lock(&m_lb);
+    g_lbGen++;
+    if (g_lbValid) {
+        for (int i = 0; i < g_lb.nGames; i++)
+            if (g_lb.games[i].id == id) {
+                strcpy(g_lb.games[i].status, "finished");
+                if (winner) g_lb.games[i].winner = winnerId;
+                lbRender(LB_GAMES);
+                break;
+            }
+        if (winner) {
+            if (lbMerge(g_lb.score, &g_lb.nScore, winner, winnerScore, 1))
+                lbRender(LB_SCORE);
+            int k = lbMerge(g_lb.kills, &g_lb.nKills, winner, 1, 0);
+            k |= lbMerge(g_lb.kills, &g_lb.nKills, loser, 0, 0);
+            if (k) lbRender(LB_KILLS);
+        }
+    }
+    pthread_mutex_unlock(&m_lb);
+}
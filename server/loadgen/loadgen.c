@@ -0,0 +1,744 @@
+/* =============================================================
+ *  Dogfight loadgen – flotte de bots sans interface (Linux)
+ *  compile :  gcc -O2 -pthread loadgen.c -o loadgen -lm
+ *
+ *  Chaque bot parle le protocole texte du client : REGISTER, LOGIN,
+ *  puis les bots pairs invitent leur voisin impair, qui accepte ; en
+ *  partie chacun envoie MOVE et FIRE aux fréquences demandées, et
+ *  réinvite dès GAME_OVER jusqu’à la fin de l’essai.
+ *
+ *  Mesures (fusionnées en fin d’essai, rapport JSON) :
+ *   – MOVE → premier STATE qui montre la nouvelle position
+ *   – FIRE → FIRE_ACK du même tir (x, y)
+ *   – intervalle entre deux STATE reçus (cadence effective : le serveur
+ *     n’envoie que les changements, à 10–60 Hz selon la connexion)
+ *   – erreurs : connexion, login, déconnexion, réponses d’erreur
+ *
+ *  -U : MOVE et STATE par le canal UDP du serveur (jeton demandé après
+ *  LOGIN, voir udp.c) ; les STATE plus anciens que le dernier reçu sont
+ *  comptés et ignorés. Avec DOGFIGHT_UDP_LOSS côté serveur, mesure la
+ *  tenue du jeu sous pertes.
+ *
+ *  Hors ligne : serveur compilé contre stub/mysql_stub.c (voir ce
+ *  fichier), ou MySQL local initialisé avec CREATEBD.sql.
+ *
+ *  ./loadgen -n 2000 -d 60 -m 30 -f 2 -o report.json
+ * ===========================================================*/
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* ------------------ Paramètres généraux ------------------ */
+#define LG_USERNAME_LEN   50
+#define LG_INBUF          8192        /* > STATE_MAX_BYTES du serveur   */
+#define LG_OUTBUF         4096
+#define LG_PENDING_FIRE   16          /* tirs en attente de FIRE_ACK    */
+#define LG_FIRE_TIMEOUT   2000000000ULL   /* ns : tir jamais acquitté   */
+#define LG_INVITE_RETRY   1000000000ULL   /* ns : invitation sans suite */
+#define LG_MAX_EVENTS     256
+#define LG_BOARD_W        560         /* = BOARD_WIDTH / HEIGHT serveur */
+#define LG_BOARD_H        540
+#define LG_UDP_HELLO      100000000ULL    /* ns : relance de 'H'        */
+#define LG_UDP_MAX        2048        /* > UDP_MAX_PAYLOAD du serveur   */
+#define LG_UDP_TAG        1           /* bit bas de data.ptr : socket UDP */
+
+#define HIST_SUB_BITS     3           /* même découpage que metrics.c   */
+#define HIST_SUB          (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP      36
+#define HIST_BUCKETS      ((HIST_MAX_EXP - HIST_SUB_BITS + 1) * HIST_SUB)
+
+/* ----------------------- Structures ----------------------- */
+typedef struct {
+    uint64_t count, sum, max;
+    uint64_t b[HIST_BUCKETS];
+} Hist;
+
+enum { B_CONNECTING, B_REGISTER, B_LOGIN, B_LOBBY, B_INVITED, B_GAME, B_DONE };
+
+typedef struct {
+    uint64_t connectFail, loginFail, disconnects, serverErrors;
+    uint64_t connected, registered, loggedIn;
+    uint64_t gamesStarted, gamesEnded, invitesRetried;
+    uint64_t moves, fires, fireUnacked, states, hits;
+    uint64_t udpStates, udpStale;
+    uint64_t bytesIn, bytesOut, msgsIn;
+    Hist     moveLat, fireLat, stateGap;
+} Stats;
+
+typedef struct Bot Bot;
+struct Bot {
+    int      fd, idx, state;
+    int      ufd, udpOk;               /* canal UDP (-U), -1 : aucun   */
+    uint64_t token, helloAt;
+    uint32_t udpSeq, lastTick;         /* MOVE envoyés / STATE reçu    */
+    char     name[LG_USERNAME_LEN];
+    Bot     *peer;                     /* voisin de duel (même thread) */
+    int      inviter;                  /* 1 : c’est lui qui invite     */
+
+    char     in[LG_INBUF];
+    size_t   inLen;
+    char     out[LG_OUTBUF];
+    size_t   outLen;
+
+    uint64_t startAt;                  /* connexion (étalement)        */
+    uint64_t nextMove, nextFire, inviteAt;
+    uint64_t lastState;
+    int      seq;                      /* génère des positions uniques */
+    int      px, py;                   /* dernière position envoyée    */
+    uint64_t moveSent;                 /* 0 : rien en attente          */
+    struct { int x, y; uint64_t t; } fire[LG_PENDING_FIRE];
+};
+
+typedef struct {
+    pthread_t tid;
+    int       epfd;
+    Bot      *bots;
+    int       count;
+    Stats     st;
+} Worker;
+
+/* ----------------------- Configuration -------------------- */
+static struct {
+    const char *host, *prefix, *report;
+    int      port, bots, threads, noRegister, quiet, udp;
+    double   rampPerSec, moveHz, fireHz, duration;
+} g_cfg = { "127.0.0.1", "bot", NULL, 12345, 100, 0, 0, 0, 0, 500, 20, 1, 30 };
+
+static struct sockaddr_in g_addr;
+static uint64_t           g_t0, g_end;
+static volatile int       g_stop;
+
+/* =========================================================
+ *        Outils : horloge, histogrammes
+ * =======================================================*/
+static uint64_t nowNs(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
+}
+
+static int histIndex(uint64_t v)
+{
+    if (v >= 1ULL << HIST_MAX_EXP) v = (1ULL << HIST_MAX_EXP) - 1;
+    if (v < HIST_SUB) return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB + (int)((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+static uint64_t histUpper(int i)
+{
+    if (i < HIST_SUB) return (uint64_t)i;
+    int e = i / HIST_SUB + HIST_SUB_BITS - 1;
+    uint64_t lo = (uint64_t)(HIST_SUB + i % HIST_SUB) << (e - HIST_SUB_BITS);
+    return lo + (1ULL << (e - HIST_SUB_BITS)) - 1;
+}
+
+static void histRecord(Hist *h, uint64_t ns)
+{
+    h->b[histIndex(ns)]++;
+    h->count++;
+    h->sum += ns;
+    if (ns > h->max) h->max = ns;
+}
+
+static void histMerge(Hist *d, const Hist *s)
+{
+    d->count += s->count; d->sum += s->sum;
+    if (s->max > d->max) d->max = s->max;
+    for (int i = 0; i < HIST_BUCKETS; i++) d->b[i] += s->b[i];
+}
+
+static double histQuantileMs(const Hist *h, double q)
+{
+    if (!h->count) return 0;
+    uint64_t rank = (uint64_t)(q * (double)h->count + 0.5), seen = 0;
+    if (rank < 1) rank = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        if ((seen += h->b[i]) >= rank) {
+            uint64_t u = histUpper(i);
+            return (u < h->max ? u : h->max) / 1e6;
+        }
+    return h->max / 1e6;
+}
+
+/* =========================================================
+ *        Envoi : tampon par bot, write non bloquant
+ * =======================================================*/
+static void botClose(Worker *w, Bot *b, int error);
+
+static void botFlush(Worker *w, Bot *b)
+{
+    while (b->outLen) {
+        ssize_t n = write(b->fd, b->out, b->outLen);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) {
+            struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT, .data.ptr = b };
+            epoll_ctl(w->epfd, EPOLL_CTL_MOD, b->fd, &ev);
+            return;
+        }
+        if (n <= 0) { botClose(w, b, 1); return; }
+        w->st.bytesOut += (uint64_t)n;
+        memmove(b->out, b->out + n, b->outLen - (size_t)n);
+        b->outLen -= (size_t)n;
+    }
+}
+
+__attribute__((format(printf, 3, 4)))
+static void botSend(Worker *w, Bot *b, const char *fmt, ...)
+{
+    if (b->fd < 0) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(b->out + b->outLen, sizeof(b->out) - b->outLen, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= sizeof(b->out) - b->outLen) {
+        botClose(w, b, 1);                 /* serveur qui ne lit plus   */
+        return;
+    }
+    b->outLen += (size_t)n;
+    botFlush(w, b);
+}
+
+static void botClose(Worker *w, Bot *b, int error)
+{
+    if (b->fd < 0) return;
+    if (error && !g_stop) w->st.disconnects++;
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, b->fd, NULL);
+    close(b->fd);
+    b->fd = -1;
+    b->state = B_DONE;
+    if (b->ufd >= 0) {
+        epoll_ctl(w->epfd, EPOLL_CTL_DEL, b->ufd, NULL);
+        close(b->ufd);
+        b->ufd = -1;
+    }
+}
+
+/* =========================================================
+ *        Canal UDP (-U)
+ * =======================================================*/
+static void put32(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+
+static void udpSend(Worker *w, Bot *b, const uint8_t *d, size_t n)
+{
+    if (send(b->ufd, d, n, MSG_DONTWAIT) == (ssize_t)n) w->st.bytesOut += n;
+}
+
+static void udpHello(Worker *w, Bot *b, uint64_t now)
+{
+    uint8_t d[9] = { 'H' };
+    put32(d + 1, (uint32_t)b->token); put32(d + 5, (uint32_t)(b->token >> 32));
+    udpSend(w, b, d, sizeof(d));
+    b->helloAt = now + LG_UDP_HELLO;
+}
+
+/* UDP_TOKEN:<hex>:<port> : socket connectée au port annoncé */
+static void udpOpen(Worker *w, Bot *b, const char *line, uint64_t now)
+{
+    char *end;
+    b->token = strtoull(line + 10, &end, 16);
+    if (*end != ':' || b->ufd >= 0) return;
+    struct sockaddr_in a = g_addr;
+    a.sin_port = htons((uint16_t)atoi(end + 1));
+    b->ufd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (b->ufd < 0) return;
+    if (connect(b->ufd, (struct sockaddr *)&a, sizeof(a)) < 0) {
+        close(b->ufd); b->ufd = -1;
+        return;
+    }
+    struct epoll_event ev = { .events = EPOLLIN,
+                              .data.ptr = (char *)b + LG_UDP_TAG };
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, b->ufd, &ev);
+    udpHello(w, b, now);
+}
+
+static void onState(Worker *w, Bot *b, const char *line, uint64_t now);
+
+/* un état par datagramme : TICK:<tick>:<ms>\nSTATE:…\n, le plus récent gagne */
+static void udpReadable(Worker *w, Bot *b, uint64_t now)
+{
+    char d[LG_UDP_MAX + 1];
+    ssize_t n;
+    while (b->ufd >= 0 && (n = recv(b->ufd, d, LG_UDP_MAX, 0)) > 0) {
+        w->st.bytesIn += (uint64_t)n;
+        d[n] = '\0';
+        if (strncmp(d, "TICK:", 5)) continue;
+        uint32_t tick = (uint32_t)strtoul(d + 5, NULL, 10);
+        if (b->lastTick && (int32_t)(tick - b->lastTick) <= 0) { w->st.udpStale++; continue; }
+        b->lastTick = tick;
+        char *st = strstr(d, "\nSTATE:"), *nl;
+        if (!st) continue;
+        if ((nl = strchr(st + 1, '\n'))) *nl = '\0';
+        w->st.udpStates++;
+        onState(w, b, st + 1, now);
+    }
+}
+
+/* =========================================================
+ *        Scénario d’un bot
+ * =======================================================*/
+static void botConnect(Worker *w, Bot *b)
+{
+    b->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    if (b->fd >= 0) setsockopt(b->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (b->fd < 0 || (connect(b->fd, (struct sockaddr *)&g_addr, sizeof(g_addr)) < 0
+                      && errno != EINPROGRESS)) {
+        if (b->fd >= 0) close(b->fd);
+        b->fd = -1;
+        b->state = B_DONE;
+        w->st.connectFail++;
+        return;
+    }
+    b->state = B_CONNECTING;
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT, .data.ptr = b };
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, b->fd, &ev);
+}
+
+static void botLogin(Worker *w, Bot *b)
+{
+    b->state = B_LOGIN;
+    botSend(w, b, "LOGIN:%s:pw\n", b->name);
+}
+
+static void botEnterGame(Worker *w, Bot *b, uint64_t now)
+{
+    b->state     = B_GAME;
+    b->lastState = 0;
+    b->moveSent  = 0;
+    memset(b->fire, 0, sizeof(b->fire));
+    b->nextMove  = now + (uint64_t)(1e9 / g_cfg.moveHz * (b->idx % 7) / 7);
+    b->nextFire  = now + (uint64_t)(1e9 / g_cfg.fireHz);
+    w->st.gamesStarted++;
+}
+
+static void botMove(Worker *w, Bot *b, uint64_t now)
+{
+    /* positions entières, jamais deux fois la même d’affilée */
+    b->seq++;
+    b->px = 40 + (b->seq * 37 + b->idx * 11) % (LG_BOARD_W - 80);
+    b->py = 40 + (b->seq * 53 + b->idx * 7)  % (LG_BOARD_H - 80);
+    b->moveSent = now;
+    w->st.moves++;
+    if (b->udpOk) {
+        uint8_t d[17] = { 'M' };
+        put32(d + 1, (uint32_t)b->token); put32(d + 5, (uint32_t)(b->token >> 32));
+        put32(d + 9, ++b->udpSeq);
+        d[13] = (uint8_t)b->px; d[14] = (uint8_t)(b->px >> 8);
+        d[15] = (uint8_t)b->py; d[16] = (uint8_t)(b->py >> 8);
+        udpSend(w, b, d, sizeof(d));
+        return;
+    }
+    botSend(w, b, "MOVE:%d:%d\n", b->px, b->py);
+}
+
+static void botFire(Worker *w, Bot *b, uint64_t now)
+{
+    int slot = -1;
+    for (int i = 0; i < LG_PENDING_FIRE; i++) {
+        if (b->fire[i].t && now - b->fire[i].t > LG_FIRE_TIMEOUT) {
+            b->fire[i].t = 0;              /* refusé (MAX_ACTIVE_MISSILES) */
+            w->st.fireUnacked++;
+        }
+        if (!b->fire[i].t && slot < 0) slot = i;
+    }
+    if (slot < 0) return;
+    int dx = b->inviter ? 20 : -20;        /* vers l’adversaire */
+    b->fire[slot].x = b->px; b->fire[slot].y = b->py; b->fire[slot].t = now;
+    w->st.fires++;
+    botSend(w, b, "FIRE:%d:%d:%d:0\n", b->px, b->py, dx);
+}
+
+/* position « nom:x:y » de ce bot dans la 3e partie d’un STATE */
+static void onState(Worker *w, Bot *b, const char *line, uint64_t now)
+{
+    w->st.states++;
+    if (b->lastState) histRecord(&w->st.stateGap, now - b->lastState);
+    b->lastState = now;
+    if (!b->moveSent) return;
+
+    const char *pos = strchr(line, '|');
+    if (pos) pos = strchr(pos + 1, '|');
+    if (!pos) return;
+    char want[LG_USERNAME_LEN + 32];
+    int n = snprintf(want, sizeof(want), "%s:%d:%d", b->name, b->px, b->py);
+    for (const char *p = pos + 1; (p = strstr(p, want)); p++)
+        if ((p[-1] == '|' || p[-1] == ',') && (p[n] == ',' || p[n] == '\0')) {
+            histRecord(&w->st.moveLat, now - b->moveSent);
+            b->moveSent = 0;
+            break;
+        }
+}
+
+/* FIRE_ACK:id:owner:x:y:dx:dy */
+static void onFireAck(Worker *w, Bot *b, char *line, uint64_t now)
+{
+    char *sp, *f[7];
+    int k = 0;
+    for (char *t = strtok_r(line, ":", &sp); t && k < 7; t = strtok_r(NULL, ":", &sp)) f[k++] = t;
+    if (k < 6 || strcmp(f[2], b->name)) return;
+    int x = atoi(f[3]), y = atoi(f[4]);
+    for (int i = 0; i < LG_PENDING_FIRE; i++)
+        if (b->fire[i].t && b->fire[i].x == x && b->fire[i].y == y) {
+            histRecord(&w->st.fireLat, now - b->fire[i].t);
+            b->fire[i].t = 0;
+            return;
+        }
+}
+
+static void onLine(Worker *w, Bot *b, char *line, uint64_t now)
+{
+    w->st.msgsIn++;
+    if (strncmp(line, "STATE:", 6) == 0)            onState(w, b, line, now);
+    else if (strncmp(line, "FIRE_ACK:", 9) == 0)    onFireAck(w, b, line, now);
+    else if (strncmp(line, "HIT:", 4) == 0)         w->st.hits++;
+    else if (strncmp(line, "GAME_OVER:", 10) == 0) {
+        if (b->state == B_GAME) w->st.gamesEnded++;
+        b->state = B_LOBBY;
+        b->inviteAt = now + LG_INVITE_RETRY / 10;
+    }
+    else if (strncmp(line, "INVITE_REQUEST:", 15) == 0) {
+        char *sp, *inviter = strtok_r(line + 15, ":", &sp);
+        if (inviter && b->state == B_LOBBY)
+            botSend(w, b, "INVITE_RESP:%s:ACCEPT\n", inviter);
+    }
+    else if (strncmp(line, "INVITE_RESULT:", 14) == 0) {
+        if (strstr(line, ":ACCEPTED")) botEnterGame(w, b, now);
+        else if (b->state == B_INVITED) { b->state = B_LOBBY; b->inviteAt = now + LG_INVITE_RETRY; }
+    }
+    else if (strcmp(line, "Registration successful") == 0) { w->st.registered++; botLogin(w, b); }
+    else if (strcmp(line, "Registration failed") == 0)     botLogin(w, b);   /* déjà inscrit */
+    else if (strcmp(line, "Login successful") == 0) {
+        w->st.loggedIn++;
+        b->state = B_LOBBY;
+        b->inviteAt = now + LG_INVITE_RETRY / 10;
+        if (g_cfg.udp) botSend(w, b, "UDP\n");
+    }
+    else if (strncmp(line, "UDP_TOKEN:", 10) == 0) udpOpen(w, b, line, now);
+    else if (strcmp(line, "UDP_OK") == 0)          b->udpOk = 1;
+    else if (strcmp(line, "Invalid credentials") == 0 || strcmp(line, "Login failed") == 0 ||
+             strcmp(line, "Login query failed") == 0) {
+        w->st.loginFail++;
+        botClose(w, b, 0);
+    }
+    else if (strcmp(line, "DB unavailable") == 0)      w->st.serverErrors++;
+}
+
+static void botReadable(Worker *w, Bot *b, uint64_t now)
+{
+    while (b->fd >= 0) {
+        ssize_t n = read(b->fd, b->in + b->inLen, sizeof(b->in) - b->inLen - 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) return;
+        if (n <= 0) { botClose(w, b, 1); return; }
+        w->st.bytesIn += (uint64_t)n;
+        b->inLen += (size_t)n;
+
+        char *p = b->in, *end = b->in + b->inLen, *nl;
+        while (b->fd >= 0 && (nl = memchr(p, '\n', (size_t)(end - p)))) {
+            *nl = '\0';
+            if ((unsigned char)*p == 0xFF) { p = nl + 1; continue; }   /* jamais BIN1 */
+            onLine(w, b, p, now);
+            p = nl + 1;
+        }
+        if (b->fd < 0) return;
+        b->inLen = (size_t)(end - p);
+        memmove(b->in, p, b->inLen);
+        if (b->inLen >= sizeof(b->in) - 1) { botClose(w, b, 1); return; }
+    }
+}
+
+static void botWritable(Worker *w, Bot *b)
+{
+    if (b->state == B_CONNECTING) {
+        int err = 0;
+        socklen_t l = sizeof(err);
+        getsockopt(b->fd, SOL_SOCKET, SO_ERROR, &err, &l);
+        if (err) {
+            w->st.connectFail++;
+            botClose(w, b, 0);
+            return;
+        }
+        w->st.connected++;
+        if (g_cfg.noRegister) botLogin(w, b);
+        else {
+            b->state = B_REGISTER;
+            botSend(w, b, "REGISTER:%s:%s@loadgen.local:pw\n", b->name, b->name);
+        }
+    }
+    if (b->fd < 0) return;
+    if (b->outLen) botFlush(w, b);
+    if (!b->outLen) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = b };
+        epoll_ctl(w->epfd, EPOLL_CTL_MOD, b->fd, &ev);
+    }
+}
+
+/* actions programmées ; renvoie la prochaine échéance */
+static uint64_t botTimers(Worker *w, Bot *b, uint64_t now)
+{
+    uint64_t next = UINT64_MAX;
+    if (b->state == B_DONE && b->fd < 0 && b->startAt) {
+        if (now >= b->startAt) { b->startAt = 0; botConnect(w, b); }
+        else return b->startAt;
+    }
+    if (b->state == B_LOBBY && b->inviter && b->peer->state == B_LOBBY) {
+        if (now >= b->inviteAt) {
+            b->state = B_INVITED;
+            b->inviteAt = now + LG_INVITE_RETRY;
+            botSend(w, b, "INVITE:%s\n", b->peer->name);
+        }
+        next = b->inviteAt;
+    }
+    if (b->ufd >= 0 && !b->udpOk) {            /* 'H' perdu : on relance */
+        if (now >= b->helloAt) udpHello(w, b, now);
+        next = b->helloAt;
+    }
+    if (b->state == B_INVITED) {               /* ni réponse ni refus : on relance */
+        if (now >= b->inviteAt) { b->state = B_LOBBY; w->st.invitesRetried++; }
+        next = b->inviteAt;
+    }
+    if (b->state == B_GAME) {
+        if (now >= b->nextMove) {
+            botMove(w, b, now);
+            b->nextMove += (uint64_t)(1e9 / g_cfg.moveHz);
+            if (b->nextMove < now) b->nextMove = now;
+        }
+        if (g_cfg.fireHz > 0 && now >= b->nextFire) {
+            botFire(w, b, now);
+            b->nextFire += (uint64_t)(1e9 / g_cfg.fireHz);
+            if (b->nextFire < now) b->nextFire = now;
+        }
+        if (b->nextMove < next) next = b->nextMove;
+        if (g_cfg.fireHz > 0 && b->nextFire < next) next = b->nextFire;
+    }
+    return next;
+}
+
+static void *workerLoop(void *arg)
+{
+    Worker *w = arg;
+    struct epoll_event evs[LG_MAX_EVENTS];
+    while (!g_stop) {
+        uint64_t now = nowNs(), next = g_end;
+        if (now >= g_end) break;
+        for (int i = 0; i < w->count; i++) {
+            uint64_t t = botTimers(w, &w->bots[i], now);
+            if (t < next) next = t;
+        }
+        now = nowNs();
+        uint64_t wait = next > now ? next - now : 0;
+        int ms = wait > 100000000ULL ? 100 : (int)((wait + 999999) / 1000000);
+        int n = epoll_wait(w->epfd, evs, LG_MAX_EVENTS, ms);
+        now = nowNs();
+        for (int i = 0; i < n; i++) {
+            uintptr_t tag = (uintptr_t)evs[i].data.ptr & LG_UDP_TAG;
+            Bot *b = (Bot *)((char *)evs[i].data.ptr - tag);
+            if (b->fd < 0) continue;
+            if (tag) { udpReadable(w, b, now); continue; }
+            if (evs[i].events & (EPOLLOUT | EPOLLERR)) botWritable(w, b);
+            if (b->fd >= 0 && (evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                botReadable(w, b, now);
+        }
+    }
+    /* fin d’essai : départ propre */
+    for (int i = 0; i < w->count; i++) {
+        Bot *b = &w->bots[i];
+        if (b->fd < 0) continue;
+        if (b->state >= B_LOBBY) botSend(w, b, "LOGOUT\n");
+        botClose(w, b, 0);
+    }
+    return NULL;
+}
+
+/* =========================================================
+ *        Rapport
+ * =======================================================*/
+static void jsonHist(FILE *f, const char *name, const Hist *h, int last)
+{
+    fprintf(f, "    \"%s\": { \"count\": %llu, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+               "\"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f }%s\n",
+            name, (unsigned long long)h->count, h->count ? h->sum / 1e6 / h->count : 0.0,
+            histQuantileMs(h, 0.5), histQuantileMs(h, 0.9), histQuantileMs(h, 0.99),
+            histQuantileMs(h, 0.999), h->max / 1e6, last ? "" : ",");
+}
+
+static void report(FILE *f, const Stats *s, double elapsed)
+{
+#define U(x) (unsigned long long)(x)
+    uint64_t errors = s->connectFail + s->loginFail + s->disconnects + s->serverErrors;
+    uint64_t attempts = s->connected + s->connectFail;
+    fprintf(f, "{\n  \"config\": { \"host\": \"%s\", \"port\": %d, \"bots\": %d, \"threads\": %d, "
+               "\"ramp_per_s\": %.1f, \"move_hz\": %.1f, \"fire_hz\": %.1f, \"duration_s\": %.1f, "
+               "\"register\": %s, \"udp\": %s },\n",
+            g_cfg.host, g_cfg.port, g_cfg.bots, g_cfg.threads, g_cfg.rampPerSec,
+            g_cfg.moveHz, g_cfg.fireHz, g_cfg.duration, g_cfg.noRegister ? "false" : "true",
+            g_cfg.udp ? "true" : "false");
+    fprintf(f, "  \"elapsed_s\": %.3f,\n", elapsed);
+    fprintf(f, "  \"sessions\": { \"connected\": %llu, \"registered\": %llu, \"logged_in\": %llu, "
+               "\"games_started\": %llu, \"games_ended\": %llu, \"invites_retried\": %llu },\n",
+            U(s->connected), U(s->registered), U(s->loggedIn), U(s->gamesStarted / 2),
+            U(s->gamesEnded / 2), U(s->invitesRetried));
+    fprintf(f, "  \"traffic\": { \"moves\": %llu, \"fires\": %llu, \"fires_unacked\": %llu, "
+               "\"states\": %llu, \"udp_states\": %llu, \"udp_stale\": %llu, \"hits\": %llu, "
+               "\"msgs_in\": %llu, \"bytes_in\": %llu, \"bytes_out\": %llu },\n",
+            U(s->moves), U(s->fires), U(s->fireUnacked), U(s->states), U(s->udpStates),
+            U(s->udpStale), U(s->hits), U(s->msgsIn), U(s->bytesIn), U(s->bytesOut));
+    fprintf(f, "  \"errors\": { \"connect\": %llu, \"login\": %llu, \"disconnect\": %llu, "
+               "\"server\": %llu, \"total\": %llu, \"rate\": %.6f },\n",
+            U(s->connectFail), U(s->loginFail), U(s->disconnects), U(s->serverErrors),
+            U(errors), attempts ? (double)errors / (double)attempts : 0.0);
+    fprintf(f, "  \"latency_ms\": {\n");
+    jsonHist(f, "move_to_state", &s->moveLat, 0);
+    jsonHist(f, "fire_to_ack",   &s->fireLat, 0);
+    jsonHist(f, "state_interval", &s->stateGap, 1);
+    fprintf(f, "  }\n}\n");
+#undef U
+}
+
+/* =========================================================
+ *                        MAIN
+ * =======================================================*/
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+        "usage: %s [-H host] [-p port] [-n bots] [-t threads] [-r connexions/s]\n"
+        "          [-m move_hz] [-f fire_hz] [-d secondes] [-u préfixe] [-R] [-U] [-q]\n"
+        "          [-o rapport.json]\n"
+        "  -R : comptes déjà créés (pas de REGISTER)\n"
+        "  -U : MOVE / STATE par le canal UDP\n", argv0);
+    exit(2);
+}
+
+static void onSignal(int s) { (void)s; g_stop = 1; }
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "H:p:n:t:r:m:f:d:u:o:RUq")) != -1)
+        switch (opt) {
+        case 'H': g_cfg.host       = optarg;       break;
+        case 'p': g_cfg.port       = atoi(optarg); break;
+        case 'n': g_cfg.bots       = atoi(optarg); break;
+        case 't': g_cfg.threads    = atoi(optarg); break;
+        case 'r': g_cfg.rampPerSec = atof(optarg); break;
+        case 'm': g_cfg.moveHz     = atof(optarg); break;
+        case 'f': g_cfg.fireHz     = atof(optarg); break;
+        case 'd': g_cfg.duration   = atof(optarg); break;
+        case 'u': g_cfg.prefix     = optarg;       break;
+        case 'o': g_cfg.report     = optarg;       break;
+        case 'R': g_cfg.noRegister = 1;            break;
+        case 'U': g_cfg.udp        = 1;            break;
+        case 'q': g_cfg.quiet      = 1;            break;
+        default:  usage(argv[0]);
+        }
+    g_cfg.bots &= ~1;                               /* par paires */
+    if (g_cfg.bots < 2 || g_cfg.moveHz <= 0 || g_cfg.rampPerSec <= 0) usage(argv[0]);
+    if (g_cfg.threads <= 0) {
+        long c = sysconf(_SC_NPROCESSORS_ONLN);
+        g_cfg.threads = c > 0 ? (int)c : 1;
+    }
+    if (g_cfg.threads > g_cfg.bots / 2) g_cfg.threads = g_cfg.bots / 2;
+
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM }, *ai;
+    if (getaddrinfo(g_cfg.host, NULL, &hints, &ai) != 0) {
+        fprintf(stderr, "hôte inconnu : %s\n", g_cfg.host);
+        return 1;
+    }
+    g_addr = *(struct sockaddr_in *)ai->ai_addr;
+    g_addr.sin_port = htons((uint16_t)g_cfg.port);
+    freeaddrinfo(ai);
+
+    /* un fd par bot : on monte la limite au maximum autorisé */
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    g_t0  = nowNs();
+    g_end = g_t0 + (uint64_t)(g_cfg.duration * 1e9);
+
+    /* paires réparties entre threads : un duel ne franchit pas de thread */
+    Worker *w = calloc((size_t)g_cfg.threads, sizeof(Worker));
+    int pairs = g_cfg.bots / 2;
+    for (int t = 0, first = 0; t < g_cfg.threads; t++) {
+        int np = pairs / g_cfg.threads + (t < pairs % g_cfg.threads);
+        w[t].count = np * 2;
+        w[t].bots  = calloc((size_t)w[t].count, sizeof(Bot));
+        w[t].epfd  = epoll_create1(EPOLL_CLOEXEC);
+        if (!w[t].bots || w[t].epfd < 0) { perror("loadgen"); return 1; }
+        for (int i = 0; i < w[t].count; i++) {
+            Bot *b = &w[t].bots[i];
+            b->idx     = first + i;
+            b->fd      = -1;
+            b->ufd     = -1;
+            b->state   = B_DONE;
+            b->peer    = &w[t].bots[i ^ 1];
+            b->inviter = !(i & 1);
+            b->startAt = g_t0 + 1 + (uint64_t)(b->idx / g_cfg.rampPerSec * 1e9);
+            snprintf(b->name, sizeof(b->name), "%s%06d", g_cfg.prefix, b->idx);
+        }
+        first += w[t].count;
+    }
+    for (int t = 0; t < g_cfg.threads; t++)
+        pthread_create(&w[t].tid, NULL, workerLoop, &w[t]);
+
+    /* avancement sur stderr, une ligne par seconde */
+    while (!g_stop && nowNs() < g_end) {
+        struct timespec s = { 1, 0 };
+        nanosleep(&s, NULL);
+        if (g_cfg.quiet) continue;
+        uint64_t logged = 0, games = 0, states = 0, errs = 0;
+        for (int t = 0; t < g_cfg.threads; t++) {
+            const Stats *st = &w[t].st;       /* lecture approximative */
+            logged += st->loggedIn; games += st->gamesStarted; states += st->states;
+            errs   += st->connectFail + st->loginFail + st->disconnects + st->serverErrors;
+        }
+        fprintf(stderr, "[%5.1fs] logged=%llu games=%llu states=%llu errors=%llu\n",
+                (nowNs() - g_t0) / 1e9, (unsigned long long)logged,
+                (unsigned long long)games / 2, (unsigned long long)states,
+                (unsigned long long)errs);
+    }
+    g_stop = 1;
+
+    Stats *total = calloc(1, sizeof(Stats));
+    for (int t = 0; t < g_cfg.threads; t++) {
+        pthread_join(w[t].tid, NULL);
+        const Stats *s = &w[t].st;
+        uint64_t *d = (uint64_t *)total;
+        const uint64_t *src = (const uint64_t *)s;
+        for (size_t k = 0; k < offsetof(Stats, moveLat) / sizeof(uint64_t); k++) d[k] += src[k];
+        histMerge(&total->moveLat, &s->moveLat);
+        histMerge(&total->fireLat, &s->fireLat);
+        histMerge(&total->stateGap, &s->stateGap);
+    }
+    double elapsed = (nowNs() - g_t0) / 1e9;
+
+    FILE *f = g_cfg.report ? fopen(g_cfg.report, "w") : stdout;
+    if (!f) { perror(g_cfg.report); f = stdout; }
+    report(f, total, elapsed);
+    if (f != stdout) fclose(f);
+    return 0;
+}
@@ -0,0 +1,61 @@
+/* ==================================================================
+ *     <mysql/mysql.h> DE SUBSTITUTION  – serveur sans MySQL (charge)
+ *
+ *  Juste ce que server.c et ses modules appellent, avec les mêmes
+ *  noms et la même sémantique d’erreur que libmysqlclient. Voir
+ *  mysql_stub.c ; ne pas utiliser en production.
+ * ================================================================== */
+#ifndef DOGFIGHT_MYSQL_STUB_H
+#define DOGFIGHT_MYSQL_STUB_H
+
+typedef char               my_bool;
+typedef unsigned long long my_ulonglong;
+
+enum enum_field_types {
+    MYSQL_TYPE_LONG   = 3,
+    MYSQL_TYPE_NULL   = 6,
+    MYSQL_TYPE_STRING = 254
+};
+
+typedef struct {
+    unsigned long        *length;
+    my_bool              *is_null;
+    void                 *buffer;
+    my_bool              *error;
+    enum enum_field_types buffer_type;
+    unsigned long         buffer_length;
+    my_bool               is_unsigned;
+} MYSQL_BIND;
+
+typedef struct MYSQL      MYSQL;
+typedef struct MYSQL_STMT MYSQL_STMT;
+
+#define MYSQL_NO_DATA        100
+#define MYSQL_DATA_TRUNCATED 101
+
+int          mysql_library_init(int, char **, char **);
+MYSQL       *mysql_init(MYSQL *);
+MYSQL       *mysql_real_connect(MYSQL *, const char *, const char *, const char *,
+                                const char *, unsigned int, const char *, unsigned long);
+void         mysql_close(MYSQL *);
+int          mysql_ping(MYSQL *);
+int          mysql_query(MYSQL *, const char *);
+const char  *mysql_error(MYSQL *);
+unsigned int mysql_errno(MYSQL *);
+
+MYSQL_STMT  *mysql_stmt_init(MYSQL *);
+int          mysql_stmt_prepare(MYSQL_STMT *, const char *, unsigned long);
+my_bool      mysql_stmt_bind_param(MYSQL_STMT *, MYSQL_BIND *);
+my_bool      mysql_stmt_bind_result(MYSQL_STMT *, MYSQL_BIND *);
+int          mysql_stmt_execute(MYSQL_STMT *);
+int          mysql_stmt_store_result(MYSQL_STMT *);
+int          mysql_stmt_fetch(MYSQL_STMT *);
+my_bool      mysql_stmt_free_result(MYSQL_STMT *);
+my_bool      mysql_stmt_reset(MYSQL_STMT *);
+my_bool      mysql_stmt_close(MYSQL_STMT *);
+my_ulonglong mysql_stmt_insert_id(MYSQL_STMT *);
+my_ulonglong mysql_stmt_affected_rows(MYSQL_STMT *);
+const char  *mysql_stmt_error(MYSQL_STMT *);
+unsigned int mysql_stmt_errno(MYSQL_STMT *);
+
+#endif
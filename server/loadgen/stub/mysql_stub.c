@@ -0,0 +1,262 @@
+/* ==================================================================
+ *     libmysqlclient DE SUBSTITUTION  – table players en mémoire
+ *
+ *  Pour les essais de charge hors ligne (loadgen.c) : le serveur est
+ *  compilé contre ce fichier au lieu de -lmysqlclient, rien d’autre
+ *  ne change.
+ *      gcc -O2 -pthread -Iloadgen/stub server.c loadgen/stub/mysql_stub.c \
+ *          -o server-offline -lm
+ *  Les requêtes préparées sont reconnues par leur début (g_stmtSql et
+ *  g_rowSql de db_pool.c) ; les requêtes multi-lignes comptent leurs
+ *  lignes au nombre de '?' :
+ *   – inscription (doublon refusé), login, suppression, score : vrais
+ *   – top des scores calculé sur la table ; parties, historique et
+ *     kills : acceptés mais non conservés (classements vides)
+ *  DOGFIGHT_STUB_LATENCY_US simule le temps d’aller-retour du serveur.
+ * ================================================================== */
+#include "mysql/mysql.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define STUB_USERS     4096            /* cases de la table (2^n)        */
+#define STUB_ROWS      5               /* LIMIT 5 des classements        */
+#define STUB_COLS      4
+#define STUB_STR       128
+#define ER_DUP_ENTRY   1062
+
+typedef struct StubUser {
+    struct StubUser *next;
+    int   id, score;
+    char  name[STUB_STR], pass[STUB_STR];
+} StubUser;
+
+struct MYSQL { int dummy; };
+
+enum { Q_LOGIN, Q_REGISTER, Q_DELETE, Q_TOP_SCORE, Q_SCORE_ADD,
+       Q_PLAYER_SCORE, Q_GAME_INSERT, Q_OTHER };
+
+typedef struct { int isStr, i; char s[STUB_STR]; } StubVal;
+
+struct MYSQL_STMT {
+    int          kind, nCols;          /* colonnes du résultat         */
+    MYSQL_BIND  *params, *result;
+    StubVal      rows[STUB_ROWS][STUB_COLS];
+    int          nRows, cur;
+    int          batch;                /* lignes par exécution         */
+    unsigned     err;
+    my_ulonglong insertId, affected;
+};
+
+static StubUser       *g_users[STUB_USERS];
+static int             g_nextId = 1, g_nextGame = 1;
+static pthread_mutex_t m_stub = PTHREAD_MUTEX_INITIALIZER;
+static useconds_t      g_latency;
+
+static uint32_t stubHash(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h & (STUB_USERS - 1);
+}
+
+static StubUser **stubFind(const char *name)
+{
+    StubUser **p = &g_users[stubHash(name)];
+    while (*p && strcmp((*p)->name, name)) p = &(*p)->next;
+    return p;
+}
+
+/* paramètre i en texte (chaîne ou entier), "" si NULL */
+static void stubParam(const MYSQL_STMT *st, int i, char *out)
+{
+    const MYSQL_BIND *b = &st->params[i];
+    out[0] = '\0';
+    if (b->buffer_type == MYSQL_TYPE_LONG)
+        snprintf(out, STUB_STR, "%d", *(int *)b->buffer);
+    else if (b->buffer_type == MYSQL_TYPE_STRING && b->buffer) {
+        unsigned long n = b->length ? *b->length : strlen(b->buffer);
+        if (n >= STUB_STR) n = STUB_STR - 1;
+        memcpy(out, b->buffer, n);
+        out[n] = '\0';
+    }
+}
+
+static void rowInt(StubVal *v, int i)            { v->isStr = 0; v->i = i; }
+static void rowStr(StubVal *v, const char *s)    { v->isStr = 1; snprintf(v->s, STUB_STR, "%s", s); }
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Connexion                                                      */
+/* ─────────────────────────────────────────────────────────────── */
+int mysql_library_init(int a, char **b, char **c)
+{
+    (void)a; (void)b; (void)c;
+    const char *l = getenv("DOGFIGHT_STUB_LATENCY_US");
+    g_latency = l ? (useconds_t)strtoul(l, NULL, 10) : 0;
+    return 0;
+}
+
+MYSQL *mysql_init(MYSQL *m)                     { return m ? m : calloc(1, sizeof(MYSQL)); }
+MYSQL *mysql_real_connect(MYSQL *m, const char *h, const char *u, const char *p,
+                          const char *d, unsigned int port, const char *s, unsigned long f)
+{
+    (void)h; (void)u; (void)p; (void)d; (void)port; (void)s; (void)f;
+    return m;
+}
+void         mysql_close(MYSQL *m)              { free(m); }
+int          mysql_ping(MYSQL *m)               { (void)m; return 0; }
+int          mysql_query(MYSQL *m, const char *q) { (void)m; (void)q; return 0; }
+const char  *mysql_error(MYSQL *m)              { (void)m; return ""; }
+unsigned int mysql_errno(MYSQL *m)              { (void)m; return 0; }
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Requêtes préparées                                             */
+/* ─────────────────────────────────────────────────────────────── */
+MYSQL_STMT *mysql_stmt_init(MYSQL *m)           { (void)m; return calloc(1, sizeof(MYSQL_STMT)); }
+
+int mysql_stmt_prepare(MYSQL_STMT *st, const char *q, unsigned long len)
+{
+    static const struct { const char *prefix; int kind, nCols, perRow; } k[] = {
+        { "SELECT id_player, username FROM players",    Q_LOGIN,        2, 0 },
+        { "INSERT INTO players",                        Q_REGISTER,     0, 0 },
+        { "DELETE FROM players",                        Q_DELETE,       0, 0 },
+        { "SELECT username, total_score FROM players",  Q_TOP_SCORE,    2, 0 },
+        { "UPDATE players p JOIN (",                    Q_SCORE_ADD,    0, 2 },
+        { "SELECT id_player, total_score FROM players", Q_PLAYER_SCORE, 2, 0 },
+        { "INSERT INTO game(",                          Q_GAME_INSERT,  0, 2 },
+    };
+    int nParams = 0;
+    for (unsigned long i = 0; i < len; i++) nParams += q[i] == '?';
+    st->kind  = Q_OTHER;                              /* jamais de ligne */
+    st->nCols = 0;
+    st->batch = 1;
+    for (size_t i = 0; i < sizeof(k) / sizeof(k[0]); i++)
+        if (strncmp(q, k[i].prefix, strlen(k[i].prefix)) == 0) {
+            st->kind = k[i].kind; st->nCols = k[i].nCols;
+            if (k[i].perRow && nParams >= k[i].perRow) st->batch = nParams / k[i].perRow;
+            break;
+        }
+    return 0;
+}
+
+my_bool mysql_stmt_bind_param(MYSQL_STMT *st, MYSQL_BIND *b)  { st->params = b; return 0; }
+my_bool mysql_stmt_bind_result(MYSQL_STMT *st, MYSQL_BIND *b) { st->result = b; return 0; }
+
+int mysql_stmt_execute(MYSQL_STMT *st)
+{
+    char a[STUB_STR], b[STUB_STR];
+    st->nRows = st->cur = 0;
+    st->err = 0;
+    st->affected = (my_ulonglong)st->batch;
+    if (g_latency) usleep(g_latency);
+
+    pthread_mutex_lock(&m_stub);
+    switch (st->kind) {
+    case Q_LOGIN: {                                   /* username, password */
+        stubParam(st, 0, a); stubParam(st, 1, b);
+        StubUser *u = *stubFind(a);
+        if (u && strcmp(u->pass, b) == 0) {
+            rowInt(&st->rows[0][0], u->id);
+            rowStr(&st->rows[0][1], u->name);
+            st->nRows = 1;
+        }
+        break;
+    }
+    case Q_REGISTER: {                                /* username, email, password */
+        stubParam(st, 0, a); stubParam(st, 2, b);
+        StubUser **p = stubFind(a);
+        if (*p) { st->err = ER_DUP_ENTRY; break; }
+        StubUser *u = calloc(1, sizeof(StubUser));
+        if (!u) { st->err = 2008; break; }           /* CR_OUT_OF_MEMORY */
+        u->id = g_nextId++;
+        snprintf(u->name, STUB_STR, "%s", a);
+        snprintf(u->pass, STUB_STR, "%s", b);
+        *p = u;
+        st->insertId = (my_ulonglong)u->id;
+        break;
+    }
+    case Q_DELETE: {
+        stubParam(st, 0, a);
+        StubUser **p = stubFind(a), *u = *p;
+        if (u) { *p = u->next; free(u); }
+        break;
+    }
+    case Q_SCORE_ADD:                                 /* (points, username) × batch */
+        for (int r = 0; r < st->batch; r++) {
+            stubParam(st, 2 * r, a); stubParam(st, 2 * r + 1, b);
+            StubUser *u = *stubFind(b);
+            if (u) u->score += atoi(a);
+        }
+        break;
+    case Q_PLAYER_SCORE: {
+        stubParam(st, 0, a);
+        StubUser *u = *stubFind(a);
+        if (u) {
+            rowInt(&st->rows[0][0], u->id);
+            rowInt(&st->rows[0][1], u->score);
+            st->nRows = 1;
+        }
+        break;
+    }
+    case Q_TOP_SCORE: {                               /* tri par insertion, 5 lignes */
+        const StubUser *top[STUB_ROWS];
+        int n = 0;
+        for (int h = 0; h < STUB_USERS; h++)
+            for (const StubUser *u = g_users[h]; u; u = u->next) {
+                if (n == STUB_ROWS && top[n-1]->score >= u->score) continue;
+                int i = n < STUB_ROWS ? n++ : n - 1;
+                for (; i > 0 && top[i-1]->score < u->score; i--) top[i] = top[i-1];
+                top[i] = u;
+            }
+        for (int i = 0; i < n; i++) {
+            rowStr(&st->rows[i][0], top[i]->name);
+            rowInt(&st->rows[i][1], top[i]->score);
+        }
+        st->nRows = n;
+        break;
+    }
+    case Q_GAME_INSERT:
+        st->insertId = (my_ulonglong)g_nextGame;     /* ids consécutifs */
+        g_nextGame  += st->batch;
+        break;
+    }
+    pthread_mutex_unlock(&m_stub);
+    if (st->err) st->affected = 0;
+    return st->err ? 1 : 0;
+}
+
+int mysql_stmt_store_result(MYSQL_STMT *st)     { (void)st; return 0; }
+
+int mysql_stmt_fetch(MYSQL_STMT *st)
+{
+    if (st->cur >= st->nRows) return MYSQL_NO_DATA;
+    int trunc = 0;
+    const StubVal *row = st->rows[st->cur++];
+    for (int c = 0; c < st->nCols && st->result; c++) {
+        MYSQL_BIND *b = &st->result[c];
+        if (b->is_null) *b->is_null = 0;
+        if (b->buffer_type == MYSQL_TYPE_LONG) {
+            *(int *)b->buffer = row[c].isStr ? atoi(row[c].s) : row[c].i;
+        } else {
+            char tmp[STUB_STR];
+            const char *s = row[c].isStr ? row[c].s : (snprintf(tmp, sizeof(tmp), "%d", row[c].i), tmp);
+            unsigned long n = strlen(s);
+            if (b->length) *b->length = n;
+            if (n >= b->buffer_length) { trunc = 1; n = b->buffer_length ? b->buffer_length - 1 : 0; }
+            memcpy(b->buffer, s, n);
+            if (b->buffer_length) ((char *)b->buffer)[n] = '\0';
+        }
+    }
+    return trunc ? MYSQL_DATA_TRUNCATED : 0;
+}
+
+my_bool      mysql_stmt_free_result(MYSQL_STMT *st) { st->nRows = st->cur = 0; return 0; }
+my_bool      mysql_stmt_reset(MYSQL_STMT *st)   { st->nRows = st->cur = 0; return 0; }
+my_bool      mysql_stmt_close(MYSQL_STMT *st)   { free(st); return 0; }
+my_ulonglong mysql_stmt_insert_id(MYSQL_STMT *st) { return st->insertId; }
+my_ulonglong mysql_stmt_affected_rows(MYSQL_STMT *st) { return st->affected; }
+const char  *mysql_stmt_error(MYSQL_STMT *st)   { return st->err == ER_DUP_ENTRY ? "Duplicate entry" : st->err ? "stub error" : ""; }
+unsigned int mysql_stmt_errno(MYSQL_STMT *st)   { return st->err; }
@@ -0,0 +1,512 @@
+/* ==================================================================
+ *          MÉTRIQUES  – compteurs par thread, histogrammes de latence
+ *
+ *  Chaque thread écrit dans SA MetShard (allouée au premier usage) :
+ *  pas d’atomique partagé sur le chemin chaud, une simple écriture
+ *  relaxée. La lecture (STATS, socket d’admin) additionne les shards.
+ *   – histogrammes log-linéaires façon HDR : 8 cases par puissance de
+ *     2 (≈ 12 % d’erreur relative), de 1 ns à 2^36 ns (≈ 69 s)
+ *   – messages sortants comptés par type (préfixe avant « : »), comme
+ *     les commandes entrantes ; le type est fixé une fois par OutBuf
+ *   – rendu texte au format d’exposition Prometheus (summary pour les
+ *     latences, counter / gauge pour le reste), en secondes
+ *   – socket UNIX locale (DOGFIGHT_ADMIN_SOCKET) : une connexion = un
+ *     relevé ; « GET … » reçoit une réponse HTTP/1.0 pour les scrapers
+ * ================================================================== */
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HIST_SUB_BITS    3
+#define HIST_SUB         (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP     36                    /* valeurs bornées à 2^36-1 */
+#define HIST_BUCKETS     ((HIST_MAX_EXP - HIST_SUB_BITS + 1) * HIST_SUB)
+#define MET_ADMIN_SOCKET "/tmp/dogfight-admin.sock"
+
+/* commandes client, dans l’ordre de g_cmdName */
+enum {
+    CMD_REGISTER, CMD_LOGIN, CMD_CHAT, CMD_QUERY1, CMD_QUERY2, CMD_QUERY3,
+    CMD_INVITE, CMD_INVITE_RESP, CMD_MOVE, CMD_ACK, CMD_FIRE, CMD_LIST,
+    CMD_DELETE_ME, CMD_LOGOUT, CMD_STATS,
+    CMD_ARENA, CMD_ARENA_LEAVE, CMD_SPECTATE, CMD_SPECTATE_LEAVE,
+    CMD_UDP, CMD_UDP_OFF, CMD_REPLAY, CMD_REPLAY_STOP,
+    CMD_OTHER, CMD_COUNT
+};
+
+static const char *const g_cmdName[CMD_COUNT] = {
+    "REGISTER", "LOGIN", "CHAT", "QUERY1", "QUERY2", "QUERY3",
+    "INVITE", "INVITE_RESP", "MOVE", "ACK", "FIRE", "LIST",
+    "DELETE_ME", "LOGOUT", "STATS",
+    "ARENA", "ARENA_LEAVE", "SPECTATE", "SPECTATE_LEAVE",
+    "UDP", "UDP_OFF", "REPLAY", "REPLAY_STOP",
+    "other"
+};
+
+/* messages sortants, dans l’ordre de g_outName ; OUT_SNAP : trame
+ * binaire (SNAP_MAGIC), OUT_OTHER : réponses en texte libre          */
+enum {
+    OUT_STATE, OUT_SNAP, OUT_FIRE_ACK, OUT_HIT, OUT_GAME_OVER,
+    OUT_MATCH_SLOTS, OUT_CHAT, OUT_INVITE_REQUEST, OUT_INVITE_RESULT,
+    OUT_ARENA_WAIT, OUT_ARENA_FAIL,
+    OUT_SPECTATE_OK, OUT_SPECTATE_FAIL, OUT_SPECTATE_END,
+    OUT_UDP_TOKEN, OUT_UDP_OK, OUT_UDP_FAIL,
+    OUT_RECORD, OUT_REPLAY_OK, OUT_REPLAY_FAIL, OUT_REPLAY_END,
+    OUT_PLAYERS, OUT_PLAYER_JOIN, OUT_PLAYER_LEAVE,
+    OUT_QUERY1_RESULT, OUT_QUERY2_RESULT, OUT_QUERY3_RESULT,
+    OUT_PROTO, OUT_LOGOUT_OK, OUT_STATS_BEGIN, OUT_STATS_DENIED,
+    OUT_OTHER, OUT_COUNT
+};
+
+static const char *const g_outName[OUT_COUNT] = {
+    "STATE", "binary", "FIRE_ACK", "HIT", "GAME_OVER",
+    "MATCH_SLOTS", "CHAT", "INVITE_REQUEST", "INVITE_RESULT",
+    "ARENA_WAIT", "ARENA_FAIL",
+    "SPECTATE_OK", "SPECTATE_FAIL", "SPECTATE_END",
+    "UDP_TOKEN", "UDP_OK", "UDP_FAIL",
+    "RECORD", "REPLAY_OK", "REPLAY_FAIL", "REPLAY_END",
+    "PLAYERS", "PLAYER_JOIN", "PLAYER_LEAVE",
+    "QUERY1_RESULT", "QUERY2_RESULT", "QUERY3_RESULT",
+    "PROTO", "LOGOUT_OK", "STATS_BEGIN", "STATS_DENIED",
+    "other"
+};
+
+/* requêtes : g_stmtSql puis g_rowSql (ST_COUNT + RW_…, une exécution
+ * par paquet de lignes)                                             */
+#define MET_STMT_COUNT   (ST_COUNT + RW_COUNT)
+
+static const char *const g_stmtName[MET_STMT_COUNT] = {
+    [ST_LOGIN]        = "login",        [ST_TOUCH_LOGIN] = "touch_login",
+    [ST_REGISTER]     = "register",     [ST_DELETE]      = "delete",
+    [ST_TOP_SCORE]    = "top_score",    [ST_LAST_GAMES]  = "last_games",
+    [ST_TOP_KILLS]    = "top_kills",    [ST_PLAYER_SCORE]= "player_score",
+    [ST_COUNT + RW_GAME_INSERT] = "game_insert",
+    [ST_COUNT + RW_GAME_END]    = "game_end",
+    [ST_COUNT + RW_HIST_INSERT] = "history_insert",
+    [ST_COUNT + RW_SCORE_ADD]   = "score_add",
+};
+
+typedef struct {
+    uint64_t count, sum, max;                  /* ns                  */
+    uint64_t b[HIST_BUCKETS];
+} Hist;
+
+typedef struct MetShard {
+    struct MetShard *next;
+    Hist     cmd[CMD_COUNT];                   /* threads I/O         */
+    Hist     db[MET_STMT_COUNT];               /* dbExec(), dbExecRows() */
+    Hist     tick, jitter;                     /* physicsLoop()       */
+    uint64_t sentMsgs[OUT_COUNT], sentBytes[OUT_COUNT];  /* par type      */
+    uint64_t stateDropped, stateReplaced, slowKills;
+    uint64_t inputDropped;                     /* file d’entrées pleine */
+    uint64_t stateIdle, stateThrottled;        /* envois d’état évités  */
+    uint64_t udpIn, udpOut, udpLost, udpStale; /* datagrammes (udp.c)  */
+    uint64_t udpRefresh;                       /* états renvoyés en UDP */
+    uint64_t recBytes, recDropped;             /* journaux (record.c)   */
+    uint64_t recPruned;                        /* supprimés (rétention) */
+    uint64_t persistLost;                      /* START/END sans suite  */
+    int64_t  queued;                           /* octets mis en file − écrits */
+} MetShard;
+
+static MetShard       *g_metShards;
+static pthread_mutex_t m_met = PTHREAD_MUTEX_INITIALIZER;
+static __thread MetShard *t_met;
+static MetShard        g_metSpare;             /* si calloc échoue    */
+static struct timespec g_metStart;
+static char           *g_admins;               /* "a,b" : DOGFIGHT_ADMINS */
+
+static MetShard *metLocal(void)
+{
+    if (t_met) return t_met;
+    MetShard *m = calloc(1, sizeof(MetShard));
+    if (!m) return t_met = &g_metSpare;
+    pthread_mutex_lock(&m_met);
+    m->next = g_metShards;
+    __atomic_store_n(&g_metShards, m, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&m_met);
+    return t_met = m;
+}
+
+/* un seul écrivain par shard : lecture simple, écriture relaxée */
+#define MET_SET(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define MET_ADD(f, v)  do { MetShard *m_ = metLocal(); MET_SET(&m_->f, m_->f + (v)); } while (0)
+
+static inline uint64_t metNow(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
+}
+
+static inline int histIndex(uint64_t v)
+{
+    if (v >= 1ULL << HIST_MAX_EXP) v = (1ULL << HIST_MAX_EXP) - 1;
+    if (v < HIST_SUB) return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB + (int)((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/* plus grande valeur rangée dans la case i */
+static uint64_t histUpper(int i)
+{
+    if (i < HIST_SUB) return (uint64_t)i;
+    int e = i / HIST_SUB + HIST_SUB_BITS - 1;
+    uint64_t lo = (uint64_t)(HIST_SUB + i % HIST_SUB) << (e - HIST_SUB_BITS);
+    return lo + (1ULL << (e - HIST_SUB_BITS)) - 1;
+}
+
+static inline void histRecord(Hist *h, uint64_t ns)
+{
+    int i = histIndex(ns);
+    MET_SET(&h->b[i], h->b[i] + 1);
+    MET_SET(&h->count, h->count + 1);
+    MET_SET(&h->sum, h->sum + ns);
+    if (ns > h->max) MET_SET(&h->max, ns);
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Points de mesure                                               */
+/* ─────────────────────────────────────────────────────────────── */
+static int metCmdIndex(const char *line)
+{
+    size_t n = strcspn(line, ":");
+    for (int k = 0; k < CMD_OTHER; k++)
+        if (strlen(g_cmdName[k]) == n && memcmp(g_cmdName[k], line, n) == 0) return k;
+    return CMD_OTHER;
+}
+
+/* appelé une fois par OutBuf (outNew) : le type suit le tampon partagé */
+static int metOutIndex(const char *data, size_t len)
+{
+    if (len && (uint8_t)data[0] == SNAP_MAGIC) return OUT_SNAP;
+    const char *end = memchr(data, ':', len < 32 ? len : 32);
+    if (!end) end = memchr(data, '\n', len < 32 ? len : 32);
+    if (!end) return OUT_OTHER;
+    size_t n = (size_t)(end - data);
+    if (n == 4 && memcmp(data, "TICK", 4) == 0) return OUT_STATE;  /* TICK:…\nSTATE:… */
+    for (int k = 0; k < OUT_OTHER; k++)
+        if (k != OUT_SNAP && strlen(g_outName[k]) == n && memcmp(g_outName[k], data, n) == 0)
+            return k;
+    return OUT_OTHER;
+}
+
+void metCmd(int k, uint64_t ns)        { histRecord(&metLocal()->cmd[k], ns); }
+void metDb(int st, uint64_t ns)        { histRecord(&metLocal()->db[st], ns); }
+
+void metTick(uint64_t busyNs, int64_t lateNs)
+{
+    MetShard *m = metLocal();
+    histRecord(&m->tick, busyNs);
+    histRecord(&m->jitter, lateNs > 0 ? (uint64_t)lateNs : 0);
+}
+
+/* nom exact de la liste : une virgule dans un nom ne peut pas
+ * fabriquer une entrée à cheval sur deux autres                  */
+int metIsAdmin(const char *user)
+{
+    size_t n = strlen(user);
+    if (!g_admins || !n) return 0;
+    for (const char *p = g_admins; *p; ) {
+        size_t k = strcspn(p, ",");
+        if (k == n && memcmp(p, user, n) == 0) return 1;
+        p += k;
+        if (*p) p++;
+    }
+    return 0;
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Rendu Prometheus                                               */
+/* ─────────────────────────────────────────────────────────────── */
+typedef struct { char *p; size_t len, cap; } MetBuf;
+
+__attribute__((format(printf, 2, 3)))
+static void mb(MetBuf *b, const char *fmt, ...)
+{
+    for (int tries = 0; tries < 2; tries++) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(b->p + b->len, b->cap - b->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if ((size_t)n < b->cap - b->len) { b->len += n; return; }
+        size_t cap = b->cap * 2 > b->len + n + 1 ? b->cap * 2 : b->len + n + 1;
+        char *p = realloc(b->p, cap);
+        if (!p) return;
+        b->p = p; b->cap = cap;
+    }
+}
+
+/* somme des shards ; off = position de l’histogramme dans MetShard */
+static void histSum(Hist *out, size_t off)
+{
+    memset(out, 0, sizeof(*out));
+    for (MetShard *m = __atomic_load_n(&g_metShards, __ATOMIC_ACQUIRE); m; m = m->next) {
+        const Hist *h = (const Hist *)((const char *)m + off);
+        out->count += __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+        out->sum   += __atomic_load_n(&h->sum,   __ATOMIC_RELAXED);
+        uint64_t mx = __atomic_load_n(&h->max,   __ATOMIC_RELAXED);
+        if (mx > out->max) out->max = mx;
+        for (int i = 0; i < HIST_BUCKETS; i++)
+            out->b[i] += __atomic_load_n(&h->b[i], __ATOMIC_RELAXED);
+    }
+}
+
+static uint64_t histQuantile(const Hist *h, double q)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) total += h->b[i];
+    if (!total) return 0;
+    uint64_t rank = (uint64_t)(q * (double)total + 0.5), seen = 0;
+    if (rank < 1) rank = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        if ((seen += h->b[i]) >= rank) {
+            uint64_t u = histUpper(i);
+            return u < h->max ? u : h->max;
+        }
+    return h->max;
+}
+
+static void mbSummary(MetBuf *b, const char *name, const char *labels,
+                      const Hist *h)
+{
+    static const double qs[] = { 0.5, 0.9, 0.99, 0.999 };
+    const char *sep = *labels ? "," : "";
+    for (size_t i = 0; i < sizeof(qs) / sizeof(qs[0]); i++)
+        mb(b, "%s{%s%squantile=\"%g\"} %.9f\n", name, labels, sep, qs[i],
+           histQuantile(h, qs[i]) / 1e9);
+    mb(b, "%s{%s%squantile=\"1\"} %.9f\n", name, labels, sep, h->max / 1e9);
+    const char *lo = *labels ? "{" : "", *lc = *labels ? "}" : "";
+    mb(b, "%s_sum%s%s%s %.9f\n", name, lo, labels, lc, h->sum / 1e9);
+    mb(b, "%s_count%s%s%s %llu\n", name, lo, labels, lc, (unsigned long long)h->count);
+}
+
+#define MET_SUM(f) ({ uint64_t s_ = 0;                                          \
+    for (MetShard *m_ = __atomic_load_n(&g_metShards, __ATOMIC_ACQUIRE); m_; m_ = m_->next) \
+        s_ += (uint64_t)__atomic_load_n(&m_->f, __ATOMIC_RELAXED);             \
+    s_; })
+
+/* relevé complet ; à libérer par free(), *len sans terminateur */
+char *metRender(size_t *len)
+{
+    MetBuf b = { malloc(16384), 0, 16384 };
+    Hist *h = malloc(sizeof(Hist));
+    if (!b.p || !h) { free(b.p); free(h); return NULL; }
+    char lab[64];
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    mb(&b, "# TYPE dogfight_uptime_seconds gauge\ndogfight_uptime_seconds %ld\n",
+       (long)(now.tv_sec - g_metStart.tv_sec));
+
+    /* --- registres --- */
+    mb(&b, "# TYPE dogfight_connections gauge\ndogfight_connections %d\n",
+       __atomic_load_n(&g_connSlab.used, __ATOMIC_RELAXED));
+    mb(&b, "# TYPE dogfight_lobby_players gauge\ndogfight_lobby_players %d\n",
+       __atomic_load_n(&g_lobbyCount, __ATOMIC_RELAXED));
+    mb(&b, "# TYPE dogfight_games_active gauge\ndogfight_games_active %d\n",
+       __atomic_load_n(&g_gameSlab.used, __ATOMIC_RELAXED));
+    mb(&b, "# TYPE dogfight_spectators gauge\ndogfight_spectators %d\n",
+       __atomic_load_n(&g_spectators, __ATOMIC_RELAXED));
+    mb(&b, "# TYPE dogfight_replays gauge\ndogfight_replays %d\n",
+       __atomic_load_n(&g_replayCount, __ATOMIC_RELAXED));
+    mb(&b, "# TYPE dogfight_invites_pending gauge\ndogfight_invites_pending %d\n",
+       __atomic_load_n(&g_inviteSlab.used, __ATOMIC_RELAXED));
+
+    /* --- files sortantes --- */
+    int64_t queued = (int64_t)MET_SUM(queued);
+    mb(&b, "# TYPE dogfight_out_queue_bytes gauge\ndogfight_out_queue_bytes %lld\n",
+       (long long)(queued > 0 ? queued : 0));
+    mb(&b, "# TYPE dogfight_sent_messages_total counter\n");
+    for (int k = 0; k < OUT_COUNT; k++) {
+        uint64_t n = MET_SUM(sentMsgs[k]);
+        if (n) mb(&b, "dogfight_sent_messages_total{msg=\"%s\"} %llu\n",
+                  g_outName[k], (unsigned long long)n);
+    }
+    mb(&b, "# TYPE dogfight_sent_bytes_total counter\n");
+    for (int k = 0; k < OUT_COUNT; k++) {
+        uint64_t n = MET_SUM(sentBytes[k]);
+        if (n) mb(&b, "dogfight_sent_bytes_total{msg=\"%s\"} %llu\n",
+                  g_outName[k], (unsigned long long)n);
+    }
+    mb(&b, "# TYPE dogfight_state_dropped_total counter\ndogfight_state_dropped_total %llu\n",
+       (unsigned long long)MET_SUM(stateDropped));
+    mb(&b, "# TYPE dogfight_state_replaced_total counter\ndogfight_state_replaced_total %llu\n",
+       (unsigned long long)MET_SUM(stateReplaced));
+    mb(&b, "# TYPE dogfight_slow_disconnects_total counter\ndogfight_slow_disconnects_total %llu\n",
+       (unsigned long long)MET_SUM(slowKills));
+    mb(&b, "# TYPE dogfight_input_dropped_total counter\ndogfight_input_dropped_total %llu\n",
+       (unsigned long long)MET_SUM(inputDropped));
+    mb(&b, "# TYPE dogfight_state_skipped_total counter\n");
+    mb(&b, "dogfight_state_skipped_total{reason=\"idle\"} %llu\n",
+       (unsigned long long)MET_SUM(stateIdle));
+    mb(&b, "dogfight_state_skipped_total{reason=\"rate\"} %llu\n",
+       (unsigned long long)MET_SUM(stateThrottled));
+    mb(&b, "# TYPE dogfight_udp_datagrams_total counter\n");
+    mb(&b, "dogfight_udp_datagrams_total{dir=\"in\"} %llu\n",
+       (unsigned long long)MET_SUM(udpIn));
+    mb(&b, "dogfight_udp_datagrams_total{dir=\"out\"} %llu\n",
+       (unsigned long long)MET_SUM(udpOut));
+    mb(&b, "# TYPE dogfight_udp_lost_total counter\ndogfight_udp_lost_total %llu\n",
+       (unsigned long long)MET_SUM(udpLost));
+    mb(&b, "# TYPE dogfight_udp_stale_moves_total counter\ndogfight_udp_stale_moves_total %llu\n",
+       (unsigned long long)MET_SUM(udpStale));
+    mb(&b, "# TYPE dogfight_udp_refresh_total counter\ndogfight_udp_refresh_total %llu\n",
+       (unsigned long long)MET_SUM(udpRefresh));
+    mb(&b, "# TYPE dogfight_record_bytes_total counter\ndogfight_record_bytes_total %llu\n",
+       (unsigned long long)MET_SUM(recBytes));
+    mb(&b, "# TYPE dogfight_record_dropped_total counter\ndogfight_record_dropped_total %llu\n",
+       (unsigned long long)MET_SUM(recDropped));
+    mb(&b, "# TYPE dogfight_record_pruned_total counter\ndogfight_record_pruned_total %llu\n",
+       (unsigned long long)MET_SUM(recPruned));
+
+    /* --- commandes --- */
+    mb(&b, "# TYPE dogfight_command_seconds summary\n");
+    for (int k = 0; k < CMD_COUNT; k++) {
+        histSum(h, offsetof(MetShard, cmd) + k * sizeof(Hist));
+        if (!h->count) continue;
+        snprintf(lab, sizeof(lab), "cmd=\"%s\"", g_cmdName[k]);
+        mbSummary(&b, "dogfight_command_seconds", lab, h);
+    }
+
+    /* --- physique --- */
+    mb(&b, "# TYPE dogfight_tick_seconds summary\n");
+    histSum(h, offsetof(MetShard, tick));
+    mbSummary(&b, "dogfight_tick_seconds", "", h);
+    mb(&b, "# TYPE dogfight_tick_jitter_seconds summary\n");
+    histSum(h, offsetof(MetShard, jitter));
+    mbSummary(&b, "dogfight_tick_jitter_seconds", "", h);
+    static const struct { const char *name; size_t off; } shardCtr[] = {
+        { "ticks",    offsetof(PhysShard, ticks)    },
+        { "steps",    offsetof(PhysShard, steps)    },
+        { "catchup",  offsetof(PhysShard, catchup)  },
+        { "dropped",  offsetof(PhysShard, dropped)  },
+        { "overruns", offsetof(PhysShard, overruns) },
+        { "stolen",   offsetof(PhysShard, stolen)   },
+    };
+    for (size_t k = 0; k < sizeof(shardCtr) / sizeof(shardCtr[0]); k++) {
+        mb(&b, "# TYPE dogfight_physics_%s_total counter\n", shardCtr[k].name);
+        for (int s = 0; s < g_shardCount; s++)
+            mb(&b, "dogfight_physics_%s_total{shard=\"%d\"} %llu\n", shardCtr[k].name, s,
+               (unsigned long long)__atomic_load_n(
+                   (uint64_t *)((char *)&g_shards[s] + shardCtr[k].off), __ATOMIC_RELAXED));
+    }
+
+    /* --- base de données --- */
+    mb(&b, "# TYPE dogfight_db_seconds summary\n");
+    for (int k = 0; k < MET_STMT_COUNT; k++) {
+        histSum(h, offsetof(MetShard, db) + k * sizeof(Hist));
+        if (!h->count) continue;
+        snprintf(lab, sizeof(lab), "stmt=\"%s\"", g_stmtName[k]);
+        mbSummary(&b, "dogfight_db_seconds", lab, h);
+    }
+    DbPoolStats ps;
+    int size, idle;
+    dbPoolStats(&ps, &size, &idle);
+    mb(&b, "# TYPE dogfight_db_pool_size gauge\ndogfight_db_pool_size %d\n", size);
+    mb(&b, "# TYPE dogfight_db_pool_idle gauge\ndogfight_db_pool_idle %d\n", idle);
+    mb(&b, "# TYPE dogfight_db_pool_acquired_total counter\n"
+           "dogfight_db_pool_acquired_total %llu\n", (unsigned long long)ps.acquired);
+    mb(&b, "# TYPE dogfight_db_pool_timeouts_total counter\n"
+           "dogfight_db_pool_timeouts_total %llu\n", (unsigned long long)ps.timeouts);
+    mb(&b, "# TYPE dogfight_db_pool_reconnects_total counter\n"
+           "dogfight_db_pool_reconnects_total %llu\n", (unsigned long long)ps.reconnects);
+    mb(&b, "# TYPE dogfight_db_pool_connect_failures_total counter\n"
+           "dogfight_db_pool_connect_failures_total %llu\n",
+       (unsigned long long)ps.connectFails);
+    mb(&b, "# TYPE dogfight_db_pool_wait_seconds_total counter\n"
+           "dogfight_db_pool_wait_seconds_total %.9f\n", ps.waitNsTotal / 1e9);
+    mb(&b, "# TYPE dogfight_db_pool_wait_max_seconds gauge\n"
+           "dogfight_db_pool_wait_max_seconds %.9f\n", ps.waitNsMax / 1e9);
+    mb(&b, "# TYPE dogfight_persist_lost_total counter\ndogfight_persist_lost_total %llu\n",
+       (unsigned long long)MET_SUM(persistLost));
+
+    free(h);
+    *len = b.len;
+    return b.p;
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Socket d’administration  (un relevé par connexion)             */
+/* ─────────────────────────────────────────────────────────────── */
+static void metWriteAll(int fd, const char *p, size_t len)
+{
+    while (len) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return;
+        p += w; len -= (size_t)w;
+    }
+}
+
+static void *metAdminLoop(void *arg)
+{
+    int srv = (int)(intptr_t)arg;
+    while (1) {
+        int fd = accept4(srv, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EINTR) perror("admin accept");
+            continue;
+        }
+        /* requête facultative : « GET /metrics … » ⇒ en-tête HTTP */
+        char req[512];
+        ssize_t r = 0;
+        struct pollfd pf = { .fd = fd, .events = POLLIN };
+        if (poll(&pf, 1, 100) > 0) r = read(fd, req, sizeof(req));
+        size_t len;
+        char *body = metRender(&len);
+        if (body) {
+            if (r >= 4 && memcmp(req, "GET ", 4) == 0) {
+                char hdr[160];
+                int n = snprintf(hdr, sizeof(hdr), "HTTP/1.0 200 OK\r\n"
+                                 "Content-Type: text/plain; version=0.0.4\r\n"
+                                 "Content-Length: %zu\r\n\r\n", len);
+                metWriteAll(fd, hdr, (size_t)n);
+            }
+            metWriteAll(fd, body, len);
+            free(body);
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+/* path NULL : défaut ; chaîne vide : pas de socket */
+void metInit(const char *path, const char *admins)
+{
+    clock_gettime(CLOCK_MONOTONIC, &g_metStart);
+    if (admins && *admins) g_admins = strdup(admins);
+
+    if (!path) path = MET_ADMIN_SOCKET;
+    if (!*path) return;
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        fprintf(stderr, "admin: chemin trop long : %s\n", path);
+        return;
+    }
+    strcpy(sa.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(path);                                  /* reste d’un ancien run */
+    /* propriétaire seul dès la création : un chmod() après bind()
+     * laisserait une fenêtre (appelé avant tout autre thread)      */
+    mode_t um = umask(077);
+    int err = fd < 0 || bind(fd, (struct sockaddr *)&sa, sizeof(sa)) || listen(fd, 8);
+    umask(um);
+    if (err) {
+        perror("admin socket");
+        if (fd >= 0) close(fd);
+        return;
+    }
+    pthread_t tid;
+    pthread_create(&tid, NULL, metAdminLoop, (void *)(intptr_t)fd);
+    pthread_detach(tid);
+    printf("Admin metrics on %s\n", path);
+}
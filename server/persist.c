@@ -0,0 +1,414 @@
+/* ==================================================================
+ *        PERSISTANCE ASYNCHRONE  – début / fin de partie
+ *
+ *  Les threads physiques ne parlent plus à MySQL : ils déposent un
+ *  événement dans une file et repartent. Un thread écrivain, avec
+ *  une connexion empruntée au pool, vide la file par lots : une seule
+ *  transaction, INSERT multi-lignes pour les parties et l’historique,
+ *  UPDATE groupés pour les parties et les scores.
+ *
+ *  MySQL indisponible : nouvelles tentatives avec back-off, puis le
+ *  lot part dans un fichier de débordement (spill) rejoué dès que la
+ *  base revient — y compris au redémarrage suivant. Le fichier n’est
+ *  effacé qu’après le COMMIT qui contient ses événements.
+ * ================================================================== */
+#include <mysql/mysql.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef USERNAME_LEN
+#define USERNAME_LEN 50
+#endif
+#ifndef WIN_SCORE
+#define WIN_SCORE 100
+#endif
+
+#define PERSIST_BATCH        256      /* événements max par transaction  */
+#define PERSIST_RETRIES      5        /* essais avant débordement disque */
+#define PERSIST_BACKOFF_MS   100      /* 100, 200, 400 … ms              */
+#define PERSIST_KEYS         1024     /* table clé → id_game, initiale (2^n) */
+#define PERSIST_SPILL        "persist_spill.log"
+
+enum { EV_GAME_START, EV_GAME_END };
+
+typedef struct PersistEv {
+    int      kind;
+    uint64_t key;                         /* identifiant local du match */
+    char     a[USERNAME_LEN];             /* START : joueur 1 / END : gagnant  */
+    char     b[USERNAME_LEN];             /* START : joueur 2 / END : perdant  */
+    int      gameId;                      /* END relu du spill : id connu */
+    struct PersistEv *next;
+} PersistEv;                              /* a[0]=='\0' en END ⇒ match nul */
+
+/* clé locale → id_game, connu seulement une fois le START écrit */
+typedef struct { uint64_t key; int id; } KeyMap;
+
+static PersistEv      *g_pHead, *g_pTail;
+static pthread_mutex_t m_persist = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  c_persist = PTHREAD_COND_INITIALIZER;
+static uint64_t        g_pNextKey;
+static const char     *g_spillPath = PERSIST_SPILL;
+
+/* thread écrivain uniquement ; doublée au-delà d’une demi-charge */
+static KeyMap  *g_keys;
+static uint32_t g_keyCap, g_keyCount;
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Côté producteurs (threads physiques / I/O) : jamais bloquant   */
+/* ─────────────────────────────────────────────────────────────── */
+static void persistPush(PersistEv *e)
+{
+    pthread_mutex_lock(&m_persist);
+    if (g_pTail) g_pTail->next = e; else g_pHead = e;
+    g_pTail = e;
+    pthread_cond_signal(&c_persist);
+    pthread_mutex_unlock(&m_persist);
+}
+
+uint64_t persistGameStart(const char *p1, const char *p2)
+{
+    PersistEv *e = calloc(1, sizeof(*e));
+    uint64_t key = __atomic_add_fetch(&g_pNextKey, 1, __ATOMIC_RELAXED);
+    if (!e) return key;
+    e->kind = EV_GAME_START;
+    e->key  = key;
+    strncpy(e->a, p1, USERNAME_LEN-1);
+    strncpy(e->b, p2, USERNAME_LEN-1);
+    persistPush(e);
+    return key;
+}
+
+/* winner == NULL : match nul (partie terminée, pas d’historique) */
+void persistGameEnd(uint64_t key, const char *winner, const char *loser)
+{
+    PersistEv *e = calloc(1, sizeof(*e));
+    if (!e) return;
+    e->kind = EV_GAME_END;
+    e->key  = key;
+    if (winner) strncpy(e->a, winner, USERNAME_LEN-1);
+    if (loser)  strncpy(e->b, loser,  USERNAME_LEN-1);
+    persistPush(e);
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Table clé → id_game                                            */
+/* ─────────────────────────────────────────────────────────────── */
+static KeyMap *keySlot(uint64_t key, int insert)
+{
+    for (uint32_t i = 0; i < g_keyCap; i++) {
+        KeyMap *k = &g_keys[(key + i) & (g_keyCap-1)];
+        if (k->key == key) return k;
+        if (!k->key) return insert ? k : NULL;
+    }
+    return NULL;
+}
+
+static int keyGrow(void)
+{
+    uint32_t cap = g_keyCap ? g_keyCap * 2 : PERSIST_KEYS;
+    KeyMap *old = g_keys, *nk = calloc(cap, sizeof(KeyMap));
+    if (!nk) return -1;
+    uint32_t oldCap = g_keyCap;
+    g_keys = nk; g_keyCap = cap;
+    for (uint32_t i = 0; i < oldCap; i++)
+        if (old[i].key) *keySlot(old[i].key, 1) = old[i];
+    free(old);
+    return 0;
+}
+
+/* id_game d’un START écrit ; une partie non enregistrée ici perdrait
+ * son END (laissée in_progress en base) : jamais en silence          */
+static void keyPut(uint64_t key, int id)
+{
+    KeyMap *k = keySlot(key, 0);
+    if (!k) {
+        if ((g_keyCount + 1) * 2 > g_keyCap) keyGrow();
+        if (g_keyCount + 1 >= g_keyCap) k = NULL;      /* garder une case vide */
+        else k = keySlot(key, 1);
+        if (!k) {
+            MET_ADD(persistLost, 1);
+            fprintf(stderr, "persist: table pleine (%u), partie %d sans suivi\n",
+                    g_keyCount, id);
+            return;
+        }
+        k->key = key;
+        g_keyCount++;
+    }
+    k->id = id;
+}
+
+static void keyDrop(uint64_t key)
+{
+    KeyMap *k = keySlot(key, 0);
+    if (!k) return;
+    /* suppression avec recompactage de la sonde linéaire */
+    uint32_t i = (uint32_t)(k - g_keys);
+    k->key = 0;
+    g_keyCount--;
+    for (uint32_t j = (i + 1) & (g_keyCap-1); g_keys[j].key;
+         j = (j + 1) & (g_keyCap-1)) {
+        KeyMap m = g_keys[j];
+        g_keys[j].key = 0;
+        *keySlot(m.key, 1) = m;
+    }
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Fichier de débordement                                         */
+/* ─────────────────────────────────────────────────────────────── */
+static void spillWrite(PersistEv *list)
+{
+    FILE *f = fopen(g_spillPath, "a");
+    if (!f) { perror("persist spill"); return; }
+    for (PersistEv *e = list; e; e = e->next) {
+        /* un END dont le START est déjà en base emporte l’id_game,
+         * pour pouvoir être rejoué après un redémarrage            */
+        KeyMap *k = e->kind == EV_GAME_END ? keySlot(e->key, 0) : NULL;
+        fprintf(f, "%c\t%llu\t%d\t%s\t%s\n", e->kind == EV_GAME_START ? 'S' : 'E',
+                (unsigned long long)e->key, k ? k->id : 0, e->a, e->b);
+    }
+    fclose(f);
+}
+
+/* relit le spill (dans l’ordre) sans l’effacer ; NULL si rien */
+static PersistEv *spillLoad(void)
+{
+    FILE *f = fopen(g_spillPath, "r");
+    if (!f) return NULL;
+    PersistEv *head = NULL, **tail = &head;
+    char line[3*USERNAME_LEN + 32];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+        char *sp, *k = strtok_r(line, "\t", &sp), *key = strtok_r(NULL, "\t", &sp);
+        char *id = strtok_r(NULL, "\t", &sp);
+        if (!k || !key || !id) continue;
+        PersistEv *e = calloc(1, sizeof(*e));
+        if (!e) break;
+        e->kind = *k == 'S' ? EV_GAME_START : EV_GAME_END;
+        e->key  = strtoull(key, NULL, 10);
+        e->gameId = atoi(id);
+        /* champs vides possibles (match nul) : découpe à la main */
+        char *a = sp, *b = a ? strchr(a, '\t') : NULL;
+        if (b) *b++ = '\0';
+        if (a) strncpy(e->a, a, USERNAME_LEN-1);
+        if (b) strncpy(e->b, b, USERNAME_LEN-1);
+        *tail = e; tail = &e->next;
+    }
+    fclose(f);
+    if (head) fprintf(stderr, "persist: reprise du fichier %s\n", g_spillPath);
+    return head;
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Écriture d’un lot en une transaction                           */
+/*      requêtes multi-lignes préparées de db_pool.c (dbExecRows)  */
+/* ─────────────────────────────────────────────────────────────── */
+/* liaisons d’une requête multi-lignes : une case par paramètre */
+typedef struct {
+    MYSQL_BIND    *p;
+    unsigned long *len;
+    int           *val;
+    int            n, rows;
+} RowBinds;
+
+static void rbStr(RowBinds *r, const char *s)
+{
+    bindStr(&r->p[r->n], s, &r->len[r->n]);
+    r->n++;
+}
+
+static void rbInt(RowBinds *r, int v)
+{
+    r->val[r->n] = v;
+    bindInt(&r->p[r->n], &r->val[r->n]);
+    r->n++;
+}
+
+static int persistBatch(DbConn *db, PersistEv *list)
+{
+    MYSQL *c = db->mysql;
+    int n = 0, ret = -1;
+    for (PersistEv *e = list; e; e = e->next) n++;
+
+    /* au plus deux lignes d’historique (5 champs) par événement */
+    RowBinds r = { calloc((size_t)n * 10, sizeof(MYSQL_BIND)),
+                   calloc((size_t)n * 10, sizeof(unsigned long)),
+                   calloc((size_t)n * 10, sizeof(int)), 0, 0 };
+    int *ids = calloc((size_t)n, sizeof(int));
+    if (!r.p || !r.len || !r.val || !ids) goto out;
+
+    for (PersistEv *e = list; e; e = e->next)
+        if (e->gameId && !keySlot(e->key, 0)) keyPut(e->key, e->gameId);
+
+    if (mysql_query(c, "START TRANSACTION")) goto out;
+
+    /* 1. nouvelles parties : l’id de chaque ligne revient de l’INSERT */
+    for (PersistEv *e = list; e; e = e->next) {
+        if (e->kind != EV_GAME_START || keySlot(e->key, 0)) continue;
+        rbStr(&r, e->a);
+        rbStr(&r, e->b);
+        r.rows++;
+    }
+    if (r.rows) {
+        if (dbExecRows(db, RW_GAME_INSERT, r.p, r.rows, ids, "persist-start") < 0)
+            goto fail;
+        int i = 0;
+        for (PersistEv *e = list; e; e = e->next)
+            if (e->kind == EV_GAME_START && !keySlot(e->key, 0)) keyPut(e->key, ids[i++]);
+    }
+
+    /* 2. parties terminées : statut, puis historique des deux joueurs */
+    r.n = r.rows = 0;
+    for (PersistEv *e = list; e; e = e->next) {
+        KeyMap *k;
+        if (e->kind != EV_GAME_END) continue;
+        if (!(k = keySlot(e->key, 0)) || !k->id) {
+            MET_ADD(persistLost, 1);
+            fprintf(stderr, "persist: fin de partie sans id_game (clé %llu)\n",
+                    (unsigned long long)e->key);
+            continue;
+        }
+        rbInt(&r, k->id);
+        rbStr(&r, e->a[0] ? e->a : NULL);
+        r.rows++;
+    }
+    if (r.rows && dbExecRows(db, RW_GAME_END, r.p, r.rows, NULL, "persist-end") < 0)
+        goto fail;
+
+    r.n = r.rows = 0;
+    for (PersistEv *e = list; e; e = e->next) {
+        KeyMap *k;
+        if (e->kind != EV_GAME_END || !e->a[0]) continue;
+        if (!(k = keySlot(e->key, 0)) || !k->id) continue;
+        rbStr(&r, e->a); rbInt(&r, k->id); rbInt(&r, 1); rbInt(&r, 0); rbInt(&r, WIN_SCORE);
+        rbStr(&r, e->b); rbInt(&r, k->id); rbInt(&r, 0); rbInt(&r, 1); rbInt(&r, 0);
+        r.rows += 2;
+    }
+    if (r.rows && dbExecRows(db, RW_HIST_INSERT, r.p, r.rows, NULL, "persist-history") < 0)
+        goto fail;
+
+    /* 3. scores : une ligne par vainqueur, victoires cumulées */
+    r.n = r.rows = 0;
+    for (PersistEv *e = list; e; e = e->next) {
+        if (e->kind != EV_GAME_END || !e->a[0] || !keySlot(e->key, 0)) continue;
+        int wins = 0;
+        for (PersistEv *o = list; o; o = o->next)
+            if (o->kind == EV_GAME_END && strcmp(o->a, e->a) == 0 && keySlot(o->key, 0)) {
+                if (!wins && o != e) break;      /* déjà compté plus haut */
+                wins++;
+            }
+        if (!wins) continue;
+        rbInt(&r, wins * WIN_SCORE);
+        rbStr(&r, e->a);
+        r.rows++;
+    }
+    if (r.rows && dbExecRows(db, RW_SCORE_ADD, r.p, r.rows, NULL, "persist-score") < 0)
+        goto fail;
+
+    if (mysql_query(c, "COMMIT")) goto fail;
+
+    /* classements en mémoire : id et score du vainqueur relus en base */
+    for (PersistEv *e = list; e; e = e->next) {
+        KeyMap *k = keySlot(e->key, 0);
+        if (!k || !k->id) continue;
+        if (e->kind == EV_GAME_START) { lbGameStarted(k->id, e->a, e->b); continue; }
+        int wid = 0, score = 0;
+        if (e->a[0] && loadPlayerScore(db, e->a, &wid, &score) < 0) {
+            lbInvalidate();
+            continue;
+        }
+        lbGameEnded(k->id, e->a[0] ? e->a : NULL, wid, score, e->b);
+    }
+
+    for (PersistEv *e = list; e; e = e->next)
+        if (e->kind == EV_GAME_END) keyDrop(e->key);
+    ret = 0;
+    goto out;
+
+fail:
+    fprintf(stderr, "persist: %s\n", mysql_error(c));
+    mysql_query(c, "ROLLBACK");
+    /* les START de ce lot seront réinsérés : oublier leurs ids */
+    for (PersistEv *e = list; e; e = e->next)
+        if (e->kind == EV_GAME_START) keyDrop(e->key);
+out:
+    free(r.p); free(r.len); free(r.val); free(ids);
+    return ret;
+}
+
+static void freeList(PersistEv *e)
+{
+    while (e) { PersistEv *n = e->next; free(e); e = n; }
+}
+
+/* détache au plus PERSIST_BATCH événements de la file */
+static PersistEv *takeBatch(void)
+{
+    pthread_mutex_lock(&m_persist);
+    while (!g_pHead) pthread_cond_wait(&c_persist, &m_persist);
+    PersistEv *head = g_pHead, *e = head;
+    for (int n = 1; n < PERSIST_BATCH && e->next; n++) e = e->next;
+    g_pHead = e->next;
+    if (!g_pHead) g_pTail = NULL;
+    e->next = NULL;
+    pthread_mutex_unlock(&m_persist);
+    return head;
+}
+
+static void *persistLoop(void *arg)
+{
+    (void)arg;
+    /* un reliquat du démarrage précédent est rejoué sans attendre */
+    int spilled = 1;
+    while (1) {
+        PersistEv *batch = spilled ? NULL : takeBatch();
+        spilled = 0;
+
+        int ok = 0;
+        for (int attempt = 0; attempt < PERSIST_RETRIES && !ok; attempt++) {
+            if (attempt) {
+                struct timespec ts = { 0, (long)PERSIST_BACKOFF_MS * 1000000L << (attempt-1) };
+                while (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+                nanosleep(&ts, NULL);
+            }
+            DbConn *db = dbAcquire();
+            if (!db) continue;
+
+            /* un spill en attente passe avant : l’ordre START → END compte.
+             * Effacé seulement une fois son lot validé ; un arrêt entre
+             * COMMIT et remove() le rejoue (doublon plutôt que perte).  */
+            PersistEv *old = spillLoad();
+            if (old) {
+                int r = persistBatch(db, old);
+                freeList(old);
+                if (r < 0) { dbRelease(db); continue; }
+                remove(g_spillPath);
+            }
+            ok = !batch || persistBatch(db, batch) == 0;
+            dbRelease(db);
+        }
+        if (!ok && batch) {
+            fprintf(stderr, "persist: MySQL indisponible, lot écrit dans %s\n",
+                    g_spillPath);
+            spillWrite(batch);
+        }
+        freeList(batch);
+    }
+    return NULL;
+}
+
+void persistStart(const char *spillPath)
+{
+    if (spillPath && *spillPath) g_spillPath = spillPath;
+    /* clés uniques d’un démarrage à l’autre (le spill peut survivre) */
+    g_pNextKey = (uint64_t)time(NULL) << 24;
+    if (keyGrow() < 0) { perror("persist"); exit(1); }
+
+    pthread_t tid;
+    pthread_create(&tid, NULL, persistLoop, NULL);
+    pthread_detach(tid);
+}
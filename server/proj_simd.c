@@ -0,0 +1,246 @@
+/* ==================================================================
+ *        PROJECTILES  – noyaux vectoriels (déplacement / collisions)
+ *
+ *  Les projectiles d’une partie sont rangés en colonnes (ProjSoA) :
+ *  un pas déplace tout le tableau de k·(dx, dy) (k = pas de la partie
+ *  en 1/60 s) puis teste le SEGMENT parcouru contre les deux avions
+ *  d’un duel, 8 (AVX) ou 4 (SSE) à la fois : pas d’effet tunnel, même
+ *  à 20 Hz où un tir avance de 60 px par pas. Le noyau
+ *  ne fait que produire des masques de bits ; simStep() (sim.c)
+ *  applique ensuite les touches dans l’ordre et compacte. En arène,
+ *  projMove() déplace seulement : les touches passent par la grille
+ *  de sim.c.
+ *   – AVX choisi à l’exécution (__builtin_cpu_supports), SSE2 sinon
+ *     sur x86-64, boucle scalaire ailleurs
+ *   – les colonnes font MAX_PROJECTILES (multiple de 8) : les lignes
+ *     au-delà de count sont calculées mais jamais lues
+ *   – test segment/boîte sans division (axes séparateurs), mêmes
+ *     opérations dans le même ordre partout : résultats identiques au
+ *     bit près entre noyaux, tant que le compilateur ne fusionne pas
+ *     mul+add (pas de -ffast-math ; -ffp-contract=off avec -march)
+ * ================================================================== */
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PROJ_X86 1
+#endif
+
+/* boîte de touche d’un avion, côté coin haut-gauche du projectile :
+ * recouvrement ⇔ lox < x < hix  et  loy < y < hiy                     */
+typedef struct { float lox, hix, loy, hiy; } PlaneBox;
+
+static void planeBoxes(const float *px, const float *py, PlaneBox *b, int n)
+{
+    for (int p = 0; p < n; p++) {
+        float ax1 = px[p] - PLANE_SIZE/2.0f, ay1 = py[p] - PLANE_SIZE/2.0f;
+        b[p].lox = ax1 - PROJECTILE_SIZE;  b[p].hix = ax1 + PLANE_SIZE;
+        b[p].loy = ay1 - PROJECTILE_SIZE;  b[p].hiy = ay1 + PLANE_SIZE;
+    }
+}
+
+#define BIT(m, i)  ((m)[(i) >> 6] |= 1ULL << ((i) & 63))
+
+/* = minps / maxps (2e opérande si égalité) */
+#define MINF(a, b)  ((a) < (b) ? (a) : (b))
+#define MAXF(a, b)  ((a) > (b) ? (a) : (b))
+
+/* segment (x0,y0) → (x1,y1) = (x0+ddx, y0+ddy) contre la boîte ouverte
+ * b : séparés sur x, sur y, ou sur la normale du segment (4 coins du
+ * même côté de la droite). Un projectile immobile : simple inclusion. */
+static inline int sweepBox(float x0, float y0, float x1, float y1,
+                           float ddx, float ddy, const PlaneBox *b)
+{
+    if (!(MAXF(x0, x1) > b->lox && MINF(x0, x1) < b->hix &&
+          MAXF(y0, y1) > b->loy && MINF(y0, y1) < b->hiy)) return 0;
+    if (ddx == 0 && ddy == 0) return 1;
+    float a0 = ddx * (b->loy - y0), a1 = ddx * (b->hiy - y0);
+    float b0 = ddy * (b->lox - x0), b1 = ddy * (b->hix - x0);
+    return MINF(a0, a1) - MAXF(b0, b1) < 0 && MAXF(a0, a1) - MINF(b0, b1) > 0;
+}
+
+/* hors plateau : au-delà d’une taille de projectile, des 4 côtés */
+#define OUT_X(x)  ((x) < -PROJECTILE_SIZE || (x) > BOARD_WIDTH  + PROJECTILE_SIZE)
+#define OUT_Y(y)  ((y) < -PROJECTILE_SIZE || (y) > BOARD_HEIGHT + PROJECTILE_SIZE)
+
+/* nb = 2 (duel) ou 0 (arène : déplacement seul, hit0/hit1 intacts) ;
+ * k = pas en 1/60 s (dx, dy sont des vitesses par 1/60 s)          */
+static void projStepScalar(ProjSoA *s, const PlaneBox *b, int nb, float k,
+                           uint64_t *hit0, uint64_t *hit1, uint64_t *out)
+{
+    for (int i = 0; i < s->count; i++) {
+        float x0 = s->x[i], y0 = s->y[i];
+        float ddx = s->dx[i] * k, ddy = s->dy[i] * k;
+        float x = s->x[i] = x0 + ddx;
+        float y = s->y[i] = y0 + ddy;
+        if (nb) {
+            if (sweepBox(x0, y0, x, y, ddx, ddy, &b[0])) BIT(hit0, i);
+            if (sweepBox(x0, y0, x, y, ddx, ddy, &b[1])) BIT(hit1, i);
+        }
+        if (OUT_X(x) || OUT_Y(y)) BIT(out, i);
+    }
+}
+
+#ifdef PROJ_X86
+static void projStepSSE(ProjSoA *s, const PlaneBox *b, int nb, float k,
+                        uint64_t *hit0, uint64_t *hit1, uint64_t *out)
+{
+    const __m128 vk   = _mm_set1_ps(k), zero = _mm_setzero_ps();
+    const __m128 xmin = _mm_set1_ps(-PROJECTILE_SIZE);
+    const __m128 xmax = _mm_set1_ps(BOARD_WIDTH + PROJECTILE_SIZE);
+    const __m128 ymax = _mm_set1_ps(BOARD_HEIGHT + PROJECTILE_SIZE);
+    __m128 lox[2], hix[2], loy[2], hiy[2];
+    for (int p = 0; p < nb; p++) {
+        lox[p] = _mm_set1_ps(b[p].lox); hix[p] = _mm_set1_ps(b[p].hix);
+        loy[p] = _mm_set1_ps(b[p].loy); hiy[p] = _mm_set1_ps(b[p].hiy);
+    }
+    for (int i = 0; i < s->count; i += 4) {
+        __m128 x0  = _mm_load_ps(&s->x[i]), y0 = _mm_load_ps(&s->y[i]);
+        __m128 ddx = _mm_mul_ps(_mm_load_ps(&s->dx[i]), vk);
+        __m128 ddy = _mm_mul_ps(_mm_load_ps(&s->dy[i]), vk);
+        __m128 x = _mm_add_ps(x0, ddx);
+        __m128 y = _mm_add_ps(y0, ddy);
+        _mm_store_ps(&s->x[i], x);
+        _mm_store_ps(&s->y[i], y);
+        uint64_t m[2] = { 0, 0 };
+        if (nb) {                                  /* sweepBox() à 4 voies */
+            __m128 lx = _mm_min_ps(x0, x), hx = _mm_max_ps(x0, x);
+            __m128 ly = _mm_min_ps(y0, y), hy = _mm_max_ps(y0, y);
+            __m128 still = _mm_and_ps(_mm_cmpeq_ps(ddx, zero), _mm_cmpeq_ps(ddy, zero));
+            for (int p = 0; p < nb; p++) {
+                __m128 ov = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(hx, lox[p]), _mm_cmplt_ps(lx, hix[p])),
+                                       _mm_and_ps(_mm_cmpgt_ps(hy, loy[p]), _mm_cmplt_ps(ly, hiy[p])));
+                __m128 a0 = _mm_mul_ps(ddx, _mm_sub_ps(loy[p], y0));
+                __m128 a1 = _mm_mul_ps(ddx, _mm_sub_ps(hiy[p], y0));
+                __m128 b0 = _mm_mul_ps(ddy, _mm_sub_ps(lox[p], x0));
+                __m128 b1 = _mm_mul_ps(ddy, _mm_sub_ps(hix[p], x0));
+                __m128 cut = _mm_and_ps(
+                    _mm_cmplt_ps(_mm_sub_ps(_mm_min_ps(a0, a1), _mm_max_ps(b0, b1)), zero),
+                    _mm_cmpgt_ps(_mm_sub_ps(_mm_max_ps(a0, a1), _mm_min_ps(b0, b1)), zero));
+                m[p] = (uint64_t)_mm_movemask_ps(_mm_and_ps(ov, _mm_or_ps(cut, still)));
+            }
+        }
+        uint64_t o = (uint64_t)_mm_movemask_ps(
+            _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(x, xmin), _mm_cmpgt_ps(x, xmax)),
+                      _mm_or_ps(_mm_cmplt_ps(y, xmin), _mm_cmpgt_ps(y, ymax))));
+        if (nb) {
+            hit0[i >> 6] |= m[0] << (i & 63);
+            hit1[i >> 6] |= m[1] << (i & 63);
+        }
+        out [i >> 6] |= o    << (i & 63);
+    }
+}
+
+__attribute__((target("avx")))
+static void projStepAVX(ProjSoA *s, const PlaneBox *b, int nb, float k,
+                        uint64_t *hit0, uint64_t *hit1, uint64_t *out)
+{
+    const __m256 vk   = _mm256_set1_ps(k), zero = _mm256_setzero_ps();
+    const __m256 xmin = _mm256_set1_ps(-PROJECTILE_SIZE);
+    const __m256 xmax = _mm256_set1_ps(BOARD_WIDTH + PROJECTILE_SIZE);
+    const __m256 ymax = _mm256_set1_ps(BOARD_HEIGHT + PROJECTILE_SIZE);
+    __m256 lox[2], hix[2], loy[2], hiy[2];
+    for (int p = 0; p < nb; p++) {
+        lox[p] = _mm256_set1_ps(b[p].lox); hix[p] = _mm256_set1_ps(b[p].hix);
+        loy[p] = _mm256_set1_ps(b[p].loy); hiy[p] = _mm256_set1_ps(b[p].hiy);
+    }
+    for (int i = 0; i < s->count; i += 8) {
+        __m256 x0  = _mm256_load_ps(&s->x[i]), y0 = _mm256_load_ps(&s->y[i]);
+        __m256 ddx = _mm256_mul_ps(_mm256_load_ps(&s->dx[i]), vk);
+        __m256 ddy = _mm256_mul_ps(_mm256_load_ps(&s->dy[i]), vk);
+        __m256 x = _mm256_add_ps(x0, ddx);
+        __m256 y = _mm256_add_ps(y0, ddy);
+        _mm256_store_ps(&s->x[i], x);
+        _mm256_store_ps(&s->y[i], y);
+        uint64_t m[2] = { 0, 0 };
+        if (nb) {                                  /* sweepBox() à 8 voies */
+            __m256 lx = _mm256_min_ps(x0, x), hx = _mm256_max_ps(x0, x);
+            __m256 ly = _mm256_min_ps(y0, y), hy = _mm256_max_ps(y0, y);
+            __m256 still = _mm256_and_ps(_mm256_cmp_ps(ddx, zero, _CMP_EQ_OQ),
+                                         _mm256_cmp_ps(ddy, zero, _CMP_EQ_OQ));
+            for (int p = 0; p < nb; p++) {
+                __m256 ov = _mm256_and_ps(
+                    _mm256_and_ps(_mm256_cmp_ps(hx, lox[p], _CMP_GT_OQ), _mm256_cmp_ps(lx, hix[p], _CMP_LT_OQ)),
+                    _mm256_and_ps(_mm256_cmp_ps(hy, loy[p], _CMP_GT_OQ), _mm256_cmp_ps(ly, hiy[p], _CMP_LT_OQ)));
+                __m256 a0 = _mm256_mul_ps(ddx, _mm256_sub_ps(loy[p], y0));
+                __m256 a1 = _mm256_mul_ps(ddx, _mm256_sub_ps(hiy[p], y0));
+                __m256 b0 = _mm256_mul_ps(ddy, _mm256_sub_ps(lox[p], x0));
+                __m256 b1 = _mm256_mul_ps(ddy, _mm256_sub_ps(hix[p], x0));
+                __m256 cut = _mm256_and_ps(
+                    _mm256_cmp_ps(_mm256_sub_ps(_mm256_min_ps(a0, a1), _mm256_max_ps(b0, b1)), zero, _CMP_LT_OQ),
+                    _mm256_cmp_ps(_mm256_sub_ps(_mm256_max_ps(a0, a1), _mm256_min_ps(b0, b1)), zero, _CMP_GT_OQ));
+                m[p] = (uint64_t)_mm256_movemask_ps(_mm256_and_ps(ov, _mm256_or_ps(cut, still)));
+            }
+        }
+        uint64_t o = (uint64_t)_mm256_movemask_ps(_mm256_or_ps(
+            _mm256_or_ps(_mm256_cmp_ps(x, xmin, _CMP_LT_OQ), _mm256_cmp_ps(x, xmax, _CMP_GT_OQ)),
+            _mm256_or_ps(_mm256_cmp_ps(y, xmin, _CMP_LT_OQ), _mm256_cmp_ps(y, ymax, _CMP_GT_OQ))));
+        if (nb) {
+            hit0[i >> 6] |= m[0] << (i & 63);
+            hit1[i >> 6] |= m[1] << (i & 63);
+        }
+        out [i >> 6] |= o    << (i & 63);
+    }
+}
+#endif
+
+typedef void (*ProjStepFn)(ProjSoA*, const PlaneBox*, int, float, uint64_t*, uint64_t*, uint64_t*);
+static ProjStepFn g_projStep = projStepScalar;
+
+void projKernelInit(void)
+{
+#ifdef PROJ_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx"))       g_projStep = projStepAVX;
+    else if (__builtin_cpu_supports("sse2")) g_projStep = projStepSSE;
+#endif
+    if (getenv("DOGFIGHT_NO_SIMD")) g_projStep = projStepScalar;
+}
+
+/* déplace tous les projectiles de k pas de 1/60 s ; masques indexés
+ * comme les colonnes : hit[p] = le trajet coupe l’avion p (propriétaire
+ * compris), out = hors plateau à l’arrivée                            */
+void projStep(ProjSoA *s, const float px[2], const float py[2], int k,
+              uint64_t hit[2][PROJ_WORDS], uint64_t out[PROJ_WORDS])
+{
+    PlaneBox b[2];
+    planeBoxes(px, py, b, 2);
+    memset(hit, 0, 2 * PROJ_WORDS * sizeof(uint64_t));
+    memset(out, 0, PROJ_WORDS * sizeof(uint64_t));
+    g_projStep(s, b, 2, (float)k, hit[0], hit[1], out);
+
+    /* lignes de bourrage (≥ count) : hors jeu */
+    for (int w = s->count >> 6; w < PROJ_WORDS; w++) {
+        uint64_t keep = (w << 6) + 64 <= s->count ? ~0ULL
+                      : (w << 6) >= s->count      ? 0
+                      : (1ULL << (s->count & 63)) - 1;
+        hit[0][w] &= keep; hit[1][w] &= keep; out[w] &= keep;
+    }
+}
+
+/* arène : déplacement et sorties seulement (touches : grille de sim.c) */
+void projMove(ProjSoA *s, int k, uint64_t out[PROJ_WORDS])
+{
+    memset(out, 0, PROJ_WORDS * sizeof(uint64_t));
+    g_projStep(s, NULL, 0, (float)k, NULL, NULL, out);
+    for (int w = s->count >> 6; w < PROJ_WORDS; w++)
+        out[w] &= (w << 6) + 64 <= s->count ? ~0ULL
+                : (w << 6) >= s->count      ? 0
+                : (1ULL << (s->count & 63)) - 1;
+}
+
+/* supprime les lignes marquées dans dead, en gardant l’ordre (ids triés) */
+void projCompact(ProjSoA *s, const uint64_t dead[PROJ_WORDS])
+{
+    int w = 0;
+    for (int r = 0; r < s->count; r++) {
+        if (dead[r >> 6] >> (r & 63) & 1) continue;
+        if (w != r) {
+            s->x[w]  = s->x[r];  s->y[w]  = s->y[r];
+            s->dx[w] = s->dx[r]; s->dy[w] = s->dy[r];
+            s->id[w] = s->id[r]; s->owner[w] = s->owner[r];
+        }
+        w++;
+    }
+    s->count = w;
+}
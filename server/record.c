@@ -0,0 +1,592 @@
+/* ==================================================================
+ *        ENREGISTREMENT DES MATCHS  – journal binaire, REPLAY:<id>
+ *
+ *  Chaque partie écrit, sous gm->lock, ses entrées appliquées, ses
+ *  événements et ses photos d’état dans des blocs en mémoire ; un
+ *  thread écrivain les ajoute à <dir>/<id>.dfr.part (O_APPEND) et
+ *  renomme le fichier en <id>.dfr à la fin du match. Le thread
+ *  physique ne fait ni write() ni open() : il remplit un bloc et,
+ *  quand il est plein, le dépose dans une file.
+ *
+ *  Fichier (little-endian) :
+ *    "DFR1" | u8 nPlayers | u8 stride | u16 0 | u32 tick0 | u64 ms unix
+ *    nPlayers × (u8 longueur, nom)
+ *    puis des enregistrements  u8 type | u16 len | u32 tick | len octets
+ *      'M'  u32 pas, u8 slot, f32 x, f32 y               MOVE appliqué
+ *      'F'  u32 pas, u8 slot, f32 x, f32 y, f32 dx, f32 dy     FIRE
+ *      'E'  u8 SEV_*, i8 slot, u8 hp, u32 id [, f32 x y dx dy]
+ *      'S'  trame BIN2 complète (base 0), à la cadence des spectateurs
+ *  Les entrées suffisent à rejouer le match dans sim.c (pas = nombre
+ *  de simStep() déjà faits) ; les photos servent au REPLAY.
+ *
+ *  REPLAY:<id>[:<vitesse 1..16>] : le fichier est projeté en mémoire
+ *  et un thread le diffuse au rythme des ticks enregistrés, sans
+ *  resimuler : événements tels quels, une photo par tick au plus
+ *  (la plus récente due), recopiée depuis la projection (BIN2),
+ *  raccourcie (BIN1) ou mise en texte (TICK/STATE).
+ *  DOGFIGHT_RECORD_DIR (défaut « recordings », vide : désactivé) ;
+ *  DOGFIGHT_RECORD_MAX_MB borne le dossier (défaut REC_KEEP_MB, 0 :
+ *  sans limite) : l’écrivain supprime les .dfr les plus anciens dès
+ *  qu’un match terminé fait dépasser la limite (le dernier reste).
+ * ================================================================== */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RECORD_DIR        "recordings"
+#define REC_CHUNK         (16*1024)      /* bloc passé à l’écrivain       */
+#define REC_MAX_QUEUED    (32*1024*1024) /* au-delà : enregistrement perdu */
+#define REC_HDR           7              /* type, len, tick               */
+#define REC_MAX_SPEED     16
+#define REC_PATH          512
+#define REC_KEEP_MB       1024           /* défaut, DOGFIGHT_RECORD_MAX_MB */
+
+enum { REC_MOVE = 'M', REC_FIRE = 'F', REC_EVENT = 'E', REC_STATE = 'S' };
+
+typedef struct RecChunk {
+    struct RecChunk *next;
+    struct Rec      *rec;
+    int              last;               /* fin du match : fermer, renommer */
+    size_t           len;
+    uint8_t          data[REC_CHUNK];
+} RecChunk;
+
+struct Rec {
+    uint64_t  id;
+    int       fd, failed;                /* thread écrivain seul          */
+    uint64_t  bytes;                     /* id.                           */
+    int       broken;                    /* bloc perdu : fichier supprimé */
+    RecChunk *cur;                       /* bloc en cours (gm->lock)      */
+};
+
+static char            g_recDir[REC_PATH - 32];  /* "" : aucun ; place pour /<id>.dfr.part */
+static uint64_t        g_recNext;            /* dernier id attribué       */
+static size_t          g_recQueued;          /* octets en attente (atomique) */
+static RecChunk       *g_rHead, *g_rTail;
+static pthread_mutex_t m_rec = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  c_rec = PTHREAD_COND_INITIALIZER;
+
+/* .dfr terminés par id croissant (thread écrivain, recInit avant) */
+typedef struct { uint64_t id, bytes; } RecFile;
+static RecFile        *g_recFiles;
+static size_t          g_recFirst, g_recCount, g_recCap;
+static uint64_t        g_recTotal, g_recMax;      /* octets ; 0 : sans limite */
+
+static uint8_t *recPut32(uint8_t *p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+    return p + 4;
+}
+
+static uint8_t *recPutF(uint8_t *p, float f)
+{
+    uint32_t v;
+    memcpy(&v, &f, 4);
+    return recPut32(p, v);
+}
+
+static uint32_t recGet32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static float recGetF(const uint8_t *p)
+{
+    uint32_t v = recGet32(p);
+    float f;
+    memcpy(&f, &v, 4);
+    return f;
+}
+
+static void recPath(char *out, uint64_t id, const char *suffix)
+{
+    snprintf(out, REC_PATH, "%s/%llu.dfr%s", g_recDir, (unsigned long long)id, suffix);
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Côté partie (gm->lock tenu) : jamais d’appel système           */
+/* ─────────────────────────────────────────────────────────────── */
+static void recPush(RecChunk *k)
+{
+    pthread_mutex_lock(&m_rec);
+    if (g_rTail) g_rTail->next = k; else g_rHead = k;
+    g_rTail = k;
+    pthread_cond_signal(&c_rec);
+    pthread_mutex_unlock(&m_rec);
+}
+
+/* bloc plein : à l’écrivain, sauf si la file déborde (disque lent) */
+static void recShip(Rec *r, int last)
+{
+    RecChunk *k = r->cur;
+    r->cur = NULL;
+    if (!k) {
+        if (!last) return;
+        if (!(k = calloc(1, sizeof(*k)))) return;   /* r et son .part restent */
+        k->rec = r;
+    }
+    k->last = last;
+    if (!last && __atomic_load_n(&g_recQueued, __ATOMIC_RELAXED) + k->len > REC_MAX_QUEUED) {
+        r->broken = 1;
+        MET_ADD(recDropped, 1);
+        free(k);
+        return;
+    }
+    __atomic_add_fetch(&g_recQueued, k->len, __ATOMIC_RELAXED);
+    recPush(k);
+}
+
+void recAppend(Rec *r, uint8_t type, uint32_t tick, const void *p, size_t len)
+{
+    if (!r || r->broken) return;
+    if (r->cur && r->cur->len + REC_HDR + len > REC_CHUNK) recShip(r, 0);
+    if (!r->cur) {
+        if (r->broken || !(r->cur = malloc(sizeof(RecChunk)))) { r->broken = 1; return; }
+        r->cur->next = NULL; r->cur->rec = r; r->cur->len = 0;
+    }
+    uint8_t *d = r->cur->data + r->cur->len;
+    d[0] = type; d[1] = (uint8_t)len; d[2] = (uint8_t)(len >> 8);
+    recPut32(d + 3, tick);
+    memcpy(d + REC_HDR, p, len);
+    r->cur->len += REC_HDR + len;
+}
+
+/* nouveau match : NULL si l’enregistrement est désactivé */
+Rec *recStart(uint32_t tick, int stride, int n, char names[][USERNAME_LEN])
+{
+    if (!g_recDir[0]) return NULL;
+    Rec *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    r->id = __atomic_add_fetch(&g_recNext, 1, __ATOMIC_RELAXED);
+    r->fd = -1;
+    if (!(r->cur = malloc(sizeof(RecChunk)))) { free(r); return NULL; }
+    r->cur->next = NULL; r->cur->rec = r;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t ms = (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+    uint8_t *p = r->cur->data;
+    memcpy(p, "DFR1", 4); p += 4;
+    *p++ = (uint8_t)n; *p++ = (uint8_t)stride; *p++ = 0; *p++ = 0;
+    p = recPut32(p, tick);
+    p = recPut32(p, (uint32_t)ms); p = recPut32(p, (uint32_t)(ms >> 32));
+    for (int i = 0; i < n; i++) {
+        size_t l = strnlen(names[i], USERNAME_LEN - 1);
+        *p++ = (uint8_t)l;
+        memcpy(p, names[i], l); p += l;
+    }
+    r->cur->len = (size_t)(p - r->cur->data);
+    return r;
+}
+
+/* entrée appliquée à la simulation, au pas step */
+void recInput(Rec *r, uint32_t tick, uint32_t step, int fire, int slot,
+              float x, float y, float dx, float dy)
+{
+    uint8_t b[25], *p = recPut32(b, step);
+    *p++ = (uint8_t)slot;
+    p = recPutF(p, x); p = recPutF(p, y);
+    if (fire) { p = recPutF(p, dx); p = recPutF(p, dy); }
+    recAppend(r, fire ? REC_FIRE : REC_MOVE, tick, b, (size_t)(p - b));
+}
+
+void recEvent(Rec *r, uint32_t tick, const SimEvent *e)
+{
+    uint8_t b[23], *p = b;
+    *p++ = e->kind; *p++ = (uint8_t)e->slot; *p++ = (uint8_t)e->hp;
+    p = recPut32(p, e->id);
+    if (e->kind == SEV_FIRE_ACK) {
+        p = recPutF(p, e->x);  p = recPutF(p, e->y);
+        p = recPutF(p, e->dx); p = recPutF(p, e->dy);
+    }
+    recAppend(r, REC_EVENT, tick, b, (size_t)(p - b));
+}
+
+/* fin du match : dernier bloc à l’écrivain, qui libère r */
+void recFinish(Rec *r)
+{
+    if (r) recShip(r, 1);
+}
+
+uint64_t recId(const Rec *r) { return r ? r->id : 0; }
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Thread écrivain                                                */
+/* ─────────────────────────────────────────────────────────────── */
+/* nouveau .dfr ; les plus anciens partent au-delà de g_recMax.
+ * Un REPLAY en cours garde sa projection (unlink sans effet dessus) */
+static void recKeep(uint64_t id, uint64_t bytes)
+{
+    if (g_recFirst + g_recCount == g_recCap) {
+        if (g_recFirst) {
+            memmove(g_recFiles, g_recFiles + g_recFirst, g_recCount * sizeof(RecFile));
+            g_recFirst = 0;
+        } else {
+            size_t cap = g_recCap ? g_recCap * 2 : 256;
+            RecFile *f = realloc(g_recFiles, cap * sizeof(RecFile));
+            if (!f) return;                       /* hors limite, jamais perdu */
+            g_recFiles = f; g_recCap = cap;
+        }
+    }
+    g_recFiles[g_recFirst + g_recCount++] = (RecFile){ id, bytes };
+    g_recTotal += bytes;
+    while (g_recMax && g_recTotal > g_recMax && g_recCount > 1) {
+        RecFile *old = &g_recFiles[g_recFirst++];
+        g_recCount--;
+        g_recTotal -= old->bytes;
+        char path[REC_PATH];
+        recPath(path, old->id, "");
+        if (unlink(path) != 0 && errno != ENOENT) perror(path);
+        MET_ADD(recPruned, 1);
+    }
+}
+
+/* r->broken n’est lu qu’au dernier bloc, publié après (m_rec) */
+static void recWrite(RecChunk *k)
+{
+    Rec *r = k->rec;
+    char path[REC_PATH];
+    recPath(path, r->id, ".part");
+    if (r->fd < 0 && !r->failed) {
+        r->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (r->fd < 0) { perror(path); r->failed = 1; }
+    }
+    for (size_t off = 0; r->fd >= 0 && !r->failed && off < k->len; ) {
+        ssize_t w = write(r->fd, k->data + off, k->len - off);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) { perror(path); r->failed = 1; break; }
+        off += (size_t)w;
+        r->bytes += (uint64_t)w;
+        MET_ADD(recBytes, (uint64_t)w);
+    }
+    if (!k->last) return;
+    if (r->fd >= 0) close(r->fd);
+    char done[REC_PATH];
+    recPath(done, r->id, "");
+    if (r->broken || r->failed) unlink(path);
+    else if (rename(path, done) != 0) perror(done);
+    else recKeep(r->id, r->bytes);
+    free(r);
+}
+
+static void *recLoop(void *arg)
+{
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&m_rec);
+        while (!g_rHead) pthread_cond_wait(&c_rec, &m_rec);
+        RecChunk *k = g_rHead;                    /* toute la file d’un coup */
+        g_rHead = g_rTail = NULL;
+        pthread_mutex_unlock(&m_rec);
+        while (k) {
+            RecChunk *next = k->next;
+            __atomic_sub_fetch(&g_recQueued, k->len, __ATOMIC_RELAXED);
+            recWrite(k);
+            free(k);
+            k = next;
+        }
+    }
+    return NULL;
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Diffusion : un thread pour tous les REPLAY en cours            */
+/* ─────────────────────────────────────────────────────────────── */
+typedef struct Replay {
+    struct Replay *next;
+    Conn          *c;                    /* ref tenue                     */
+    uint64_t       id;
+    const uint8_t *map;
+    size_t         size, pos;            /* pos : prochain enregistrement */
+    int            speed, n;
+    uint32_t       tick0;                /* tick du match au départ       */
+    uint64_t       t0;                   /* metNow() au départ            */
+    char           names[SIM_MAX_PLAYERS][USERNAME_LEN];
+} Replay;
+
+static Replay         *g_replays;       /* g_replayCount : jauge         */
+static pthread_mutex_t m_replay = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  c_replay = PTHREAD_COND_INITIALIZER;
+
+/* en-tête lu et vérifié ; 0 si le fichier n’est pas un DFR1 complet */
+static int replayHeader(Replay *rp)
+{
+    const uint8_t *p = rp->map, *end = rp->map + rp->size;
+    if (rp->size < 20 || memcmp(p, "DFR1", 4)) return 0;
+    rp->n = p[4];
+    if (rp->n < 2 || rp->n > SIM_MAX_PLAYERS) return 0;
+    rp->tick0 = recGet32(p + 8);
+    p += 20;
+    for (int i = 0; i < rp->n; i++) {
+        if (p >= end || p + 1 + *p > end || *p >= USERNAME_LEN) return 0;
+        memcpy(rp->names[i], p + 1, *p);
+        rp->names[i][*p] = '\0';
+        p += 1 + *p;
+    }
+    rp->pos = (size_t)(p - rp->map);
+    return 1;
+}
+
+/* 'E' → même ligne que gameEvents() ; 0 si l’enregistrement est illisible */
+static int replayEvent(const Replay *rp, const uint8_t *e, size_t len, char *m, size_t cap)
+{
+    if (len < 7) return 0;
+    int slot = (int8_t)e[1];
+    const char *who = slot >= 0 && slot < rp->n ? rp->names[slot] : "NONE";
+    switch (e[0]) {
+    case SEV_FIRE_ACK:
+        if (len < 23) return 0;
+        return snprintf(m, cap, "FIRE_ACK:%u:%s:%.0f:%.0f:%.0f:%.0f\n", recGet32(e + 3), who,
+                        recGetF(e + 7), recGetF(e + 11), recGetF(e + 15), recGetF(e + 19));
+    case SEV_HIT:       return snprintf(m, cap, "HIT:%s:%d\n", who, e[2]);
+    case SEV_GAME_OVER: return snprintf(m, cap, GAME_OVER_PREFIX "%s\n", who);
+    }
+    return 0;
+}
+
+/* trame BIN2 complète → format du client : recopiée (tick et heure de
+ * la diffusion), sans tick ni heure (BIN1), ou TICK/STATE en texte   */
+static OutBuf *replayFrame(const Replay *rp, const uint8_t *f, size_t len, int v,
+                           uint32_t tick, uint32_t ms)
+{
+    size_t pm = (size_t)(rp->n + 7) / 8, need = 20 + pm + (size_t)rp->n * 5 + 4;
+    if (len < need || f[0] != SNAP_MAGIC) return NULL;
+    if (v >= 2) {
+        OutBuf *b = outNew(f, len);
+        if (b) { recPut32((uint8_t*)b->data + 12, tick); recPut32((uint8_t*)b->data + 16, ms); }
+        return b;
+    }
+    uint8_t out[SNAP_MAX_BYTES];
+    if (v == 1) {
+        if (len - 8 > sizeof(out)) return NULL;
+        memcpy(out, f, 12);
+        memcpy(out + 12, f + 20, len - 20);
+        out[1] = (uint8_t)(len - 11); out[2] = (uint8_t)((len - 11) >> 8);
+        return outNew(out, len - 8);
+    }
+
+    /* texte : photo complète, tous les slots présents */
+    const uint8_t *pl = f + 20 + pm, *pj = pl + (size_t)rp->n * 5;
+    size_t nRem = (size_t)(pj[0] | pj[1] << 8);
+    pj += 2 + nRem * 2;
+    if (pj + 2 > f + len) return NULL;
+    size_t nUpd = (size_t)(pj[0] | pj[1] << 8);
+    pj += 2;
+    if (pj + nUpd * 6 > f + len) return NULL;
+
+    char msg[STATE_MAX_BYTES];
+    char *p = msg, *end = msg + sizeof(msg);
+    p += snprintf(p, end - p, "TICK:%u:%u\nSTATE:", tick, ms);
+    for (size_t k = 0; k < nUpd && end - p > 32; k++, pj += 6)
+        p += snprintf(p, end - p, "%s%u:%d:%d", k ? "," : "", pj[0] | pj[1] << 8,
+                      (int16_t)(pj[2] | pj[3] << 8), (int16_t)(pj[4] | pj[5] << 8));
+    for (int k = 0; k < rp->n && end - p > USERNAME_LEN + 16; k++)
+        p += snprintf(p, end - p, "%c%s:%d", k ? ',' : '|', rp->names[k], pl[k*5 + 4]);
+    for (int k = 0; k < rp->n && end - p > USERNAME_LEN + 96; k++)
+        p += snprintf(p, end - p, "%c%s:%d:%d", k ? ',' : '|', rp->names[k],
+                      (int16_t)(pl[k*5] | pl[k*5 + 1] << 8),
+                      (int16_t)(pl[k*5 + 2] | pl[k*5 + 3] << 8));
+    if (end - p > 1) *p++ = '\n';
+    return outNew(msg, (size_t)(p - msg));
+}
+
+static void replayFree(Replay *rp)
+{
+    munmap((void*)rp->map, rp->size);
+    connRelease(rp->c);
+    free(rp);
+    __atomic_sub_fetch(&g_replayCount, 1, __ATOMIC_RELAXED);
+}
+
+/* ce qui est dû depuis le dernier passage ; 0 une fois terminé */
+static int replayAdvance(Replay *rp, uint64_t now)
+{
+    Conn *c = rp->c;
+    if (__atomic_load_n(&c->closed, __ATOMIC_ACQUIRE)) return 0;
+    uint64_t el = (now - rp->t0) * TICK_HZ / 1000000000ULL;     /* ticks réels */
+    uint64_t due = rp->tick0 + el * (uint64_t)rp->speed;
+    const uint8_t *frame = NULL;
+    size_t frameLen = 0;
+    char m[160];
+    while (rp->pos + REC_HDR <= rp->size) {
+        const uint8_t *r = rp->map + rp->pos;
+        size_t len = (size_t)(r[1] | r[2] << 8);
+        if (rp->pos + REC_HDR + len > rp->size) { rp->pos = rp->size; break; }
+        if ((uint32_t)(recGet32(r + 3) - rp->tick0) > due - rp->tick0) break;
+        rp->pos += REC_HDR + len;
+        if (r[0] == REC_STATE) { frame = r + REC_HDR; frameLen = len; }
+        else if (r[0] == REC_EVENT) {
+            int ml = replayEvent(rp, r + REC_HDR, len, m, sizeof(m));
+            if (ml > 0) connQueue(c, m, (size_t)ml, MSG_CTRL);
+        }
+    }
+    if (frame) {
+        OutBuf *b = replayFrame(rp, frame, frameLen, c->bin, (uint32_t)el, (uint32_t)(now / 1000000));
+        if (b) { connQueueBuf(c, b, MSG_STATE); outRelease(b); }
+    }
+    if (rp->pos + REC_HDR > rp->size) {
+        int ml = snprintf(m, sizeof(m), "REPLAY_END:%llu\n", (unsigned long long)rp->id);
+        connQueue(c, m, (size_t)ml, MSG_CTRL);
+        connFlush(c);
+        return 0;
+    }
+    connFlush(c);
+    return 1;
+}
+
+static void *replayLoop(void *arg)
+{
+    (void)arg;
+    const struct timespec period = { 0, 1000000000L / TICK_HZ };
+    while (1) {
+        pthread_mutex_lock(&m_replay);
+        while (!g_replays) pthread_cond_wait(&c_replay, &m_replay);
+        uint64_t now = metNow();
+        for (Replay **pp = &g_replays; *pp; ) {
+            Replay *rp = *pp;
+            if (replayAdvance(rp, now)) { pp = &rp->next; continue; }
+            *pp = rp->next;
+            replayFree(rp);
+        }
+        pthread_mutex_unlock(&m_replay);
+        nanosleep(&period, NULL);
+    }
+    return NULL;
+}
+
+/* comme replayStop, sans le raccourci sur g_replayCount : après
+ * c->game ≥ 0 (startMatch), m_replay ordonne l’appel avec la
+ * vérification de replayStart, l’un des deux voit l’autre         */
+int replayCancel(Conn *c)
+{
+    int stopped = 0;
+    pthread_mutex_lock(&m_replay);
+    for (Replay **pp = &g_replays; *pp; ) {
+        Replay *rp = *pp;
+        if (rp->c != c) { pp = &rp->next; continue; }
+        *pp = rp->next;
+        replayFree(rp);
+        stopped = 1;
+    }
+    pthread_mutex_unlock(&m_replay);
+    return stopped;
+}
+
+/* arrête le REPLAY de c s’il y en a un (threads I/O) ; 1 si arrêté */
+int replayStop(Conn *c)
+{
+    if (!__atomic_load_n(&g_replayCount, __ATOMIC_RELAXED)) return 0;
+    return replayCancel(c);
+}
+
+/* REPLAY:<id>[:<vitesse>] → REPLAY_OK:<id>:<vitesse> + MATCH_SLOTS,
+ * puis le match ; REPLAY_FAIL si inconnu ou en cours d’écriture     */
+void replayStart(Conn *c, const char *idArg, const char *speedArg)
+{
+    char path[REC_PATH];
+    int speed = speedArg ? atoi(speedArg) : 1;
+    speed = speed < 1 ? 1 : speed > REC_MAX_SPEED ? REC_MAX_SPEED : speed;
+    if (!g_recDir[0] || !idArg || *idArg < '0' || *idArg > '9' ||
+        __atomic_load_n(&c->game, __ATOMIC_ACQUIRE) >= 0) {
+        connSend(c, "REPLAY_FAIL\n", 12);
+        return;
+    }
+    uint64_t id = strtoull(idArg, NULL, 10);
+    recPath(path, id, "");
+    Replay *rp = calloc(1, sizeof(*rp));
+    int fd = rp ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0)
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (fd >= 0) close(fd);
+    if (map == MAP_FAILED) { free(rp); connSend(c, "REPLAY_FAIL\n", 12); return; }
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    rp->map = map; rp->size = (size_t)st.st_size;
+    rp->id = id; rp->speed = speed;
+    if (!replayHeader(rp)) {
+        munmap(map, rp->size); free(rp);
+        connSend(c, "REPLAY_FAIL\n", 12);
+        return;
+    }
+    replayStop(c);
+    spectateLeave(c);
+
+    char m[SIM_MAX_PLAYERS*USERNAME_LEN+64];
+    int  ml = snprintf(m, sizeof(m), "REPLAY_OK:%llu:%d\nMATCH_SLOTS:", (unsigned long long)id, speed);
+    for (int i = 0; i < rp->n; i++)
+        ml += snprintf(m + ml, sizeof(m) - ml, "%s%s", i ? "," : "", rp->names[i]);
+    ml += snprintf(m + ml, sizeof(m) - ml, "\n");
+
+    /* un match a pu démarrer depuis le premier test : revu sous
+     * m_replay, que startMatch prend (replayCancel) après c->game  */
+    pthread_mutex_lock(&m_replay);
+    if (__atomic_load_n(&c->game, __ATOMIC_ACQUIRE) >= 0) {
+        pthread_mutex_unlock(&m_replay);
+        munmap(map, rp->size); free(rp);
+        connSend(c, "REPLAY_FAIL\n", 12);
+        return;
+    }
+    connSend(c, m, (size_t)ml);
+    rp->c  = connAcquire(c);
+    rp->t0 = metNow();
+    rp->next = g_replays; g_replays = rp;
+    __atomic_add_fetch(&g_replayCount, 1, __ATOMIC_RELAXED);
+    pthread_cond_signal(&c_replay);
+    pthread_mutex_unlock(&m_replay);
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Démarrage                                                      */
+/* ─────────────────────────────────────────────────────────────── */
+static int recFileCmp(const void *a, const void *b)
+{
+    uint64_t x = ((const RecFile *)a)->id, y = ((const RecFile *)b)->id;
+    return x < y ? -1 : x > y;
+}
+
+/* dossier créé au besoin ; ids repris après le plus grand présent,
+ * .dfr existants comptés dans la limite (maxMb, 0 : aucune)        */
+static void recInit(const char *dir, long maxMb)
+{
+    pthread_t tid;
+    if (!dir || !*dir) return;
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) { perror(dir); return; }
+    DIR *d = opendir(dir);
+    if (!d) { perror(dir); return; }
+    snprintf(g_recDir, sizeof(g_recDir), "%s", dir);
+    RecFile *found = NULL;
+    size_t n = 0, cap = 0;
+    for (struct dirent *e; (e = readdir(d)); ) {
+        char *end, path[REC_PATH];
+        struct stat st;
+        unsigned long long id = strtoull(e->d_name, &end, 10);
+        if (end == e->d_name || strncmp(end, ".dfr", 4) != 0) continue;
+        if (id > g_recNext) g_recNext = id;
+        recPath(path, id, "");
+        if (end[4] || stat(path, &st) != 0) continue;     /* .dfr.part : ignoré */
+        if (n == cap) {
+            RecFile *f = realloc(found, (cap = cap ? cap * 2 : 256) * sizeof(RecFile));
+            if (!f) break;
+            found = f;
+        }
+        found[n++] = (RecFile){ id, (uint64_t)st.st_size };
+    }
+    closedir(d);
+    qsort(found, n, sizeof(RecFile), recFileCmp);
+    g_recMax = maxMb > 0 ? (uint64_t)maxMb << 20 : 0;
+    for (size_t i = 0; i < n; i++) recKeep(found[i].id, found[i].bytes);
+    free(found);
+    if (pthread_create(&tid, NULL, recLoop, NULL) != 0) { g_recDir[0] = '\0'; return; }
+    pthread_detach(tid);
+    if (pthread_create(&tid, NULL, replayLoop, NULL) == 0) pthread_detach(tid);
+}
@@ -1,29 +1,43 @@
 /* =============================================================
  *  Dogfight Server – version « duels » + persistance MySQL
- *  © 2025 – compile :  gcc -pthread -lmysqlclient server.c -o server
+ *  © 2025 – compile :  gcc -pthread server.c -o server -lmysqlclient -lm
  * ===========================================================*/
 
+#define _GNU_SOURCE                  /* accept4()                     */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <mysql/mysql.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>             /* TCP_NODELAY                   */
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <pthread.h>
 #include <time.h>
 #include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stddef.h>                  /* offsetof()                    */
 
 /* ------------------ Paramètres généraux ------------------ */
 #define PORT                 12345
 #define BUFFER_SIZE          2048
-#define MAX_PLAYERS          100
 #define USERNAME_LEN         50
-#define MAX_CLIENTS          100
-#define MAX_INVITES          50
-#define MAX_GAMES            20
-#define MAX_PROJECTILES      256
+#define MAX_CLIENTS          65536   /* défaut, DOGFIGHT_MAX_CLIENTS  */
+#define MAX_INVITES          8192    /* défaut, DOGFIGHT_MAX_INVITES  */
+#define MAX_GAMES            4096    /* défaut, DOGFIGHT_MAX_GAMES    */
+#define SLAB_SHIFT_CONN      8       /* 256 connexions par tranche    */
+#define SLAB_SHIFT_INVITE    8
+#define SLAB_SHIFT_GAME      4       /* 16 parties par tranche        */
+#define INVITE_BUCKETS       1024    /* index invitations (2^n)       */
+#define INVITE_TTL_S         30      /* sans réponse : expirée        */
+#define INVITE_WHEEL         64      /* cases d’1 s (> INVITE_TTL_S)  */
+#define MAX_PROJECTILES      512     /* par partie (arène : 64×5 tirs) */
 #define MAX_ACTIVE_MISSILES  5
 #define PLANE_SIZE           40
 #define PROJECTILE_SIZE      20
@@ -33,8 +47,32 @@
 #define MAX_HEALTH           100
 #define DMG_PER_HIT          10
 #define TICK_HZ              60
+#define TICK_CATCHUP_MAX     5       /* pas rattrapés d’un coup, au-delà : perdus */
+#define MATCH_HZ             60      /* défaut, DOGFIGHT_MATCH_HZ (10..60) */
+#define TICK_REPORT_S        10      /* bilan des dépassements sur stderr */
 #define GAME_OVER_PREFIX     "GAME_OVER:"
 #define WIN_SCORE            100     /* points crédités au vainqueur */
+#define MAX_EVENTS           64      /* événements epoll par réveil  */
+#define INBUF_INIT           512     /* tampon d’entrée initial       */
+#define MAX_LINE             16384   /* ligne plus longue → on coupe  */
+#define SNAP_MAGIC           0xFF    /* 1er octet d’une trame binaire */
+#define SNAP_HISTORY         32      /* snapshots gardés pour les deltas (2^n) */
+#define SNAP_MAX_BYTES       (24 + SIM_MAX_PLAYERS/8 + SIM_MAX_PLAYERS*5 + 4 + MAX_PROJECTILES*8)
+#define STATE_MAX_BYTES      (96 + MAX_PROJECTILES*24 + SIM_MAX_PLAYERS*(2*USERNAME_LEN+32))
+#define ARENA_MIN            3       /* ARENA:<n>, n ∈ [ARENA_MIN, SIM_MAX_PLAYERS] */
+#define SNAP_HZ_MIN          10      /* cadence plancher d’un client lent */
+#define RATE_DIV_MAX         (TICK_HZ/SNAP_HZ_MIN)   /* ticks entre envois */
+#define RATE_QUEUE_HIGH      (8*1024)    /* file sortante : on ralentit */
+#define RATE_RTT_HIGH_US     150000      /* RTT (ACK binaires) : idem   */
+#define RATE_PROBE           30      /* envois sains avant de réaccélérer */
+#define SPECTATE_HZ          15      /* défaut, DOGFIGHT_SPECTATE_HZ  */
+#define MAX_SPECTATORS       1024    /* par partie, DOGFIGHT_MAX_SPECTATORS */
+#define CONN_BUCKETS         4096    /* index connexions (2^n)        */
+#define CONN_STRIPES         64      /* verrous de l’index (2^n)      */
+#define OUT_HIGH_WATER       (64*1024)   /* au-delà : snapshots jetés */
+#define OUT_MAX_BYTES        (1024*1024) /* au-delà : client déconnecté */
+#define OUT_IOV              64      /* segments par writev()         */
+#define INPUT_RING           256     /* entrées en attente par partie (2^n) */
 
 /* ----------------------- Structures ----------------------- */
 typedef struct {
@@ -42,44 +80,223 @@ typedef struct {
     char inviter[USERNAME_LEN];
     char invitee[USERNAME_LEN];
     int  response;                 /* 0 = pending, 1 = yes, -1 = no */
+    int  stride;                   /* pas du duel, en ticks (INVITE:<u>:<hz>) */
+    /* index (handles, -1 = fin) et roue d’expiration, sous m_invites */
+    int  nextByInviter, nextByInvitee;
+    int  wheelPrev, wheelNext, wheelSlot;
 } Invitation;
 
+/* Règles du duel : état pur, entrées → événements (sim.c) */
+#include "sim.c"
+
+typedef struct Conn Conn;
+typedef struct Rec  Rec;              /* journal d’un match (record.c) */
+
+/* Message sortant, partageable entre plusieurs files (refs) */
 typedef struct {
-    int   active, id;
-    float x, y, dx, dy;
-    char  owner[USERNAME_LEN];
-} Projectile;
+    int      refs;                    /* atomique                     */
+    uint32_t len;
+    uint8_t  type;                    /* métrique : OUT_… (metrics.c) */
+    char     data[];
+} OutBuf;
+
+enum { MSG_CTRL, MSG_STATE };         /* MSG_STATE : remplaçable/jetable */
 
 typedef struct {
-    int   active;
-    char  players[2][USERNAME_LEN];   /* duel → 2 joueurs */
-    float posX[2], posY[2];
-    int   hp[2];
+    OutBuf *buf;
+    int     kind;
+} OutSeg;
 
-    Projectile proj[MAX_PROJECTILES];
-    int   projCount, nextProjId;
+/* Photo d’une partie telle qu’envoyée à UN client (pour les deltas) */
+typedef struct {
+    uint32_t seq;
+    uint64_t sentNs;                  /* mis en file à (RTT sur ACK)  */
+    int16_t  x[SIM_MAX_PLAYERS], y[SIM_MAX_PLAYERS];
+    uint8_t  hp[SIM_MAX_PLAYERS];
+    uint16_t nProj;                   /* projectiles triés par id     */
+    uint32_t projId[MAX_PROJECTILES];
+    int16_t  projX [MAX_PROJECTILES], projY[MAX_PROJECTILES];
+} Snapshot;
+
+/* Entrées des joueurs vers leur partie : file MPSC bornée sans verrou
+ * (cases numérotées, Vyukov). Les threads I/O ne font qu’y déposer ;
+ * le thread qui simule le tick la vide au début de celui-ci, gm->lock
+ * tenu (un seul consommateur à la fois).                           */
+enum { IN_MOVE, IN_FIRE, IN_ACK };
 
-    int   db_id;                      /* id_game (table game) */
+typedef struct {
+    uint32_t connId;                  /* émetteur, revérifié au drain */
+    uint8_t  kind;                    /* IN_MOVE / IN_FIRE / IN_ACK   */
+    uint8_t  slot;                    /* c->slot au dépôt             */
+    uint32_t ack;                     /* IN_ACK : seq acquitté        */
+    uint64_t ns;                      /* IN_ACK : reçu à (RTT)        */
+    float    x, y, dx, dy;
+} GameInput;
 
-    pthread_mutex_t lock;
+typedef struct {
+    uint32_t  seq;                    /* atomique : pos+1 = pleine    */
+    GameInput in;
+} InputCell;
+
+typedef struct {
+    uint32_t  tail;                   /* producteurs (CAS)            */
+    InputCell cell[INPUT_RING];       /* sépare tail/head (partage)   */
+    uint32_t  head;                   /* consommateur seul            */
+} InputRing;
+
+typedef struct {
+    pthread_mutex_t lock;             /* en tête : survit au reset    */
+    InputRing in;                     /* idem : jamais remise à zéro  */
+
+    int   active;
+    int   handle;                     /* indice dans g_gameSlab       */
+    int   shardPos;                   /* place dans shard->games      */
+    int   shard;                      /* shard physique propriétaire  */
+    uint64_t tick;                    /* dernier tick simulé (claim)  */
+    int   stride;                     /* un pas tous les stride ticks */
+    int   nPlayers;                   /* 2 : duel, sinon arène        */
+    char  players[SIM_MAX_PLAYERS][USERNAME_LEN];
+    Conn *conn[SIM_MAX_PLAYERS];      /* handles résolus au startMatch */
+    SimState sim;                     /* positions, vies, projectiles */
+
+    uint64_t matchKey;                /* clé de persistance (duels seulement) */
+    Rec     *rec;                     /* NULL : pas d’enregistrement  */
+    uint8_t  recDirty;                /* photo à journaliser          */
+    uint64_t recTick;                 /* tick de la dernière photo    */
+    uint32_t recSeq;
+
+    /* snapshots binaires (clients ayant négocié BIN1/BIN2 au LOGIN) */
+    int       bin[SIM_MAX_PLAYERS];   /* version, 0 : texte           */
+    uint32_t  snapSeq[SIM_MAX_PLAYERS];   /* dernier seq envoyé       */
+    uint32_t  ackSeq[SIM_MAX_PLAYERS];    /* dernier seq acquitté (ACK:) */
+    Snapshot *hist[SIM_MAX_PLAYERS];  /* SNAP_HISTORY derniers envois */
+
+    /* cadence par joueur : rien tant que rien n’a bougé, sinon au plus
+     * un envoi tous les rateDiv ticks (adapté à sa file et à son RTT) */
+    uint8_t   dirty[SIM_MAX_PLAYERS];     /* état changé depuis son envoi */
+    uint64_t  sentTick[SIM_MAX_PLAYERS];  /* tick de son dernier envoi    */
+    int       rateDiv[SIM_MAX_PLAYERS];   /* 1..RATE_DIV_MAX              */
+    int       rateOk[SIM_MAX_PLAYERS];    /* envois sains d’affilée       */
+    uint32_t  rttUs[SIM_MAX_PLAYERS];     /* lissé, 0 : inconnu (texte)   */
+
+    /* spectateurs : une photo commune, tous les g_specDiv ticks au plus */
+    Conn    **spec;                   /* refs tenues, libéré à endGame */
+    int       nSpec, specCap;
+    uint8_t   specDirty;
+    uint64_t  specTick;
+    uint32_t  specSeq;                /* trames binaires (toujours complètes) */
 } Game;
 
-/* ----------------------- Globals -------------------------- */
-static char g_connected[MAX_PLAYERS][USERNAME_LEN];
-static int  g_numPlayers = 0;
+/* Shard physique : un thread qui simule « ses » parties à TICK_HZ et
+ * vole les parties pas encore simulées des autres shards s’il a fini */
+typedef struct {
+    pthread_t       tid;
+    pthread_mutex_t lock;             /* protège games/count          */
+    int            *games;            /* handles de g_gameSlab        */
+    int             count, cap;
+    uint64_t        stolen;           /* ticks volés à d’autres shards */
+    /* budget : un tick doit tenir dans 1/TICK_HZ (thread du shard seul) */
+    uint64_t        ticks;            /* réveils                      */
+    uint64_t        steps;            /* pas simulés (rattrapage compris) */
+    uint64_t        catchup;          /* pas en plus du premier       */
+    uint64_t        dropped;          /* pas abandonnés (> CATCHUP_MAX) */
+    uint64_t        overruns;         /* tick fini après l’échéance suivante */
+    uint64_t        busyNs, maxNs;    /* travail cumulé / pire tick   */
+    int64_t         lateNsMax;        /* pire retard de réveil        */
+} PhysShard;
+
+/* Une connexion client : lue/écrite par UN thread I/O (pas de verrou).
+ * Les autres threads la tiennent par handle (refs) : le fd n’est fermé
+ * qu’au dernier connRelease(), il ne peut donc pas être réattribué
+ * sous leurs pieds.                                                 */
+struct Conn {
+    int       fd;
+    uint32_t  id;
+    int       handle;                 /* indice dans g_connSlab       */
+    int       refs;                   /* atomique                     */
+    int       closed;                 /* atomique : plus d’envoi      */
+    char      user[USERNAME_LEN];
+    int       logged;
+    int       bin;                    /* snapshots binaires négociés  */
+    int       game, slot;             /* partie en cours (-1 sinon)   */
+    int       arena;                  /* taille d’arène attendue, 0 : aucune (m_arena) */
+    int       spectate;               /* partie regardée (-1 sinon), gm->lock */
+    uint64_t  udpToken;               /* 0 : pas de canal UDP demandé */
+    uint64_t  udpPeer;                /* adresse liée (udp.c), 0 : TCP */
+    uint32_t  udpMoveSeq;             /* dernier MOVE UDP (thread UDP) */
+    int       lobbyIdx;               /* place dans g_lobby (-1 sinon) */
+    int       epfd;                   /* epoll du thread I/O proprio  */
+    int       io;                     /* son indice dans g_io         */
+    int       dbBusy;                 /* commande SQL chez un worker  */
+    int       cmdKind;                /* …sa métrique (metCmdIndex)   */
+    uint64_t  cmdStart;               /* …et son arrivée (metNow)     */
+
+    /* file sortante : alimentée par tous les threads, vidée en writev
+     * non bloquant ; EPOLLOUT armé tant qu’il reste des octets        */
+    pthread_mutex_t outLock;
+    OutSeg   *out;
+    size_t    outCap, outHead, outCount;
+    size_t    outOff;                 /* déjà écrit du 1er segment    */
+    size_t    outBytes;               /* total en attente             */
+    int       outArmed;
+
+    /* flux entrant : [inHead, inHead+inLen) = octets pas encore traités */
+    char   *in;
+    size_t  inCap, inHead, inLen;
+
+    Conn     *nextId, *nextName;      /* chaînage des index           */
+};
+
+/* Thread I/O : un epoll et les connexions qui y sont inscrites ;
+ * les workers SQL y rendent leurs commandes via wakefd           */
+typedef struct {
+    int        epfd;
+    int        wakefd;                /* eventfd, data.ptr = l’IoThread */
+    pthread_t  tid;
+    pthread_mutex_t doneLock;
+    struct SqlJob  *done;             /* commandes SQL terminées      */
+} IoThread;
 
-static int  g_clientSockets[MAX_CLIENTS];
-static char g_socketUsers [MAX_CLIENTS][USERNAME_LEN];
-static int  g_clientCount = 0;
+/* Allocateur des registres (slabAlloc / slabFree / slabAt) */
+#include "slab.c"
 
-static Invitation g_invites[MAX_INVITES];
-static Game       g_games  [MAX_GAMES];
+/* ----------------------- Globals -------------------------- */
+/* lobby : joueurs connectés (ordre quelconque), version des deltas */
+static Conn   **g_lobby;
+static int      g_lobbyCount, g_lobbyCap;
+static uint64_t g_lobbyVer;
+
+/* index des connexions : par id et par username, verrous par bande */
+static Conn            *g_connById  [CONN_BUCKETS];
+static Conn            *g_connByName[CONN_BUCKETS];
+static pthread_rwlock_t g_connLocks [CONN_STRIPES];
+static uint32_t         g_nextConnId = 0;
+
+/* registres : tranches allouées à la demande, handles stables */
+static Slab g_connSlab, g_inviteSlab, g_gameSlab;
+#define gameAt(h)    ((Game*)slabAt(&g_gameSlab,(h)))
+#define inviteAt(h)  ((Invitation*)slabAt(&g_inviteSlab,(h)))
+
+static IoThread  *g_io;
+static int        g_ioCount = 0;
+
+static PhysShard *g_shards;
+static int        g_shardCount = 0;
+static struct timespec g_tick0;        /* origine commune des ticks */
+
+/* Configuration (variables d’environnement, défauts = #define) */
+static size_t g_outHighWater = OUT_HIGH_WATER;
+static size_t g_outMaxBytes  = OUT_MAX_BYTES;
+static int    g_specDiv      = TICK_HZ / SPECTATE_HZ;   /* ticks entre photos */
+static int    g_matchStride  = TICK_HZ / MATCH_HZ;      /* défaut des matchs  */
+static int    g_specMax      = MAX_SPECTATORS;
+static int    g_spectators;                             /* jauge (atomique)   */
+static int    g_replayCount;                            /* REPLAY en cours    */
 
 /* Mutexes */
 static pthread_mutex_t m_players = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t m_clients = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t m_invites = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t m_games   = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t m_arena   = PTHREAD_MUTEX_INITIALIZER;  /* files d’arène, départs de match */
 
 /* DB credentials (adapter) */
 static const char *DB_HOST = "localhost";
@@ -88,48 +305,124 @@ static const char *DB_PASS = "so";
 static const char *DB_NAME = "SO";
 static unsigned int DB_PORT = 0;
 
+/* Pool MySQL partagé (dbAcquire / dbRelease) */
+#include "db_pool.c"
+
+/* Compteurs par thread, STATS et socket d’admin */
+#include "metrics.c"
+
 /* -------------------- Déclarations ------------------------ */
-void *handleClient(void *arg);
+void *ioLoop(void *arg);
+int   handleClient(Conn*, char*);
+void  closeConn(IoThread*, Conn*);
 void *physicsLoop(void *arg);
+void  tickGame(Game *gm, int steps);
+static uint64_t currentTick(void);
 void  sendState(Game *gm);
-
-void registerUser(MYSQL*, const char*, const char*, const char*, int);
-void loginUser   (MYSQL*, const char*, const char*, int, char*, int*);
-void queryOne(MYSQL*, int);
-void queryTwo(MYSQL*, int);
-void queryThree(MYSQL*, int);
-void deleteAccount(MYSQL*, const char*, int);
-
-
-void addConnectedPlayer(const char*);
-void removeConnectedPlayer(const char*);
-void broadcastPlayersList(void);
-
-void addClientSocket(int);
-void removeClientSocket(int);
-void broadcastMessage(const char*);
-int  socketFromUsername(const char*);
-void setSocketUsername(int,const char*);
+void  endGame(Game *gm);
+
+void registerUser(DbConn*, const char*, const char*, const char*, Conn*);
+void loginUser   (DbConn*, const char*, const char*, Conn*, char*, int*);
+void deleteAccount(DbConn*, const char*, Conn*);
+
+/* ------- classements en cache (leaderboard.c) -------- */
+void lbInit(void);
+int  lbServe(Conn*, int);
+void lbReload(DbConn*, Conn*, int);
+void lbInvalidate(void);
+void lbGameStarted(int, const char*, const char*);
+void lbGameEnded(int, const char*, int, int, const char*);
+
+
+void lobbyJoin(Conn*);
+void lobbyLeave(Conn*);
+void lobbySnapshot(Conn*);
+
+Conn *connNew(int);
+Conn *connAcquire(Conn*);
+void  connRelease(Conn*);
+Conn *connByName(const char*);
+Conn *connById(uint32_t);
+void  connSetName(Conn*,const char*);
+void  connUnlink(Conn*);
+OutBuf *outNew(const void*,size_t);
+void  outRelease(OutBuf*);
+int   connQueueBuf(Conn*,OutBuf*,int);
+int   connQueue(Conn*,const void*,size_t,int);
+void  connFlush(Conn*);
+int   connSend(Conn*,const void*,size_t);
+void  broadcastMessage(const char*);
 
 int  findInviteSlot(const char*);
-void createInvitation(const char*, const char*);
+void createInvitation(const char*, const char*, int);
 void handleInviteAnswer(const char*, const char*, int);
+void inviteIndexInit(void);
+void dropInvitesOf(const char*);
+void *inviteReaper(void*);
 void startGame(Invitation*);
-
-int  findGameByPlayer(const char*);
-void fireFromPlayer(int, const char*, float, float, float, float);
+void startMatch(const char *const*, int, int);
+void arenaJoin(Conn*, int);
+void arenaLeave(Conn*);
+void spectateJoin(Conn*, const char*);
+void spectateLeave(Conn*);
+static void arenaRemove(Conn*);
+static void gameCtor(void*);
+
+static void gamePost(Conn*, GameInput);
+static void ackSnapshot(Conn*, uint32_t);
+static int inputPop(InputRing*, GameInput*);
+static int gameEvents(Game*, const SimEvents*);
 
 /* ------- helper MySQL pour l’enregistrement -------- */
 static MYSQL *open_db(void);
-static void   close_db(MYSQL*);
-static int    db_createGame(const char*, const char*);
-static void   db_finishGame(int,const char*,const char*);
+
+/* ------- persistance asynchrone des parties (persist.c) -------- */
+void     persistStart(const char*);
+uint64_t persistGameStart(const char*, const char*);
+void     persistGameEnd(uint64_t, const char*, const char*);
+
+/* MOVE / STATE par datagrammes, à côté de TCP */
+#include "udp.c"
+
+/* journal binaire des matchs, REPLAY:<id> */
+#include "record.c"
 
 /* =========================================================
  *                        MAIN
  * =======================================================*/
+static long envLong(const char *name, long def)
+{
+    const char *v = getenv(name);
+    return v && *v ? strtol(v, NULL, 10) : def;
+}
+
+/* cadence demandée (Hz) → pas en ticks, arrondi vers la cadence
+ * supérieure ; ≤ 0 : défaut du nœud                               */
+static int matchStride(long hz)
+{
+    if (hz <= 0) return g_matchStride;
+    int k = hz >= TICK_HZ ? 1 : (int)(TICK_HZ / hz);
+    return k > SIM_MAX_STRIDE ? SIM_MAX_STRIDE : k;
+}
+
 int main(void)
 {
+    g_outHighWater = (size_t)envLong("DOGFIGHT_OUT_HIGH_WATER", OUT_HIGH_WATER);
+    g_outMaxBytes  = (size_t)envLong("DOGFIGHT_OUT_MAX_BYTES",  OUT_MAX_BYTES);
+    long specHz    = envLong("DOGFIGHT_SPECTATE_HZ", SPECTATE_HZ);
+    g_specDiv      = specHz > 0 && specHz < TICK_HZ ? (int)(TICK_HZ / specHz) : 1;
+    g_specMax      = (int)envLong("DOGFIGHT_MAX_SPECTATORS", MAX_SPECTATORS);
+    g_matchStride  = matchStride(envLong("DOGFIGHT_MATCH_HZ", MATCH_HZ));
+    metInit(getenv("DOGFIGHT_ADMIN_SOCKET"), getenv("DOGFIGHT_ADMINS"));
+    projKernelInit();
+    dbPoolInit((int)envLong("DOGFIGHT_DB_POOL", DB_POOL_SIZE),
+               (int)envLong("DOGFIGHT_DB_WORKERS", DB_WORKERS));
+    lbInit();
+    persistStart(getenv("DOGFIGHT_SPILL_FILE"));
+    udpInit(PORT, (unsigned)envLong("DOGFIGHT_UDP_LOSS", 0));
+    const char *recDir = getenv("DOGFIGHT_RECORD_DIR");
+    recInit(recDir ? recDir : RECORD_DIR, envLong("DOGFIGHT_RECORD_MAX_MB", REC_KEEP_MB));
+
     int server_sock = socket(AF_INET, SOCK_STREAM, 0);
     int opt = 1;
     setsockopt(server_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
@@ -143,148 +436,534 @@ int main(void)
     if (bind(server_sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
         perror("bind");  return 1;
     }
-    listen(server_sock, 10);
+    listen(server_sock, SOMAXCONN);
     printf("Server listening on %d\n", PORT);
 
-    pthread_t physTid;
-    pthread_create(&physTid, NULL, physicsLoop, NULL);
+    /* un client qui ferme pendant un write() ne doit pas tuer le serveur */
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < CONN_STRIPES; i++)
+        pthread_rwlock_init(&g_connLocks[i], NULL);
+    if (slabInit(&g_connSlab, sizeof(Conn), SLAB_SHIFT_CONN,
+                 (int)envLong("DOGFIGHT_MAX_CLIENTS", MAX_CLIENTS), NULL) ||
+        slabInit(&g_inviteSlab, sizeof(Invitation), SLAB_SHIFT_INVITE,
+                 (int)envLong("DOGFIGHT_MAX_INVITES", MAX_INVITES), NULL) ||
+        slabInit(&g_gameSlab, sizeof(Game), SLAB_SHIFT_GAME,
+                 (int)envLong("DOGFIGHT_MAX_GAMES", MAX_GAMES), gameCtor)) {
+        fprintf(stderr, "registres : mémoire insuffisante\n");
+        return 1;
+    }
+    inviteIndexInit();
+    pthread_t reaper;
+    pthread_create(&reaper, NULL, inviteReaper, NULL);
+    pthread_detach(reaper);
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) cores = 1;
+
+    /* --- physique : un shard par cœur, ticks alignés sur g_tick0 --- */
+    clock_gettime(CLOCK_MONOTONIC, &g_tick0);
+    g_shardCount = (int)cores;
+    g_shards = calloc(g_shardCount, sizeof(PhysShard));
+    for (int i = 0; i < g_shardCount; i++) {
+        pthread_mutex_init(&g_shards[i].lock, NULL);
+        pthread_create(&g_shards[i].tid, NULL, physicsLoop, &g_shards[i]);
+    }
+
+    /* --- threads I/O : un par cœur, chacun son epoll --- */
+    g_ioCount = (int)cores;
+    g_io = calloc(g_ioCount, sizeof(IoThread));
+    for (int i = 0; i < g_ioCount; i++) {
+        g_io[i].epfd   = epoll_create1(EPOLL_CLOEXEC);
+        g_io[i].wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (g_io[i].epfd < 0 || g_io[i].wakefd < 0) { perror("epoll/eventfd"); return 1; }
+        pthread_mutex_init(&g_io[i].doneLock, NULL);
+        struct epoll_event wev = { .events = EPOLLIN, .data.ptr = &g_io[i] };
+        if (epoll_ctl(g_io[i].epfd, EPOLL_CTL_ADD, g_io[i].wakefd, &wev) != 0) {
+            perror("epoll_ctl"); return 1;
+        }
+        pthread_create(&g_io[i].tid, NULL, ioLoop, &g_io[i]);
+    }
+    printf("%d I/O thread(s)\n", g_ioCount);
 
+    /* --- accept : répartition round-robin entre les threads I/O --- */
+    unsigned next = 0;
     while (1) {
-        int client = accept(server_sock, NULL, NULL);
-        addClientSocket(client);
-        pthread_t tid;
-        int *p = malloc(sizeof(int));
-        *p = client;
-        pthread_create(&tid, NULL, handleClient, p);
+        int client = accept4(server_sock, NULL, NULL,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) perror("accept");
+            continue;
+        }
+        /* petits messages (STATE, acks) : pas d’attente Nagle / ACK retardé */
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        Conn *c = connNew(client);
+        if (!c) { close(client); continue; }
+
+        IoThread *io = &g_io[next++ % g_ioCount];
+        c->epfd = io->epfd;
+        c->io   = (int)(io - g_io);
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP,
+                                  .data.ptr = c };
+        if (epoll_ctl(io->epfd, EPOLL_CTL_ADD, client, &ev) != 0) {
+            perror("epoll_ctl");
+            connUnlink(c);
+            connRelease(c);
+        }
     }
 }
 
 /* =========================================================
- *            Gestion des sockets clients connectés
+ *     Index des connexions  (id → Conn, username → Conn)
+ *     lookups O(1) ; chaque bucket est protégé par une des
+ *     CONN_STRIPES bandes de verrous lecteur/écrivain.
  * =======================================================*/
-void addClientSocket(int sock)
+static uint32_t hashName(const char *u)
 {
-    pthread_mutex_lock(&m_clients);
-    g_clientSockets[g_clientCount] = sock;
-    g_socketUsers [g_clientCount][0] = '\0';
-    g_clientCount++;
-    pthread_mutex_unlock(&m_clients);
+    uint32_t h = 2166136261u;                 /* FNV-1a */
+    while (*u) { h ^= (uint8_t)*u++; h *= 16777619u; }
+    return h;
 }
+#define BUCKET_LOCK(b) (&g_connLocks[(b) & (CONN_STRIPES-1)])
 
-void removeClientSocket(int sock)
+Conn *connAcquire(Conn *c)
 {
-    pthread_mutex_lock(&m_clients);
-    for (int i = 0; i < g_clientCount; i++)
-        if (g_clientSockets[i] == sock)
-        {
-            for (int j = i; j < g_clientCount-1; j++) {
-                g_clientSockets[j] = g_clientSockets[j+1];
-                strcpy(g_socketUsers[j], g_socketUsers[j+1]);
-            }
-            g_clientCount--;
-            break;
+    __atomic_add_fetch(&c->refs, 1, __ATOMIC_RELAXED);
+    return c;
+}
+
+void connRelease(Conn *c)
+{
+    if (!c || __atomic_sub_fetch(&c->refs, 1, __ATOMIC_ACQ_REL)) return;
+    close(c->fd);
+    for (size_t i = 0; i < c->outCount; i++)
+        outRelease(c->out[(c->outHead + i) % c->outCap].buf);
+    free(c->out);
+    pthread_mutex_destroy(&c->outLock);
+    free(c->in);
+    slabFree(&g_connSlab, c->handle);
+}
+
+/* NULL si DOGFIGHT_MAX_CLIENTS connexions sont déjà ouvertes */
+Conn *connNew(int fd)
+{
+    int h = slabAlloc(&g_connSlab);
+    if (h < 0) return NULL;
+    Conn *c = slabAt(&g_connSlab, h);
+    memset(c, 0, sizeof(*c));
+    c->handle = h;
+    c->fd   = fd;
+    c->refs = 1;                              /* référence du thread I/O */
+    c->game = -1;
+    c->spectate = -1;
+    c->lobbyIdx = -1;
+    pthread_mutex_init(&c->outLock, NULL);
+    c->id   = __atomic_add_fetch(&g_nextConnId, 1, __ATOMIC_RELAXED);
+
+    uint32_t b = c->id & (CONN_BUCKETS-1);
+    pthread_rwlock_wrlock(BUCKET_LOCK(b));
+    c->nextId = g_connById[b];
+    g_connById[b] = c;
+    pthread_rwlock_unlock(BUCKET_LOCK(b));
+    return c;
+}
+
+Conn *connById(uint32_t id)
+{
+    uint32_t b = id & (CONN_BUCKETS-1);
+    Conn *r = NULL;
+    pthread_rwlock_rdlock(BUCKET_LOCK(b));
+    for (Conn *c = g_connById[b]; c; c = c->nextId)
+        if (c->id == id) { r = connAcquire(c); break; }
+    pthread_rwlock_unlock(BUCKET_LOCK(b));
+    return r;
+}
+
+/* handle acquis (à relâcher) ou NULL si le joueur n’est pas connecté */
+Conn *connByName(const char *u)
+{
+    uint32_t b = hashName(u) & (CONN_BUCKETS-1);
+    Conn *r = NULL;
+    pthread_rwlock_rdlock(BUCKET_LOCK(b));
+    for (Conn *c = g_connByName[b]; c; c = c->nextName)
+        if (strcmp(c->user, u) == 0) { r = connAcquire(c); break; }
+    pthread_rwlock_unlock(BUCKET_LOCK(b));
+    return r;
+}
+
+static void unlinkName(Conn *c)
+{
+    if (!c->user[0]) return;
+    uint32_t b = hashName(c->user) & (CONN_BUCKETS-1);
+    pthread_rwlock_wrlock(BUCKET_LOCK(b));
+    for (Conn **pp = &g_connByName[b]; *pp; pp = &(*pp)->nextName)
+        if (*pp == c) { *pp = c->nextName; break; }
+    pthread_rwlock_unlock(BUCKET_LOCK(b));
+}
+
+/* (ré)indexe la connexion sous ce nom — la plus récente gagne */
+void connSetName(Conn *c, const char *u)
+{
+    unlinkName(c);
+    strncpy(c->user, u, USERNAME_LEN-1);
+    uint32_t b = hashName(c->user) & (CONN_BUCKETS-1);
+    pthread_rwlock_wrlock(BUCKET_LOCK(b));
+    c->nextName = g_connByName[b];
+    g_connByName[b] = c;
+    pthread_rwlock_unlock(BUCKET_LOCK(b));
+}
+
+void connUnlink(Conn *c)
+{
+    unlinkName(c);
+    uint32_t b = c->id & (CONN_BUCKETS-1);
+    pthread_rwlock_wrlock(BUCKET_LOCK(b));
+    for (Conn **pp = &g_connById[b]; *pp; pp = &(*pp)->nextId)
+        if (*pp == c) { *pp = c->nextId; break; }
+    pthread_rwlock_unlock(BUCKET_LOCK(b));
+}
+
+/* =========================================================
+ *     Files sortantes  (non bloquantes, writev, backpressure)
+ * =======================================================*/
+OutBuf *outNew(const void *data, size_t len)
+{
+    OutBuf *b = malloc(sizeof(OutBuf) + len);
+    if (!b) return NULL;
+    b->refs = 1;
+    b->len  = (uint32_t)len;
+    memcpy(b->data, data, len);
+    b->type = (uint8_t)metOutIndex(b->data, len);
+    return b;
+}
+
+void outRelease(OutBuf *b)
+{
+    if (b && __atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) == 0) free(b);
+}
+
+static void setEpollOut(Conn *c, int on)          /* outLock tenu */
+{
+    if (c->outArmed == on) return;
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP | (on ? EPOLLOUT : 0),
+                              .data.ptr = c };
+    if (epoll_ctl(c->epfd, EPOLL_CTL_MOD, c->fd, &ev) == 0) c->outArmed = on;
+}
+
+/* client trop lent (ou socket morte) : on coupe, le thread I/O
+ * verra la fermeture et fera le ménage via closeConn()          */
+static void connKill(Conn *c)                     /* outLock tenu */
+{
+    __atomic_store_n(&c->closed, 1, __ATOMIC_RELEASE);
+    shutdown(c->fd, SHUT_RDWR);
+    MET_ADD(queued, -(int64_t)c->outBytes);
+    for (size_t i = 0; i < c->outCount; i++)
+        outRelease(c->out[(c->outHead + i) % c->outCap].buf);
+    c->outCount = c->outHead = c->outOff = c->outBytes = 0;
+}
+
+/* met en file sans écrire ; prend une référence sur b.
+ * MSG_STATE : remplace le snapshot encore non entamé en file,
+ * ou est jeté au-dessus du high-water mark.                    */
+int connQueueBuf(Conn *c, OutBuf *b, int kind)
+{
+    if (!c || !b || __atomic_load_n(&c->closed, __ATOMIC_ACQUIRE)) return -1;
+    pthread_mutex_lock(&c->outLock);
+    if (c->closed) { pthread_mutex_unlock(&c->outLock); return -1; }
+
+    if (kind == MSG_STATE) {
+        for (size_t i = c->outCount; i-- > 0; ) {
+            if (i == 0 && c->outOff) break;      /* déjà en cours d’envoi */
+            OutSeg *sg = &c->out[(c->outHead + i) % c->outCap];
+            if (sg->kind != MSG_STATE) continue;
+            c->outBytes += b->len; c->outBytes -= sg->buf->len;
+            MET_ADD(queued, (int64_t)b->len - (int64_t)sg->buf->len);
+            MET_ADD(stateReplaced, 1);
+            outRelease(sg->buf);
+            sg->buf = b;
+            __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&c->outLock);
+            return 0;
+        }
+        if (c->outBytes >= g_outHighWater) {
+            pthread_mutex_unlock(&c->outLock);
+            MET_ADD(stateDropped, 1);
+            return -1;
         }
-    pthread_mutex_unlock(&m_clients);
+    }
+    if (c->outBytes + b->len > g_outMaxBytes) {
+        fprintf(stderr, "conn %u: file sortante pleine, déconnexion\n", c->id);
+        MET_ADD(slowKills, 1);
+        connKill(c);
+        pthread_mutex_unlock(&c->outLock);
+        return -1;
+    }
+    if (c->outCount == c->outCap) {
+        size_t cap = c->outCap ? c->outCap * 2 : 16;
+        OutSeg *n = malloc(cap * sizeof(OutSeg));
+        if (!n) { pthread_mutex_unlock(&c->outLock); return -1; }
+        for (size_t i = 0; i < c->outCount; i++)
+            n[i] = c->out[(c->outHead + i) % c->outCap];
+        free(c->out);
+        c->out = n; c->outCap = cap; c->outHead = 0;
+    }
+    c->out[(c->outHead + c->outCount++) % c->outCap] = (OutSeg){ b, kind };
+    c->outBytes += b->len;
+    MET_ADD(queued, (int64_t)b->len);
+    __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&c->outLock);
+    return 0;
+}
+
+int connQueue(Conn *c, const void *data, size_t len, int kind)
+{
+    if (!c || __atomic_load_n(&c->closed, __ATOMIC_ACQUIRE)) return -1;
+    OutBuf *b = outNew(data, len);
+    int r = connQueueBuf(c, b, kind);
+    outRelease(b);
+    return r;
 }
 
-int socketFromUsername(const char *u)
+/* écrit tout ce qui peut l’être, en un writev par lot de OUT_IOV ;
+ * le reste attend EPOLLOUT sur le thread I/O propriétaire          */
+void connFlush(Conn *c)
 {
-    pthread_mutex_lock(&m_clients);
-    for (int i = 0; i < g_clientCount; i++)
-        if (strcmp(g_socketUsers[i], u) == 0) {
-            int s = g_clientSockets[i];
-            pthread_mutex_unlock(&m_clients);
-            return s;
+    if (!c) return;
+    pthread_mutex_lock(&c->outLock);
+    while (c->outCount && !c->closed) {
+        struct iovec iov[OUT_IOV];
+        int n = 0;
+        for (; n < OUT_IOV && (size_t)n < c->outCount; n++) {
+            OutBuf *b = c->out[(c->outHead + n) % c->outCap].buf;
+            size_t off = n ? 0 : c->outOff;
+            iov[n].iov_base = b->data + off;
+            iov[n].iov_len  = b->len - off;
         }
-    pthread_mutex_unlock(&m_clients);
-    return -1;
+        ssize_t w = writev(c->fd, iov, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) { setEpollOut(c, 1); break; }
+            connKill(c);
+            break;
+        }
+        c->outBytes -= (size_t)w;
+        MET_ADD(queued, -(int64_t)w);
+        while (w > 0) {
+            OutSeg *sg = &c->out[c->outHead];
+            size_t left = sg->buf->len - c->outOff;
+            if ((size_t)w < left) { c->outOff += w; break; }
+            w -= left;
+            MET_ADD(sentMsgs[sg->buf->type], 1);
+            MET_ADD(sentBytes[sg->buf->type], sg->buf->len);
+            outRelease(sg->buf);
+            c->outHead = (c->outHead + 1) % c->outCap;
+            c->outCount--; c->outOff = 0;
+        }
+    }
+    if (!c->outCount) setEpollOut(c, 0);
+    pthread_mutex_unlock(&c->outLock);
 }
 
-void setSocketUsername(int sock,const char *u)
+/* envoi immédiat (lobby, réponses) : file + flush */
+int connSend(Conn *c, const void *buf, size_t len)
 {
-    pthread_mutex_lock(&m_clients);
-    for (int i = 0; i < g_clientCount; i++)
-        if (g_clientSockets[i]==sock)
-            strncpy(g_socketUsers[i],u,USERNAME_LEN-1);
-    pthread_mutex_unlock(&m_clients);
+    if (connQueue(c, buf, len, MSG_CTRL) < 0) return -1;
+    connFlush(c);
+    return (int)len;
 }
 
 /* =========================================================
- *     Liste publique des joueurs connectés
+ *     Diffusion : encodée une fois, partagée par toutes les files
  * =======================================================*/
+static void broadcastBuf(OutBuf *b)
+{
+    for (int st = 0; st < CONN_STRIPES; st++) {
+        pthread_rwlock_rdlock(&g_connLocks[st]);
+        for (int k = st; k < CONN_BUCKETS; k += CONN_STRIPES)
+            for (Conn *c = g_connById[k]; c; c = c->nextId)
+                if (connQueueBuf(c, b, MSG_CTRL) == 0) connFlush(c);
+        pthread_rwlock_unlock(&g_connLocks[st]);
+    }
+}
+
 void broadcastMessage(const char *msg)
 {
-    pthread_mutex_lock(&m_clients);
-    for (int i=0;i<g_clientCount;i++)
-        write(g_clientSockets[i], msg, strlen(msg));
-    pthread_mutex_unlock(&m_clients);
+    OutBuf *b = outNew(msg, strlen(msg));
+    if (!b) return;
+    broadcastBuf(b);
+    outRelease(b);
+}
+
+/* =========================================================
+ *     Présence dans le lobby  (deltas versionnés)
+ *
+ *  PLAYER_JOIN:<ver>:<nom> / PLAYER_LEAVE:<ver>:<nom> à chaque
+ *  mouvement, PLAYERS:<ver>:<a,b,…> en réponse à LIST. Un client
+ *  applique le delta ver+1, ignore les plus anciens et renvoie LIST
+ *  s’il voit un trou. Les deltas partent sous m_players : chaque file
+ *  les reçoit dans l’ordre des versions.
+ * =======================================================*/
+static void lobbyDelta(const char *kind, const char *name)   /* m_players tenu */
+{
+    char msg[64 + USERNAME_LEN];
+    int  len = snprintf(msg, sizeof(msg), "%s:%llu:%s\n",
+                        kind, (unsigned long long)++g_lobbyVer, name);
+    OutBuf *b = outNew(msg, len);
+    if (!b) return;
+    broadcastBuf(b);
+    outRelease(b);
 }
 
-void broadcastPlayersList(void)
+void lobbyJoin(Conn *c)
 {
-    char buf[BUFFER_SIZE]="";
     pthread_mutex_lock(&m_players);
-    for (int i=0;i<g_numPlayers;i++){
-        strcat(buf,g_connected[i]);
-        if (i<g_numPlayers-1) strcat(buf,",");
+    if (c->lobbyIdx < 0) {
+        if (g_lobbyCount == g_lobbyCap) {
+            int cap = g_lobbyCap ? g_lobbyCap * 2 : 64;
+            Conn **n = realloc(g_lobby, cap * sizeof(Conn*));
+            if (!n) { pthread_mutex_unlock(&m_players); return; }
+            g_lobby = n; g_lobbyCap = cap;
+        }
+        c->lobbyIdx = g_lobbyCount;
+        g_lobby[g_lobbyCount++] = c;
+        lobbyDelta("PLAYER_JOIN", c->user);
     }
     pthread_mutex_unlock(&m_players);
-
-    char msg[BUFFER_SIZE+32];
-    snprintf(msg,sizeof(msg),"UPDATE_LIST:%s\n",buf);
-    broadcastMessage(msg);
 }
 
-void addConnectedPlayer(const char *u)
+void lobbyLeave(Conn *c)
 {
     pthread_mutex_lock(&m_players);
-    strncpy(g_connected[g_numPlayers++],u,USERNAME_LEN-1);
+    int i = c->lobbyIdx;
+    if (i >= 0) {
+        Conn *last = g_lobby[--g_lobbyCount];     /* retrait en O(1) */
+        g_lobby[i] = last;
+        last->lobbyIdx = i;
+        c->lobbyIdx = -1;
+        lobbyDelta("PLAYER_LEAVE", c->user);
+    }
     pthread_mutex_unlock(&m_players);
-    broadcastPlayersList();
 }
-void removeConnectedPlayer(const char *u)
+
+/* photo complète, taille non bornée (LIST / resynchronisation) */
+void lobbySnapshot(Conn *c)
 {
     pthread_mutex_lock(&m_players);
-    for(int i=0;i<g_numPlayers;i++)
-        if(strcmp(g_connected[i],u)==0){
-            for(int j=i;j<g_numPlayers-1;j++)
-                strcpy(g_connected[j],g_connected[j+1]);
-            g_numPlayers--;  break;
-        }
+    size_t cap = 48 + (size_t)g_lobbyCount * USERNAME_LEN;
+    char  *msg = malloc(cap);
+    if (!msg) { pthread_mutex_unlock(&m_players); return; }
+    size_t n = (size_t)snprintf(msg, cap, "PLAYERS:%llu:",
+                                (unsigned long long)g_lobbyVer);
+    for (int i = 0; i < g_lobbyCount; i++)
+        n += (size_t)snprintf(msg + n, cap - n, "%s%s",
+                              i ? "," : "", g_lobby[i]->user);
+    msg[n++] = '\n';
+    /* sous le verrou : aucun delta ne peut passer devant la photo */
+    connSend(c, msg, n);
     pthread_mutex_unlock(&m_players);
-    broadcastPlayersList();
+    free(msg);
 }
 
 /* =========================================================
  *                    Invitations DUEL
  * =======================================================*/
+/* Index par inviteur (une invitation en cours chacun) et par invité
+ * (plusieurs possibles), chaînés par handles ; roue de INVITE_WHEEL
+ * cases d’une seconde pour l’expiration. Tout est sous m_invites.   */
+static int g_invByInviter[INVITE_BUCKETS], g_invByInvitee[INVITE_BUCKETS];
+static int g_invWheel[INVITE_WHEEL];
+static int g_invWheelPos;                    /* case de la seconde courante */
+
+void inviteIndexInit(void)
+{
+    for (int i = 0; i < INVITE_BUCKETS; i++) g_invByInviter[i] = g_invByInvitee[i] = -1;
+    for (int i = 0; i < INVITE_WHEEL; i++) g_invWheel[i] = -1;
+}
+
+#define INV_BUCKET(name)  (hashName(name) & (INVITE_BUCKETS-1))
+
+/* invitation en cours émise par inv, -1 sinon */
 int findInviteSlot(const char *inv)
 {
-    for(int i=0;i<MAX_INVITES;i++)
-        if(g_invites[i].active && strcmp(g_invites[i].inviter,inv)==0)
-            return i;
+    for(int h=g_invByInviter[INV_BUCKET(inv)];h>=0;h=inviteAt(h)->nextByInviter)
+        if(strcmp(inviteAt(h)->inviter,inv)==0) return h;
     return -1;
 }
 
-void createInvitation(const char *inviter,const char *targetsCsv)
+/* retire h d’une chaîne simple ; off = champ « suivant » */
+static void inviteUnchain(int *head,int h,size_t off)
+{
+    for(int *pp=head;*pp>=0;pp=(int*)((char*)inviteAt(*pp)+off))
+        if(*pp==h){ *pp=*(int*)((char*)inviteAt(h)+off); return; }
+}
+
+/* retire l’invitation de tous les index et libère son handle */
+static void inviteRemove(int h)
+{
+    Invitation *in=inviteAt(h);
+    inviteUnchain(&g_invByInviter[INV_BUCKET(in->inviter)],h,
+                  offsetof(Invitation,nextByInviter));
+    inviteUnchain(&g_invByInvitee[INV_BUCKET(in->invitee)],h,
+                  offsetof(Invitation,nextByInvitee));
+    if(in->wheelPrev>=0) inviteAt(in->wheelPrev)->wheelNext=in->wheelNext;
+    else                 g_invWheel[in->wheelSlot]=in->wheelNext;
+    if(in->wheelNext>=0) inviteAt(in->wheelNext)->wheelPrev=in->wheelPrev;
+    in->active=0;
+    slabFree(&g_inviteSlab,h);
+}
+
+/* envoi ciblé : seulement aux deux intéressés */
+static void inviteNotify(const char *to,const char *msg,size_t len)
 {
+    Conn *c=connByName(to);
+    connSend(c,msg,len);
+    connRelease(c);
+}
+
+/* en partie ou en file d’arène : ni INVITE, ni ACCEPT, ni ARENA.
+ * Fiable sous m_arena, qui sérialise tous les départs de match.    */
+static int connBusy(Conn *c)
+{
+    return c && (__atomic_load_n(&c->game,__ATOMIC_ACQUIRE)>=0 ||
+                 __atomic_load_n(&c->arena,__ATOMIC_RELAXED));
+}
+
+void createInvitation(const char *inviter,const char *targetsCsv,int stride)
+{
+    char invitee[USERNAME_LEN];
+    const char *comma=strchr(targetsCsv,',');
+    size_t len=comma? (size_t)(comma-targetsCsv):strlen(targetsCsv);
+    if(len>=USERNAME_LEN) len=USERNAME_LEN-1;
+    memcpy(invitee,targetsCsv,len);
+    invitee[len]='\0';
+    if(!invitee[0] || strcmp(invitee,inviter)==0) return;
+
     pthread_mutex_lock(&m_invites);
-    int slot=-1;
-    for(int i=0;i<MAX_INVITES;i++)
-        if(!g_invites[i].active){slot=i;break;}
+    int old=findInviteSlot(inviter);          /* une seule en cours */
+    if(old>=0) inviteRemove(old);
+    int slot=slabAlloc(&g_inviteSlab);
     if(slot<0){pthread_mutex_unlock(&m_invites);return;}
 
-    Invitation *in=&g_invites[slot];
+    Invitation *in=inviteAt(slot);
     memset(in,0,sizeof(*in));
     in->active=1;
+    in->stride=stride;
     strncpy(in->inviter,inviter,USERNAME_LEN-1);
+    strcpy(in->invitee,invitee);
 
-    const char *comma=strchr(targetsCsv,',');
-    size_t len=comma? (size_t)(comma-targetsCsv):strlen(targetsCsv);
-    if(len>=USERNAME_LEN) len=USERNAME_LEN-1;
-    strncpy(in->invitee,targetsCsv,len);
-    in->invitee[len]='\0';
+    uint32_t b=INV_BUCKET(in->inviter);
+    in->nextByInviter=g_invByInviter[b]; g_invByInviter[b]=slot;
+    b=INV_BUCKET(in->invitee);
+    in->nextByInvitee=g_invByInvitee[b]; g_invByInvitee[b]=slot;
 
+    int w=(g_invWheelPos+INVITE_TTL_S)%INVITE_WHEEL;
+    in->wheelSlot=w; in->wheelPrev=-1; in->wheelNext=g_invWheel[w];
+    if(in->wheelNext>=0) inviteAt(in->wheelNext)->wheelPrev=slot;
+    g_invWheel[w]=slot;
+
+    char m[16+2*USERNAME_LEN];
+    int ml=snprintf(m,sizeof(m),"INVITE_REQUEST:%s:%s\n",inviter,invitee);
+    inviteNotify(invitee,m,ml);
     pthread_mutex_unlock(&m_invites);
 }
 
@@ -294,432 +973,1345 @@ void handleInviteAnswer(const char *inviter,const char *invitee,int accept)
     int idx=findInviteSlot(inviter);
     if(idx<0){pthread_mutex_unlock(&m_invites);return;}
 
-    Invitation *in=&g_invites[idx];
+    Invitation *in=inviteAt(idx);
     if(strcmp(in->invitee,invitee)!=0){pthread_mutex_unlock(&m_invites);return;}
 
-    in->response=accept?1:-1;
+    Conn *c1=connByName(inviter);
+    Conn *c2=connByName(invitee);
+    /* m_arena : une arène ne peut pas partir avec l’un d’eux entre le
+     * test et startMatch. L’inviteur a pu rejoindre une file depuis
+     * son INVITE : le duel l’en retire ; l’invité, lui, doit être libre. */
+    pthread_mutex_lock(&m_arena);
+    int busy=accept && ((c1 && __atomic_load_n(&c1->game,__ATOMIC_ACQUIRE)>=0) ||
+                        connBusy(c2));
+    in->response=accept&&!busy?1:-1;
 
     char res[BUFFER_SIZE];
     snprintf(res,sizeof(res),"INVITE_RESULT:%s:%s\n",
-             inviter, accept?"ACCEPTED":"REJECTED");
-    int s1=socketFromUsername(inviter);
-    int s2=socketFromUsername(invitee);
-    if(s1!=-1) write(s1,res,strlen(res));
-    if(s2!=-1) write(s2,res,strlen(res));
+             inviter, busy?"BUSY":accept?"ACCEPTED":"REJECTED");
+    connSend(c1,res,strlen(res));
+    connSend(c2,res,strlen(res));
 
-    if(accept) startGame(in);
+    if(accept&&!busy){
+        if(c1) arenaRemove(c1);
+        startGame(in);
+    }
+    pthread_mutex_unlock(&m_arena);
+    connRelease(c1); connRelease(c2);
 
-    in->active=0;
+    inviteRemove(idx);
+    pthread_mutex_unlock(&m_invites);
+}
+
+/* déconnexion / logout : ses invitations, envoyées ou reçues, tombent */
+void dropInvitesOf(const char *u)
+{
+    pthread_mutex_lock(&m_invites);
+    int h=findInviteSlot(u);
+    if(h>=0) inviteRemove(h);
+    for(h=g_invByInvitee[INV_BUCKET(u)];h>=0;){
+        Invitation *in=inviteAt(h);
+        int next=in->nextByInvitee;
+        if(strcmp(in->invitee,u)==0) inviteRemove(h);
+        h=next;
+    }
     pthread_mutex_unlock(&m_invites);
 }
 
+/* avance la roue d’une case par seconde ; ce qui s’y trouve a expiré */
+void *inviteReaper(void *arg)
+{
+    (void)arg;
+    struct timespec dl;
+    clock_gettime(CLOCK_MONOTONIC,&dl);
+    while(1){
+        dl.tv_sec++;
+        while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&dl,NULL)==EINTR);
+
+        pthread_mutex_lock(&m_invites);
+        g_invWheelPos=(g_invWheelPos+1)%INVITE_WHEEL;
+        int h;
+        while((h=g_invWheel[g_invWheelPos])>=0){
+            Invitation *in=inviteAt(h);
+            char m[32+USERNAME_LEN];
+            int ml=snprintf(m,sizeof(m),"INVITE_RESULT:%s:EXPIRED\n",in->inviter);
+            inviteNotify(in->inviter,m,ml);
+            inviteNotify(in->invitee,m,ml);
+            inviteRemove(h);
+        }
+        pthread_mutex_unlock(&m_invites);
+    }
+    return NULL;
+}
+
 /* =========================================================
  *                    Création d’un match
  * =======================================================*/
+/* une fois par Game, à la création de sa tranche : le mutex survit
+ * aux réutilisations du handle                                      */
+static void gameCtor(void *p)
+{
+    Game *gm=p;
+    pthread_mutex_init(&gm->lock, NULL);
+    gm->in.head=gm->in.tail=0;
+    for(uint32_t i=0;i<INPUT_RING;i++) gm->in.cell[i].seq=i;
+}
+
+/* MATCH_SLOTS:a,b,… : nom de chaque slot des trames binaires */
+static int matchSlots(const Game *gm,char *out,size_t cap)
+{
+    int len=snprintf(out,cap,"MATCH_SLOTS:");
+    for(int i=0;i<gm->nPlayers;i++)
+        len+=snprintf(out+len,cap-len,"%s%s",i?",":"",gm->players[i]);
+    len+=snprintf(out+len,cap-len,"\n");
+    return len;
+}
+
 void startGame(Invitation *in)
 {
-    pthread_mutex_lock(&m_games);
-    int slot=-1;
-    for(int i=0;i<MAX_GAMES;i++)
-        if(!g_games[i].active){slot=i;break;}
-    if(slot<0){pthread_mutex_unlock(&m_games);return;}
+    const char *duo[2]={ in->inviter,in->invitee };
+    startMatch(duo,2,in->stride);
+}
 
-    Game *gm=&g_games[slot];
-    memset(gm,0,sizeof(*gm));
-    gm->active=1;
-    gm->nextProjId=1;
-    pthread_mutex_init(&gm->lock,NULL);
+/* n joueurs : duel (2) ou arène ; ordre des noms = slots ;
+ * un pas de simulation tous les stride ticks (1 : 60 Hz)       */
+void startMatch(const char *const *names,int n,int stride)
+{
+    int slot=slabAlloc(&g_gameSlab);
+    if(slot<0){
+        fprintf(stderr,"startMatch: DOGFIGHT_MAX_GAMES atteint\n");
+        return;
+    }
 
-    strcpy(gm->players[0],in->inviter);
-    strcpy(gm->players[1],in->invitee);
+    Game *gm=gameAt(slot);
+    pthread_mutex_lock(&gm->lock);
+    /* dépôts restés de la partie précédente sur ce handle : jetés */
+    GameInput old;
+    while(inputPop(&gm->in,&old));
+    /* remise à zéro de tout sauf mutex et file (gameCtor) */
+    memset((char*)gm+offsetof(Game,active),0,
+           sizeof(*gm)-offsetof(Game,active));
+    gm->active=1;
+    gm->handle=slot;
+    simInit(&gm->sim,n,stride);
+    gm->nPlayers=n=gm->sim.nPlayers;
+    gm->stride=gm->sim.stride;
+    gm->tick=currentTick();             /* pas de rattrapage depuis g_tick0 */
+    for(int i=0;i<n;i++){               /* 1er état tout de suite, à 60 Hz */
+        gm->dirty[i]=1;
+        gm->rateDiv[i]=1;
+        gm->sentTick[i]=gm->tick-RATE_DIV_MAX;
+    }
 
-    gm->hp[0]=gm->hp[1]=MAX_HEALTH;
-    gm->posX[0]= PLANE_SIZE;
-    gm->posY[0]= BOARD_HEIGHT/2.0f;
-    gm->posX[1]= BOARD_WIDTH-PLANE_SIZE;
-    gm->posY[1]= BOARD_HEIGHT/2.0f;
+    for(int i=0;i<n;i++)
+        snprintf(gm->players[i],USERNAME_LEN,"%s",names[i]);
+    gm->rec=recStart((uint32_t)gm->tick,gm->stride,n,gm->players);
+    gm->recDirty=1;
+    gm->recTick=gm->tick-(uint64_t)g_specDiv;
+
+    /* handles mis en cache : plus de recherche par nom pendant le match */
+    for(int i=0;i<n;i++){
+        gm->conn[i]=connByName(gm->players[i]);
+        if(gm->conn[i]){
+            gm->conn[i]->slot=i;
+            __atomic_store_n(&gm->conn[i]->game,slot,__ATOMIC_RELEASE);
+            spectateLeave(gm->conn[i]);   /* autre partie : jamais gm */
+            replayCancel(gm->conn[i]);    /* après c->game : cf. replayStart */
+        }
+    }
 
-    /* --- enregistrement BDD --- */
-    gm->db_id = db_createGame(gm->players[0],gm->players[1]);
+    /* --- enregistrement BDD (asynchrone) : le schéma game est un duel --- */
+    if(n==2) gm->matchKey = persistGameStart(gm->players[0],gm->players[1]);
+
+    /* --- table des slots : clients binaires, et tous en arène --- */
+    char slots[SIM_MAX_PLAYERS*USERNAME_LEN+32];
+    int  slen=matchSlots(gm,slots,sizeof(slots));
+    for(int i=0;i<n;i++){
+        Conn *c=gm->conn[i];
+        if(!c) continue;
+        if(c->bin && (gm->hist[i]=calloc(SNAP_HISTORY,sizeof(Snapshot))))
+            gm->bin[i]=c->bin;
+        if(gm->bin[i] || n>2) connSend(c,slots,slen);
+        if(gm->rec){
+            char m[40];
+            connSend(c,m,snprintf(m,sizeof(m),"RECORD:%llu\n",
+                                  (unsigned long long)recId(gm->rec)));
+        }
+    }
 
     sendState(gm);
-    pthread_mutex_unlock(&m_games);
+    for(int i=0;i<n;i++) connFlush(gm->conn[i]);
+
+    /* --- confié au shard le moins chargé --- */
+    int best=0;
+    for(int i=1;i<g_shardCount;i++)
+        if(g_shards[i].count<g_shards[best].count) best=i;
+    PhysShard *sh=&g_shards[best];
+    gm->shard=best;
+    pthread_mutex_lock(&sh->lock);
+    if(sh->count==sh->cap){
+        int cap=sh->cap?sh->cap*2:64;
+        int *n=realloc(sh->games,cap*sizeof(int));
+        if(n){ sh->games=n; sh->cap=cap; }
+    }
+    if(sh->count<sh->cap){
+        gm->shardPos=sh->count;
+        sh->games[sh->count++]=slot;
+    }
+    pthread_mutex_unlock(&sh->lock);
+
+    pthread_mutex_unlock(&gm->lock);
+}
+
+/* ---------------------------------------------------------
+ *  Arènes : une file par taille (ARENA:<n>), la partie part dès
+ *  qu’elle est pleine. Sous m_arena ; c->arena = file attendue.
+ * -------------------------------------------------------*/
+typedef struct {
+    int  n;
+    char names[SIM_MAX_PLAYERS][USERNAME_LEN];
+} ArenaQueue;
+
+static ArenaQueue      g_arenaQ[SIM_MAX_PLAYERS+1];
+
+/* ARENA_WAIT:<taille>:<inscrits> à toute la file (m_arena tenu) */
+static void arenaNotify(int size)
+{
+    const ArenaQueue *q=&g_arenaQ[size];
+    char m[64];
+    int  ml=snprintf(m,sizeof(m),"ARENA_WAIT:%d:%d\n",size,q->n);
+    for(int i=0;i<q->n;i++){
+        Conn *c=connByName(q->names[i]);
+        connSend(c,m,ml);
+        connRelease(c);
+    }
+}
+
+/* retrait de sa file (m_arena tenu) */
+static void arenaRemove(Conn *c)
+{
+    int size=c->arena;
+    if(!size) return;
+    ArenaQueue *q=&g_arenaQ[size];
+    for(int i=0;i<q->n;i++)
+        if(strcmp(q->names[i],c->user)==0){
+            memmove(q->names[i],q->names[i+1],(size_t)(q->n-i-1)*USERNAME_LEN);
+            q->n--;
+            break;
+        }
+    c->arena=0;
+    arenaNotify(size);
+}
+
+void arenaJoin(Conn *c,int size)
+{
+    pthread_mutex_lock(&m_arena);
+    if(size<ARENA_MIN || size>SIM_MAX_PLAYERS || connBusy(c))
+        connSend(c,"ARENA_FAIL\n",11);   /* déjà en file : ARENA_LEAVE d’abord */
+    else{
+        ArenaQueue *q=&g_arenaQ[size];
+        snprintf(q->names[q->n++],USERNAME_LEN,"%s",c->user);
+        c->arena=size;
+        if(q->n<size) arenaNotify(size);
+        else{
+            /* pleine : la partie part, la file repart de zéro */
+            const char *names[SIM_MAX_PLAYERS];
+            for(int i=0;i<size;i++){
+                names[i]=q->names[i];
+                Conn *p=connByName(q->names[i]);
+                if(p) p->arena=0;
+                connRelease(p);
+            }
+            startMatch(names,size,g_matchStride);
+            q->n=0;
+        }
+    }
+    pthread_mutex_unlock(&m_arena);
+}
+
+void arenaLeave(Conn *c)
+{
+    pthread_mutex_lock(&m_arena);
+    arenaRemove(c);
+    pthread_mutex_unlock(&m_arena);
 }
 
 /* =========================================================
  *                  Utilitaires  « jeu »
  * =======================================================*/
-int findGameByPlayer(const char *u)
+/* dépôt sans verrou (threads I/O) ; 0 si la file est pleine */
+static int inputPush(InputRing *r,const GameInput *v)
 {
-    for(int i=0;i<MAX_GAMES;i++)
-        if(g_games[i].active &&
-           (strcmp(g_games[i].players[0],u)==0 ||
-            strcmp(g_games[i].players[1],u)==0))
-            return i;
-    return -1;
+    uint32_t pos=__atomic_load_n(&r->tail,__ATOMIC_RELAXED);
+    for(;;){
+        InputCell *cl=&r->cell[pos&(INPUT_RING-1)];
+        int32_t d=(int32_t)(__atomic_load_n(&cl->seq,__ATOMIC_ACQUIRE)-pos);
+        if(d<0) return 0;                       /* un tour d’avance : pleine */
+        if(d>0){ pos=__atomic_load_n(&r->tail,__ATOMIC_RELAXED); continue; }
+        if(__atomic_compare_exchange_n(&r->tail,&pos,pos+1,1,
+                                       __ATOMIC_RELAXED,__ATOMIC_RELAXED)){
+            cl->in=*v;
+            __atomic_store_n(&cl->seq,pos+1,__ATOMIC_RELEASE);
+            return 1;
+        }                                       /* CAS raté : pos rechargé */
+    }
 }
 
-void fireFromPlayer(int sock,const char *u,float x,float y,float dx,float dy)
+/* retrait (consommateur unique, gm->lock tenu) ; 0 si vide ou si le
+ * dépôt suivant n’est pas encore publié (repris au tick d’après)   */
+static int inputPop(InputRing *r,GameInput *out)
 {
-    int gid=findGameByPlayer(u);
+    InputCell *cl=&r->cell[r->head&(INPUT_RING-1)];
+    if(__atomic_load_n(&cl->seq,__ATOMIC_ACQUIRE)!=r->head+1) return 0;
+    *out=cl->in;
+    __atomic_store_n(&cl->seq,r->head+INPUT_RING,__ATOMIC_RELEASE);
+    r->head++;
+    return 1;
+}
+
+/* entrée d’un joueur vers sa partie (threads I/O) : ni verrou ni
+ * vérification ici, le slot est résolu au drain                  */
+static void gamePost(Conn *c,GameInput in)
+{
+    int gid=__atomic_load_n(&c->game,__ATOMIC_ACQUIRE);
     if(gid<0) return;
-    Game *gm=&g_games[gid];
+    in.connId=c->id;
+    in.slot=(uint8_t)c->slot;
+    if(!inputPush(&gameAt(gid)->in,&in)) MET_ADD(inputDropped,1);
+}
 
-    pthread_mutex_lock(&gm->lock);
+/* l’état visible a changé : à renvoyer aux joueurs et spectateurs,
+ * et à journaliser                                                */
+static void gameDirty(Game *gm)
+{
+    memset(gm->dirty,1,(size_t)gm->nPlayers);
+    gm->specDirty=1;
+    gm->recDirty=1;
+}
+
+/* RTT mesuré sur un ACK binaire (mise en file → réception), lissé 1/8 */
+static void rttSample(Game *gm,int i,uint64_t ns)
+{
+    uint32_t us=ns/1000>UINT32_MAX?UINT32_MAX:(uint32_t)(ns/1000);
+    gm->rttUs[i]=gm->rttUs[i]?gm->rttUs[i]-gm->rttUs[i]/8+us/8:us;
+}
+
+/* file vidée au début du tick : MOVE réduits au dernier de chaque
+ * joueur, FIRE appliqués dans l’ordre d’arrivée                    */
+static void gameDrain(Game *gm)
+{
+    GameInput in;
+    uint8_t moved[SIM_MAX_PLAYERS]={0};
+    float   mx[SIM_MAX_PLAYERS],my[SIM_MAX_PLAYERS];
+    SimEvents ev; ev.n=0;
+    while(inputPop(&gm->in,&in)){
+        int s=in.slot;                  /* dépôt tardif d’un autre match ? */
+        if(s>=gm->nPlayers || !gm->conn[s] || gm->conn[s]->id!=in.connId)
+            continue;
+        switch(in.kind){
+        case IN_MOVE:
+            moved[s]=1; mx[s]=in.x; my[s]=in.y;
+            break;
+        case IN_FIRE:
+            recInput(gm->rec,(uint32_t)gm->tick,(uint32_t)gm->sim.steps,1,s,
+                     in.x,in.y,in.dx,in.dy);
+            simInput(&gm->sim,&(SimInput){ SIN_FIRE,(uint8_t)s,
+                                           in.x,in.y,in.dx,in.dy },&ev);
+            break;
+        case IN_ACK:
+            if(in.ack<=gm->snapSeq[s] && in.ack>gm->ackSeq[s]){
+                gm->ackSeq[s]=in.ack;
+                const Snapshot *h=&gm->hist[s][in.ack & (SNAP_HISTORY-1)];
+                if(h->seq==in.ack && in.ns>h->sentNs)
+                    rttSample(gm,s,in.ns-h->sentNs);
+            }
+            break;
+        }
+    }
+    for(int i=0;i<gm->nPlayers;i++){
+        if(!moved[i] || (mx[i]==gm->sim.posX[i] && my[i]==gm->sim.posY[i]))
+            continue;
+        recInput(gm->rec,(uint32_t)gm->tick,(uint32_t)gm->sim.steps,0,i,
+                 mx[i],my[i],0,0);
+        simInput(&gm->sim,&(SimInput){ SIN_MOVE,(uint8_t)i,
+                                       mx[i],my[i],0,0 },NULL);
+        gameDirty(gm);
+    }
+    if(ev.n) gameDirty(gm);
+    gameEvents(gm,&ev);                 /* FIRE_ACK des tirs acceptés */
+}
+
+/* ---------------------------------------------------------
+ *  Trame binaire  (little-endian, délta vs dernier ACK) :
+ *    u8 0xFF | u16 len | 'S' | u32 seq | u32 base
+ *    BIN2 seulement : u32 tick | u32 ms   (interpolation côté client)
+ *    pmask      → (nPlayers+7)/8 octets (1 en duel) ; pour chaque
+ *                 slot i présent : i16 x, i16 y, u8 hp
+ *    u16 nRem   → u16 id                 (projectiles disparus)
+ *    u16 nUpd   → u16 id, i16 x, i16 y   (nouveaux ou déplacés)
+ *  base = 0  ⇒ photo complète.
+ * -------------------------------------------------------*/
+static uint8_t *put16(uint8_t *p,uint16_t v){ p[0]=v; p[1]=v>>8; return p+2; }
+static uint8_t *put32(uint8_t *p,uint32_t v){
+    p[0]=v; p[1]=v>>8; p[2]=v>>16; p[3]=v>>24; return p+4;
+}
+
+static void takeSnapshot(const Game *gm,Snapshot *s)
+{
+    const SimState *st=&gm->sim;
+    for(int i=0;i<gm->nPlayers;i++){
+        s->x[i]=(int16_t)lrintf(st->posX[i]);
+        s->y[i]=(int16_t)lrintf(st->posY[i]);
+        s->hp[i]=(uint8_t)st->hp[i];
+    }
+    const ProjSoA *pr=&st->proj;
+    for(int i=0;i<pr->count;i++){
+        s->projId[i]=pr->id[i];
+        s->projX[i]=(int16_t)lrintf(pr->x[i]);
+        s->projY[i]=(int16_t)lrintf(pr->y[i]);
+    }
+    s->nProj=(uint16_t)pr->count;
+}
 
-    int cnt=0;
-    for(int k=0;k<gm->projCount;k++)
-        if(gm->proj[k].active && strcmp(gm->proj[k].owner,u)==0) cnt++;
+static size_t encodeSnapshot(const Snapshot *cur,const Snapshot *base,int n,
+                             const uint32_t *hint,uint8_t *out)
+{
+    uint8_t *p=out+3;
+    *p++='S';
+    p=put32(p,cur->seq);
+    p=put32(p,base?base->seq:0);
+    if(hint){ p=put32(p,hint[0]); p=put32(p,hint[1]); }
+
+    uint8_t *mask=p; p+=(n+7)/8;
+    memset(mask,0,(size_t)(n+7)/8);
+    for(int i=0;i<n;i++){
+        if(base && base->x[i]==cur->x[i] && base->y[i]==cur->y[i]
+                && base->hp[i]==cur->hp[i]) continue;
+        mask[i>>3]|=1u<<(i&7);
+        p=put16(p,(uint16_t)cur->x[i]);
+        p=put16(p,(uint16_t)cur->y[i]);
+        *p++=cur->hp[i];
+    }
 
-    if(cnt>=MAX_ACTIVE_MISSILES || gm->projCount>=MAX_PROJECTILES){
-        pthread_mutex_unlock(&gm->lock); return;
+    /* les deux listes sont triées par id → fusion linéaire */
+    uint8_t *nRem=p; p+=2; uint16_t rem=0;
+    if(base){
+        int j=0;
+        for(int i=0;i<base->nProj;i++){
+            while(j<cur->nProj && cur->projId[j]<base->projId[i]) j++;
+            if(j<cur->nProj && cur->projId[j]==base->projId[i]) continue;
+            p=put16(p,(uint16_t)base->projId[i]); rem++;
+        }
     }
+    put16(nRem,rem);
+
+    uint8_t *nUpd=p; p+=2; uint16_t upd=0;
+    int j=0;
+    for(int i=0;i<cur->nProj;i++){
+        if(base){
+            while(j<base->nProj && base->projId[j]<cur->projId[i]) j++;
+            if(j<base->nProj && base->projId[j]==cur->projId[i]
+               && base->projX[j]==cur->projX[i]
+               && base->projY[j]==cur->projY[i]) continue;
+        }
+        p=put16(p,(uint16_t)cur->projId[i]);
+        p=put16(p,(uint16_t)cur->projX[i]);
+        p=put16(p,(uint16_t)cur->projY[i]);
+        upd++;
+    }
+    put16(nUpd,upd);
 
-    Projectile *pr=&gm->proj[gm->projCount++];
-    pr->active=1;
-    pr->id    =gm->nextProjId++;
-    pr->x=x; pr->y=y; pr->dx=dx; pr->dy=dy;
-    strncpy(pr->owner,u,USERNAME_LEN-1);
+    size_t len=p-out;
+    out[0]=SNAP_MAGIC;
+    put16(out+1,(uint16_t)(len-3));
+    return len;
+}
 
-    char ack[128];
-    snprintf(ack,sizeof(ack),"FIRE_ACK:%d:%s:%.0f:%.0f:%.0f:%.0f\n",
-             pr->id,pr->owner,pr->x,pr->y,pr->dx,pr->dy);
-    for(int i=0;i<2;i++){
-        int d=socketFromUsername(gm->players[i]);
-        if(d!=-1) write(d,ack,strlen(ack));
+static void sendSnapshot(Game *gm,int i,const uint32_t hint[2],uint64_t now,
+                         UdpBatch *u)
+{
+    Snapshot *cur=&gm->hist[i][++gm->snapSeq[i] & (SNAP_HISTORY-1)];
+    takeSnapshot(gm,cur);
+    cur->seq=gm->snapSeq[i];
+    cur->sentNs=now;
+
+    /* base = dernier snapshot acquitté, s’il est encore dans l’historique */
+    uint32_t ack=__atomic_load_n(&gm->ackSeq[i],__ATOMIC_ACQUIRE);
+    const Snapshot *base=NULL;
+    if(ack && cur->seq-ack<SNAP_HISTORY){
+        const Snapshot *h=&gm->hist[i][ack & (SNAP_HISTORY-1)];
+        if(h->seq==ack) base=h;
     }
-    pthread_mutex_unlock(&gm->lock);
+
+    uint8_t out[SNAP_MAX_BYTES];
+    size_t len=encodeSnapshot(cur,base,gm->nPlayers,gm->bin[i]>=2?hint:NULL,out);
+    OutBuf *b=outNew(out,len);
+    if(!udpQueue(u,gm->conn[i],b)) connQueueBuf(gm->conn[i],b,MSG_STATE);
+    outRelease(b);
+}
+
+/* ACK:<seq> reçu d’un client binaire (thread I/O) */
+static void ackSnapshot(Conn *c,uint32_t seq)
+{
+    gamePost(c,(GameInput){ .kind=IN_ACK, .ack=seq, .ns=metNow() });
 }
 
+/* cadence du joueur i, revue à chaque envoi (AIMD sur l’écart entre
+ * envois) : doublé dès que sa file sortante ou son RTT grossit,
+ * réduit d’un cran après RATE_PROBE envois sans alerte             */
+static void rateAdapt(Game *gm,int i,Conn *c)
+{
+    size_t queued=__atomic_load_n(&c->outBytes,__ATOMIC_RELAXED);
+    if(queued>RATE_QUEUE_HIGH || gm->rttUs[i]>RATE_RTT_HIGH_US){
+        gm->rateDiv[i]=gm->rateDiv[i]*2<RATE_DIV_MAX?gm->rateDiv[i]*2:RATE_DIV_MAX;
+        gm->rateOk[i]=0;
+    }else if(gm->rateDiv[i]>1 && ++gm->rateOk[i]>=RATE_PROBE){
+        gm->rateDiv[i]--;
+        gm->rateOk[i]=0;
+    }
+}
+
+/* TICK:tick:ms puis STATE:proj|hp|pos, un seul segment (les anciens
+ * clients ignorent la ligne TICK) ; encodé une fois par envoi, la même
+ * copie part à tous les clients texte, joueurs et spectateurs          */
+static OutBuf *stateText(const Game *gm,const uint32_t hint[2])
+{
+    char msg[STATE_MAX_BYTES];
+    char *p=msg, *end=msg+sizeof(msg);
+    p+=snprintf(p,end-p,"TICK:%u:%u\nSTATE:",hint[0],hint[1]);
+    const SimState *st=&gm->sim;
+    const ProjSoA *pr=&st->proj;
+    for(int k=0;k<pr->count && end-p>32;k++)
+        p+=snprintf(p,end-p,"%s%u:%.0f:%.0f",
+                    k?",":"",pr->id[k],pr->x[k],pr->y[k]);
+    for(int k=0;k<gm->nPlayers && end-p>USERNAME_LEN+16;k++)
+        p+=snprintf(p,end-p,"%c%s:%d",k?',':'|',gm->players[k],st->hp[k]);
+    for(int k=0;k<gm->nPlayers && end-p>USERNAME_LEN+96;k++)
+        p+=snprintf(p,end-p,"%c%s:%.0f:%.0f",k?',':'|',
+                    gm->players[k],st->posX[k],st->posY[k]);
+    if(end-p>1) *p++='\n';
+    return outNew(msg,(size_t)(p-msg));
+}
+
+/* trame binaire complète (base 0) pour les spectateurs : pas d’ACK,
+ * donc pas de delta, mais une seule trame par version de protocole */
+static OutBuf *stateFrame(const Game *gm,int v,const uint32_t hint[2])
+{
+    Snapshot s;
+    takeSnapshot(gm,&s);
+    s.seq=gm->specSeq;
+    uint8_t out[SNAP_MAX_BYTES];
+    return outNew(out,encodeSnapshot(&s,NULL,gm->nPlayers,v>=2?hint:NULL,out));
+}
+
+static void spectateState(Game*,const uint32_t[2],OutBuf*,UdpBatch*);
+
+/* photo complète au journal si l’état a changé, à la cadence des
+ * spectateurs (entrées et événements, eux, sont tous journalisés) ;
+ * l’heure (0 ici) est fixée à la diffusion                         */
+static void recState(Game *gm)
+{
+    if(gm->tick-gm->recTick<(uint64_t)g_specDiv) return;
+    gm->recTick=gm->tick;
+    Snapshot s;
+    takeSnapshot(gm,&s);
+    s.seq=++gm->recSeq;
+    uint32_t hint[2]={ (uint32_t)gm->tick,0 };
+    uint8_t out[SNAP_MAX_BYTES];
+    size_t len=encodeSnapshot(&s,NULL,gm->nPlayers,hint,out);
+    recAppend(gm->rec,REC_STATE,(uint32_t)gm->tick,out,len);
+    gm->recDirty=0;
+}
+
+/* client lié en UDP sans état neuf : le dernier datagramme a pu se
+ * perdre. Renvoi tous les RATE_DIV_MAX ticks tant qu’une trame
+ * binaire n’est pas acquittée ; en texte (pas d’ACK), toujours      */
+static int udpRefresh(const Game *gm,int i,Conn *c)
+{
+    if(!__atomic_load_n(&c->udpPeer,__ATOMIC_ACQUIRE)) return 0;
+    if(gm->tick-gm->sentTick[i]<(uint64_t)RATE_DIV_MAX) return 0;
+    return !gm->bin[i] || __atomic_load_n(&gm->ackSeq[i],__ATOMIC_ACQUIRE)!=gm->snapSeq[i];
+}
+
+/* état aux joueurs qui en ont besoin ce tick-ci (dirty + cadence) ;
+ * chaque envoi porte le tick simulé et l’heure serveur en ms        */
 void sendState(Game *gm)
 {
-    char proj[BUFFER_SIZE]="",hp[BUFFER_SIZE]="",pos[BUFFER_SIZE]="";
-    int first=1;
-    for(int i=0;i<gm->projCount;i++){
-        Projectile *p=&gm->proj[i];
-        if(!p->active) continue;
-        if(!first) strcat(proj,",");
-        char tmp[64];
-        snprintf(tmp,sizeof(tmp),"%d:%.0f:%.0f",p->id,p->x,p->y);
-        strcat(proj,tmp); first=0;
+    OutBuf *txt=NULL;                 /* format texte construit au besoin */
+    UdpBatch udp; udp.n=0;            /* clients liés en UDP : un sendmmsg */
+    uint64_t now=metNow();
+    uint32_t hint[2]={ (uint32_t)gm->tick,(uint32_t)(now/1000000) };
+
+    for(int i=0;i<gm->nPlayers;i++){
+        Conn *c=gm->conn[i];
+        if(!c || c->closed) continue;
+        if(!gm->dirty[i]){
+            if(!udpRefresh(gm,i,c)){ MET_ADD(stateIdle,1); continue; }
+            MET_ADD(udpRefresh,1);
+        }
+        if(gm->tick-gm->sentTick[i]<(uint64_t)gm->rateDiv[i]){
+            MET_ADD(stateThrottled,1);
+            continue;
+        }
+        gm->dirty[i]=0;
+        gm->sentTick[i]=gm->tick;
+        rateAdapt(gm,i,c);
+        if(gm->bin[i]){ sendSnapshot(gm,i,hint,now,&udp); continue; }
+        if(!txt) txt=stateText(gm,hint);
+        if(!udpQueue(&udp,c,txt)) connQueueBuf(c,txt,MSG_STATE);
     }
-    for(int i=0;i<2;i++){
-        if(i){strcat(hp,",");strcat(pos,",");}
-        char tmp[64];
-        snprintf(tmp,sizeof(tmp),"%s:%d",gm->players[i],gm->hp[i]); strcat(hp,tmp);
-        snprintf(tmp,sizeof(tmp),"%s:%.0f:%.0f",
-                 gm->players[i],gm->posX[i],gm->posY[i]); strcat(pos,tmp);
+    spectateState(gm,hint,txt,&udp);
+    if(txt) outRelease(txt);
+    if(udp.n) udpFlush(&udp);
+}
+
+void endGame(Game *gm)
+{
+    for(int i=0;i<gm->nPlayers;i++){
+        free(gm->hist[i]); gm->hist[i]=NULL;
+        Conn *c=gm->conn[i];
+        if(!c) continue;
+        __atomic_store_n(&c->game,-1,__ATOMIC_RELEASE);
+        connRelease(c); gm->conn[i]=NULL;
+    }
+    /* spectateurs : GAME_OVER déjà en file, on vide et on détache */
+    for(int i=0;i<gm->nSpec;i++){
+        Conn *c=gm->spec[i];
+        __atomic_store_n(&c->spectate,-1,__ATOMIC_RELEASE);
+        connFlush(c);
+        connRelease(c);
     }
-    char msg[BUFFER_SIZE];
-    int len=snprintf(msg,sizeof(msg),"STATE:%s|%s|%s\n",proj,hp,pos);
-    for(int i=0;i<2;i++){
-        int d=socketFromUsername(gm->players[i]);
-        if(d!=-1) write(d,msg,len);
+    __atomic_sub_fetch(&g_spectators,gm->nSpec,__ATOMIC_RELAXED);
+    free(gm->spec); gm->spec=NULL;
+    gm->nSpec=gm->specCap=0;
+
+    recFinish(gm->rec);                   /* .dfr complet côté écrivain */
+    gm->rec=NULL;
+
+    /* retrait du shard en O(1) : le dernier prend la place */
+    PhysShard *sh=&g_shards[gm->shard];
+    pthread_mutex_lock(&sh->lock);
+    int pos=gm->shardPos;
+    if(pos<sh->count && sh->games[pos]==gm->handle){
+        int last=sh->games[--sh->count];
+        sh->games[pos]=last;
+        gameAt(last)->shardPos=pos;
     }
+    pthread_mutex_unlock(&sh->lock);
+
+    gm->active=0;
+    slabFree(&g_gameSlab,gm->handle);     /* gm->lock encore tenu par l’appelant */
 }
 
 /* =========================================================
- *               Boucle physique
+ *     Spectateurs  (SPECTATE:<partie|joueur>, SPECTATE_LEAVE)
+ *
+ *  Rattachés à la partie sous gm->lock, qui tient une référence sur
+ *  chacun. Ils reçoivent les messages de contrôle de la partie et,
+ *  si l’état a changé, une photo tous les g_specDiv ticks au plus :
+ *  encodée une fois par format (texte, BIN1, BIN2) et partagée par
+ *  toutes leurs files, quel que soit leur nombre. Un spectateur lent
+ *  ne voit que la photo la plus récente (MSG_STATE remplaçable).
+ *  Sans changement, les spectateurs liés en UDP (ni ACK ni renvoi)
+ *  reçoivent encore la dernière photo tous les RATE_DIV_MAX ticks.
  * =======================================================*/
-void *physicsLoop(void *arg)
+static void spectateState(Game *gm,const uint32_t hint[2],OutBuf *txt,
+                          UdpBatch *u)
 {
-    (void)arg;
-    struct timespec req={0,(long)(1e9/TICK_HZ)};
+    if(!gm->nSpec) return;
+    uint64_t since=gm->tick-gm->specTick;
+    if(since<(uint64_t)g_specDiv) return;
+    int refresh=!gm->specDirty;
+    if(refresh && since<(uint64_t)(g_specDiv>RATE_DIV_MAX?g_specDiv:RATE_DIV_MAX))
+        return;
+    gm->specDirty=0;
+    gm->specTick=gm->tick;
+    if(!refresh) gm->specSeq++;
+
+    OutBuf *b[3]={ txt,NULL,NULL };   /* indice : c->bin (0 = texte) */
+    if(txt) __atomic_add_fetch(&txt->refs,1,__ATOMIC_RELAXED);
+    for(int i=0;i<gm->nSpec;i++){
+        if(refresh && !__atomic_load_n(&gm->spec[i]->udpPeer,__ATOMIC_ACQUIRE))
+            continue;
+        int v=gm->spec[i]->bin;
+        if(!b[v]) b[v]=v?stateFrame(gm,v,hint):stateText(gm,hint);
+        if(!udpQueue(u,gm->spec[i],b[v])) connQueueBuf(gm->spec[i],b[v],MSG_STATE);
+    }
+    for(int v=0;v<3;v++) outRelease(b[v]);
+}
 
-    while(1){
-        nanosleep(&req,NULL);
-
-        pthread_mutex_lock(&m_games);
-        for(int gi=0;gi<MAX_GAMES;gi++){
-            Game *gm=&g_games[gi];
-            if(!gm->active) continue;
-
-            pthread_mutex_lock(&gm->lock);
-
-            /* --- déplacement projectiles + collisions --- */
-            for(int i=0;i<gm->projCount;i++){
-                Projectile *pr=&gm->proj[i];
-                if(!pr->active) continue;
-                pr->x+=pr->dx; pr->y+=pr->dy;
-
-                for(int p=0;p<2;p++){
-                    if(strcmp(pr->owner,gm->players[p])==0) continue;
-                    float ax1=gm->posX[p]-PLANE_SIZE/2.0f;
-                    float ay1=gm->posY[p]-PLANE_SIZE/2.0f;
-                    float ax2=ax1+PLANE_SIZE, ay2=ay1+PLANE_SIZE;
-                    float px1=pr->x,py1=pr->y,
-                          px2=pr->x+PROJECTILE_SIZE,
-                          py2=pr->y+PROJECTILE_SIZE;
-                    if(px1<ax2&&px2>ax1&&py1<ay2&&py2>ay1){
-                        pr->active=0;
-                        gm->hp[p]-=DMG_PER_HIT;
-                        if(gm->hp[p]<0) gm->hp[p]=0;
-                        char h[64];
-                        snprintf(h,sizeof(h),"HIT:%s:%d\n",
-                                 gm->players[p],gm->hp[p]);
-                        for(int q=0;q<2;q++){
-                            int d=socketFromUsername(gm->players[q]);
-                            if(d!=-1) write(d,h,strlen(h));
-                        }
-                        break;
-                    }
-                }
-                if(pr->active &&
-                   (pr->x<-PROJECTILE_SIZE || pr->x>BOARD_WIDTH+PROJECTILE_SIZE))
-                    pr->active=0;
-            }
-            int w=0;
-            for(int r=0;r<gm->projCount;r++)
-                if(gm->proj[r].active) gm->proj[w++]=gm->proj[r];
-            gm->projCount=w;
-
-            /* --- Game over ? --- */
-            int alive0=gm->hp[0]>0, alive1=gm->hp[1]>0;
-            if(!alive0 || !alive1){
-                const char *winner = alive0?gm->players[0]
-                                   : alive1?gm->players[1]:"NONE";
-                const char *loser  = alive0?gm->players[1]
-                                   : alive1?gm->players[0]:"NONE";
-                char msg[128];
-                snprintf(msg,sizeof(msg),GAME_OVER_PREFIX"%s\n",winner);
-                for(int p=0;p<2;p++){
-                    int d=socketFromUsername(gm->players[p]);
-                    if(d!=-1) write(d,msg,strlen(msg));
-                }
-
-                if(gm->db_id>0 && strcmp(winner,"NONE")==0){
-                    /* match nul : on marque finished sans winner */
-                    db_finishGame(gm->db_id, NULL, NULL);
-                }else if(gm->db_id>0){
-                    db_finishGame(gm->db_id, winner, loser);
-                }
-
-                gm->active=0;
-                pthread_mutex_unlock(&gm->lock);
-                continue;
-            }
+void spectateJoin(Conn *c,const char *arg)
+{
+    int gid=-1;
+    if(arg && *arg>='0' && *arg<='9') gid=atoi(arg);
+    else if(arg && *arg){                     /* par nom d’un joueur */
+        Conn *p=connByName(arg);
+        if(p) gid=__atomic_load_n(&p->game,__ATOMIC_ACQUIRE);
+        connRelease(p);
+    }
+    if(gid<0 || gid>=slabSpan(&g_gameSlab) ||
+       __atomic_load_n(&c->game,__ATOMIC_ACQUIRE)>=0){
+        connSend(c,"SPECTATE_FAIL\n",14);
+        return;
+    }
+    spectateLeave(c);
+    replayStop(c);
 
-            sendState(gm);
+    Game *gm=gameAt(gid);
+    pthread_mutex_lock(&gm->lock);
+    if(!gm->active || gm->nSpec>=g_specMax){
+        pthread_mutex_unlock(&gm->lock);
+        connSend(c,"SPECTATE_FAIL\n",14);
+        return;
+    }
+    if(gm->nSpec==gm->specCap){
+        int cap=gm->specCap?gm->specCap*2:16;
+        Conn **n=realloc(gm->spec,cap*sizeof(Conn*));
+        if(!n){
             pthread_mutex_unlock(&gm->lock);
+            connSend(c,"SPECTATE_FAIL\n",14);
+            return;
         }
-        pthread_mutex_unlock(&m_games);
+        gm->spec=n; gm->specCap=cap;
     }
-    return NULL;
+    gm->spec[gm->nSpec++]=connAcquire(c);
+    __atomic_store_n(&c->spectate,gid,__ATOMIC_RELEASE);
+    __atomic_add_fetch(&g_spectators,1,__ATOMIC_RELAXED);
+
+    /* SPECTATE_OK:<partie> + MATCH_SLOTS, puis l’état courant */
+    char m[SIM_MAX_PLAYERS*USERNAME_LEN+64];
+    int  ml=snprintf(m,sizeof(m),"SPECTATE_OK:%d\n",gid);
+    if(gm->rec) ml+=snprintf(m+ml,sizeof(m)-ml,"RECORD:%llu\n",
+                             (unsigned long long)recId(gm->rec));
+    ml+=matchSlots(gm,m+ml,sizeof(m)-ml);
+    connQueue(c,m,(size_t)ml,MSG_CTRL);
+    uint32_t hint[2]={ (uint32_t)gm->tick,(uint32_t)(metNow()/1000000) };
+    OutBuf *b=c->bin?stateFrame(gm,c->bin,hint):stateText(gm,hint);
+    connQueueBuf(c,b,MSG_STATE);
+    outRelease(b);
+    pthread_mutex_unlock(&gm->lock);
+    connFlush(c);
+}
+
+/* détache c de la partie qu’il regarde ; rien si endGame l’a déjà fait */
+void spectateLeave(Conn *c)
+{
+    int gid=__atomic_load_n(&c->spectate,__ATOMIC_ACQUIRE);
+    if(gid<0) return;
+    Game *gm=gameAt(gid);
+    pthread_mutex_lock(&gm->lock);
+    for(int i=0;i<gm->nSpec;i++)
+        if(gm->spec[i]==c){
+            gm->spec[i]=gm->spec[--gm->nSpec];
+            __atomic_store_n(&c->spectate,-1,__ATOMIC_RELEASE);
+            __atomic_sub_fetch(&g_spectators,1,__ATOMIC_RELAXED);
+            connRelease(c);               /* l’appelant tient encore c */
+            break;
+        }
+    pthread_mutex_unlock(&gm->lock);
 }
 
 /* =========================================================
- *         Thread Client – écoute les commandes
+ *               Simulation d’un tick  (gm->lock tenu)
  * =======================================================*/
-void *handleClient(void *arg)
+/* message de contrôle à tous les joueurs et spectateurs : un seul
+ * OutBuf partagé                                                  */
+static void gameBroadcast(Game *gm,const char *m,int ml)
 {
-    int sock=*((int*)arg); free(arg);
+    OutBuf *b=outNew(m,(size_t)ml);
+    for(int q=0;q<gm->nPlayers;q++) connQueueBuf(gm->conn[q],b,MSG_CTRL);
+    for(int q=0;q<gm->nSpec;q++)    connQueueBuf(gm->spec[q],b,MSG_CTRL);
+    outRelease(b);
+}
 
-    MYSQL *conn=mysql_init(NULL);
-    if(!mysql_real_connect(conn,DB_HOST,DB_USER,DB_PASS,
-                           DB_NAME,DB_PORT,NULL,0)){
-        close(sock); return NULL;
+/* événements de sim.c → messages (file seulement, flush au tick) ;
+ * 0 si la partie est terminée (endGame fait)                       */
+static int gameEvents(Game *gm,const SimEvents *ev)
+{
+    for(int i=0;i<ev->n;i++){
+        const SimEvent *e=&ev->ev[i];
+        char m[160];
+        int  ml;
+        recEvent(gm->rec,(uint32_t)gm->tick,e);
+        switch(e->kind){
+        case SEV_FIRE_ACK:
+            /* part avec le prochain tick (même writev que le STATE) */
+            ml=snprintf(m,sizeof(m),"FIRE_ACK:%u:%s:%.0f:%.0f:%.0f:%.0f\n",
+                        e->id,gm->players[e->slot],e->x,e->y,e->dx,e->dy);
+            gameBroadcast(gm,m,ml);
+            break;
+        case SEV_HIT:
+            ml=snprintf(m,sizeof(m),"HIT:%s:%d\n",gm->players[e->slot],e->hp);
+            gameBroadcast(gm,m,ml);
+            break;
+        case SEV_GAME_OVER: {
+            const char *winner = e->slot>=0?gm->players[e->slot]:"NONE";
+            ml=snprintf(m,sizeof(m),GAME_OVER_PREFIX"%s\n",winner);
+            gameBroadcast(gm,m,ml);
+            for(int p=0;p<gm->nPlayers;p++) connFlush(gm->conn[p]);
+            /* match nul : on marque finished sans winner ; les arènes
+             * ne vont pas en base (table game = duel)                 */
+            if(gm->nPlayers==2){
+                if(e->slot<0) persistGameEnd(gm->matchKey,NULL,NULL);
+                else          persistGameEnd(gm->matchKey,winner,gm->players[!e->slot]);
+            }
+            endGame(gm);
+            return 0;
+        }
+        }
     }
+    return 1;
+}
 
-    char buf[BUFFER_SIZE];
-    char user[USERNAME_LEN]="";
-    int  logged=0;
+/* un pas de simulation ; 0 si la partie vient de se terminer */
+static int stepGame(Game *gm)
+{
+    SimEvents ev; ev.n=0;
+    int moving=gm->sim.proj.count>0;
+    simStep(&gm->sim,&ev);
+    if(moving || ev.n) gameDirty(gm);
+    return gameEvents(gm,&ev);
+}
 
-    while(1){
-        int r=read(sock,buf,BUFFER_SIZE-1);
-        if(r<=0){
-            if(logged) removeConnectedPlayer(user);
-            removeClientSocket(sock);
-            close(sock); mysql_close(conn); return NULL;
-        }
-        buf[r]='\0';
-        buf[strcspn(buf,"\r\n")]='\0';
+/* steps pas d’affilée (rattrapage), au plus un état envoyé à la fin */
+void tickGame(Game *gm,int steps)
+{
+    gameDrain(gm);
+    while(steps-->0)
+        if(!stepGame(gm)) return;
 
-        char *cmd=strtok(buf,":");
-        if(!cmd) continue;
+    if(gm->rec && gm->recDirty) recState(gm);
+    sendState(gm);
 
-        if(strcmp(cmd,"REGISTER")==0){
-            char *u=strtok(NULL,":");
-            char *e=strtok(NULL,":");
-            char *p=strtok(NULL,":");
-            if(u&&e&&p) registerUser(conn,u,e,p,sock);
-        }
-        else if(strcmp(cmd,"LOGIN")==0){
-            char *u=strtok(NULL,":");
-            char *p=strtok(NULL,":");
-            if(u&&p) loginUser(conn,u,p,sock,user,&logged);
-            if(logged){
-                setSocketUsername(sock,user);
-                addConnectedPlayer(user);
-            }
-        }
-        
-        else if(strcmp(cmd,"CHAT")==0 && logged){
-            char *txt=strtok(NULL,"");
-            if(txt&&*txt){
-                char out[BUFFER_SIZE];
-                snprintf(out,sizeof(out),"CHAT:%s:%s\n",user,txt);
-                broadcastMessage(out);
-            }
-        }
-        else if(strcmp(cmd,"QUERY1")==0) queryOne(conn,sock);
-        else if(strcmp(cmd,"QUERY2")==0) queryTwo(conn,sock);
-        else if(strcmp(cmd,"QUERY3")==0) queryThree(conn,sock);
-
-        else if(strcmp(cmd,"INVITE")==0 && logged){
-            char *c=strtok(NULL,":");
-            if(c){
-                createInvitation(user,c);
-                char m[BUFFER_SIZE];
-                snprintf(m,sizeof(m),"INVITE_REQUEST:%s:%s\n",user,c);
-                broadcastMessage(m);
-            }
-        }
-        else if(strcmp(cmd,"INVITE_RESP")==0 && logged){
-            char *inviter=strtok(NULL,":");
-            char *resp   =strtok(NULL,":");
-            if(inviter&&resp)
-                handleInviteAnswer(inviter,user,
-                                   strcmp(resp,"ACCEPT")==0);
-        }
-        else if(strcmp(cmd,"MOVE")==0 && logged){
-            char *sx=strtok(NULL,":");
-            char *sy=strtok(NULL,":");
-            if(sx&&sy){
-                int gid=findGameByPlayer(user);
-                if(gid>=0){
-                    Game *gm=&g_games[gid];
-                    pthread_mutex_lock(&gm->lock);
-                    int idx=strcmp(gm->players[0],user)==0?0:1;
-                    gm->posX[idx]=atof(sx);
-                    gm->posY[idx]=atof(sy);
-                    pthread_mutex_unlock(&gm->lock);
-                }
-            }
-        }
-        else if(strcmp(cmd,"FIRE")==0 && logged){
-            char *sx=strtok(NULL,":");
-            char *sy=strtok(NULL,":");
-            char *sdx=strtok(NULL,":");
-            char *sdy=strtok(NULL,":");
-            if(sx&&sy&&sdx&&sdy)
-                fireFromPlayer(sock,user,atof(sx),atof(sy),
-                               atof(sdx),atof(sdy));
-        }
-        else if(strcmp(cmd,"LIST")==0 && logged){
-            char list[BUFFER_SIZE]="";
-            pthread_mutex_lock(&m_players);
-            for(int i=0;i<g_numPlayers;i++){
-                strcat(list,g_connected[i]);
-                if(i<g_numPlayers-1) strcat(list,",");
-            }
-            pthread_mutex_unlock(&m_players);
-            char msg[BUFFER_SIZE+32];
-            snprintf(msg,sizeof(msg),"UPDATE_LIST:%s\n",list);
-            write(sock,msg,strlen(msg));
-        }
+    /* tout ce que ce tick a produit part en un seul writev */
+    for(int p=0;p<gm->nPlayers;p++) connFlush(gm->conn[p]);
+    for(int p=0;p<gm->nSpec;p++)    connFlush(gm->spec[p]);
+}
+
+/* =========================================================
+ *        Boucle physique  (un thread par shard)
+ * =======================================================*/
 
-        else if (strcmp(cmd,"DELETE_ME")==0 && logged)
-        {
-            deleteAccount(conn,user,sock);          /* envoie DELETE_OK / DELETE_FAIL */
-            removeConnectedPlayer(user);
-            /* on laisse à mysql le soin d’effacer l’historique via ON DELETE CASCADE */
-            logged = 0;
-            /* on ferme la socket juste après avoir répondu */
-            close(sock);
-            mysql_close(conn);
-            return NULL;
+/* simule la partie jusqu’à ce tick si personne ne l’a déjà fait ;
+ * le CAS sur gm->tick est le « claim » partagé propriétaire/voleurs.
+ * Un match à stride k ne fait un pas qu’aux ticks multiples de k.
+ * Renvoie le nombre de pas simulés (0 : déjà fait ailleurs, ou
+ * pas de pas à ce tick).                                           */
+static int claimTick(PhysShard *me,int slot,uint64_t tick)
+{
+    Game *gm=gameAt(slot);
+    uint64_t t=__atomic_load_n(&gm->tick,__ATOMIC_ACQUIRE);
+    if(t>=tick || !__atomic_compare_exchange_n(&gm->tick,&t,tick,0,
+                                  __ATOMIC_ACQ_REL,__ATOMIC_RELAXED))
+        return 0;
+    uint64_t k=(uint64_t)__atomic_load_n(&gm->stride,__ATOMIC_RELAXED);
+    if(k<1) k=1;
+    uint64_t steps=tick/k-t/k;
+    if(!steps) return 0;
+    if(steps>TICK_CATCHUP_MAX){
+        me->dropped+=steps-TICK_CATCHUP_MAX;
+        steps=TICK_CATCHUP_MAX;
+    }
+    me->steps+=steps;
+    me->catchup+=steps-1;
+    pthread_mutex_lock(&gm->lock);
+    if(gm->active) tickGame(gm,(int)steps);
+    pthread_mutex_unlock(&gm->lock);
+    return (int)steps;
+}
+
+/* copie des handles du shard dans *buf (agrandi au besoin) */
+static int shardGames(PhysShard *sh,int **buf,int *cap)
+{
+    pthread_mutex_lock(&sh->lock);
+    int n=sh->count;
+    if(n>*cap){
+        int *b=realloc(*buf,n*sizeof(int));
+        if(b){ *buf=b; *cap=n; } else n=*cap;
+    }
+    if(n) memcpy(*buf,sh->games,n*sizeof(int));
+    pthread_mutex_unlock(&sh->lock);
+    return n;
+}
+
+#define TICK_PERIOD_NS  (1000000000LL/TICK_HZ)
+
+static int64_t sinceTick0(const struct timespec *t)
+{
+    return (int64_t)(t->tv_sec-g_tick0.tv_sec)*1000000000LL
+          +(t->tv_nsec-g_tick0.tv_nsec);
+}
+
+/* dernier tick dont l’échéance est passée */
+static uint64_t currentTick(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return (uint64_t)(sinceTick0(&now)/TICK_PERIOD_NS);
+}
+
+static struct timespec tickDeadline(uint64_t tick)
+{
+    struct timespec dl=g_tick0;
+    int64_t ns=dl.tv_nsec+(int64_t)tick*TICK_PERIOD_NS;
+    dl.tv_sec+=ns/1000000000LL; dl.tv_nsec=ns%1000000000LL;
+    return dl;
+}
+
+/* Pas fixe 1/TICK_HZ sur échéances absolues (g_tick0 + k·période) :
+ * le retard d’un tick ne décale pas les suivants. Un shard en retard
+ * saute directement au tick courant et chaque partie rattrape les pas
+ * manquants (TICK_CATCHUP_MAX au plus) : la vitesse de simulation
+ * reste constante, seul l’envoi d’état est sauté.                    */
+void *physicsLoop(void *arg)
+{
+    PhysShard *me=arg;
+    int self=(int)(me-g_shards);
+    int *games=NULL, gcap=0;
+    uint64_t tick=currentTick();
+    uint64_t reportAt=tick+(uint64_t)TICK_REPORT_S*TICK_HZ, lastOver=0;
+
+    while(1){
+        tick++;
+        struct timespec dl=tickDeadline(tick), t0, t1;
+        while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&dl,NULL)==EINTR);
+        clock_gettime(CLOCK_MONOTONIC,&t0);
+
+        /* réveillé en retard d’un tick ou plus : on saute au courant */
+        int64_t late=sinceTick0(&t0)-(int64_t)tick*TICK_PERIOD_NS;
+        if(late>me->lateNsMax) me->lateNsMax=late;
+        uint64_t cur=(uint64_t)(sinceTick0(&t0)/TICK_PERIOD_NS);
+        if(cur>tick) tick=cur;
+
+        /* 1) nos parties */
+        int n=shardGames(me,&games,&gcap);
+        for(int i=0;i<n;i++) claimTick(me,games[i],tick);
+
+        /* 2) vol : parties des autres shards encore en attente */
+        for(int k=1;k<g_shardCount;k++){
+            PhysShard *sh=&g_shards[(self+k)%g_shardCount];
+            n=shardGames(sh,&games,&gcap);
+            for(int i=0;i<n;i++)
+                if(claimTick(me,games[i],tick)) me->stolen++;
         }
-        /* ----------- LOGOUT (unique) ----------- */
-        else if (strcmp(cmd,"LOGOUT")==0 && logged)
-        {
-            /* 1) on le retire du lobby */
-            removeConnectedPlayer(user);
-
-            /* 2) petit accusé côté client */
-            write(sock,"LOGOUT_OK\n",10);
-
-            /* 3) fermeture propre + fin de thread */
-            close(sock);
-            mysql_close(conn);
-            return NULL;
+
+        /* budget : fini avant l’échéance suivante ? */
+        clock_gettime(CLOCK_MONOTONIC,&t1);
+        uint64_t busy=(uint64_t)((t1.tv_sec-t0.tv_sec)*1000000000LL
+                                +(t1.tv_nsec-t0.tv_nsec));
+        me->ticks++;
+        me->busyNs+=busy;
+        if(busy>me->maxNs) me->maxNs=busy;
+        if(sinceTick0(&t1)>(int64_t)(tick+1)*TICK_PERIOD_NS) me->overruns++;
+        metTick(busy,late);
+
+        if(tick>=reportAt){
+            if(me->overruns>lastOver)
+                fprintf(stderr,"physique: shard %d saturé, %llu dépassements en %ds "
+                        "(pire tick %.2f ms, %llu pas perdus au total)\n",
+                        self,(unsigned long long)(me->overruns-lastOver),TICK_REPORT_S,
+                        me->maxNs/1e6,(unsigned long long)me->dropped);
+            lastOver=me->overruns;
+            reportAt=tick+(uint64_t)TICK_REPORT_S*TICK_HZ;
         }
+    }
+    return NULL;
+}
+
+/* =========================================================
+ *         Threads I/O – boucle epoll
+ * =======================================================*/
+
+void closeConn(IoThread *io, Conn *c)
+{
+    epoll_ctl(io->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    lobbyLeave(c);
+    if (c->logged) { dropInvitesOf(c->user); arenaLeave(c); }
+    spectateLeave(c);
+    replayStop(c);
+    udpClose(c);
+    connUnlink(c);
+    /* les parties qui tiennent encore un handle n’enverront plus rien ;
+     * le fd reste réservé jusqu’à leur connRelease()                  */
+    __atomic_store_n(&c->closed, 1, __ATOMIC_RELEASE);
+    shutdown(c->fd, SHUT_RDWR);
+    connRelease(c);
+}
+
+/* place libre en fin de tampon ; recompacte puis double si besoin */
+static char *inReserve(Conn *c, size_t want, size_t *avail)
+{
+    if (c->inHead && c->inHead + c->inLen + want > c->inCap) {
+        memmove(c->in, c->in + c->inHead, c->inLen);
+        c->inHead = 0;
+    }
+    if (c->inLen + want > c->inCap) {
+        size_t cap = c->inCap ? c->inCap : INBUF_INIT;
+        while (cap < c->inLen + want) cap *= 2;
+        char *n = realloc(c->in, cap);
+        if (!n) return NULL;
+        c->in = n; c->inCap = cap;
+    }
+    *avail = c->inCap - c->inHead - c->inLen;
+    return c->in + c->inHead + c->inLen;
+}
+
+/* exécute chaque ligne complète du tampon ; s’arrête derrière une
+ * commande SQL en cours (reprise par sqlFinish)                   */
+static int runLines(Conn *c)
+{
+    /* découpe en lignes : plusieurs commandes par read() */
+    while (c->inLen && !c->dbBusy) {
+        char *line = c->in + c->inHead;
+        char *nl = memchr(line, '\n', c->inLen);
+        if (!nl) break;
+        size_t n = nl - line + 1;
+        *nl = '\0';
+        if (nl > line && nl[-1] == '\r') nl[-1] = '\0';
+        c->inHead += n; c->inLen -= n;
+        if (!*line) continue;
+        int k = metCmdIndex(line);
+        uint64_t t0 = metNow();
+        int rc = handleClient(c, line);
+        if (c->dbBusy) { c->cmdKind = k; c->cmdStart = t0; }  /* mesurée par sqlFinish */
+        else metCmd(k, metNow() - t0);
+        if (rc < 0) return -1;
+    }
+    if (c->inLen == 0) c->inHead = 0;
+    return 0;
+}
+
+/* lit tout ce qui est dispo puis exécute chaque ligne complète ;
+ * retourne -1 si la connexion doit être fermée                    */
+static int onReadable(Conn *c)
+{
+    while (1) {
+        size_t avail;
+        char *dst = inReserve(c, INBUF_INIT, &avail);
+        if (!dst) return -1;
+
+        ssize_t r = read(c->fd, dst, avail);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0 && errno == EAGAIN) return 0;
+        if (r <= 0) return -1;
+        c->inLen += r;
+
+        if (runLines(c) < 0) return -1;
+        /* pas de \n, ou trop de lignes derrière une commande SQL */
+        if (c->inLen >= MAX_LINE) return -1;
+
+        if ((size_t)r < avail) return 0;          /* socket vidée */
+    }
+}
+
+static void sqlFinish(IoThread *io);
 
+void *ioLoop(void *arg)
+{
+    IoThread *io = arg;
+    struct epoll_event evs[MAX_EVENTS];
 
+    while (1) {
+        int n = epoll_wait(io->epfd, evs, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait"); return NULL;
+        }
+        int sqlDone = 0;
+        for (int i = 0; i < n; i++) {
+            if (evs[i].data.ptr == io) { sqlDone = 1; continue; }
+            Conn *c = evs[i].data.ptr;
+            if (evs[i].events & EPOLLOUT) connFlush(c);
+            if ((evs[i].events & ~EPOLLOUT) && onReadable(c) < 0)
+                closeConn(io, c);
+        }
+        /* après le lot : sqlFinish() peut fermer une connexion encore
+         * présente plus loin dans evs[]                             */
+        if (sqlDone) sqlFinish(io);
     }
 }
 
 /* =========================================================
- *          Helpers MySQL pour l’historique
+ *    Dispatch d’une commande client  (callback par connexion)
+ *    retourne -1 si la connexion doit être fermée
  * =======================================================*/
-static MYSQL *open_db(void)
+/* ---------------------------------------------------------
+ *  Commandes SQL : exécutées par les workers du pool, jamais
+ *  sur un thread I/O. La connexion reste en pause (dbBusy) :
+ *  ses lignes suivantes attendent dans le tampon d’entrée et
+ *  sont reprises dans l’ordre par sqlFinish().
+ * -------------------------------------------------------*/
+enum { SQL_REGISTER, SQL_LOGIN, SQL_QUERY1, SQL_QUERY2, SQL_QUERY3, SQL_DELETE };
+
+typedef struct SqlJob {
+    DbJob   job;                      /* en tête : DbJob* → SqlJob*   */
+    struct SqlJob *next;              /* file de retour du thread I/O */
+    Conn   *c;                        /* handle tenu par le job       */
+    int     cmd;
+    int     ok;                       /* LOGIN accepté / DELETE tenté */
+    char    name[USERNAME_LEN];       /* LOGIN : nom tel qu’en base   */
+    char   *arg[3];                   /* champs copiés dans buf       */
+    char    buf[];
+} SqlJob;
+
+/* thread worker : requête, réponse directe au client, puis retour
+ * au thread I/O propriétaire pour appliquer le résultat           */
+static void sqlRun(DbJob *dj, DbConn *db)
 {
-    MYSQL *c=mysql_init(NULL);
-    if(!mysql_real_connect(c,DB_HOST,DB_USER,DB_PASS,
-                           DB_NAME,DB_PORT,NULL,0)){
-        fprintf(stderr,"DB connect: %s\n",mysql_error(c));
-        return NULL;
+    SqlJob *j=(SqlJob*)dj;
+    Conn *c=j->c;
+    if(!db) connSend(c,"DB unavailable\n",15);
+    else switch(j->cmd){
+    case SQL_REGISTER: registerUser(db,j->arg[0],j->arg[1],j->arg[2],c); break;
+    case SQL_LOGIN:    loginUser(db,j->arg[0],j->arg[1],c,j->name,&j->ok); break;
+    case SQL_QUERY1:                  /* cache froid : voir leaderboard.c */
+    case SQL_QUERY2:
+    case SQL_QUERY3:   lbReload(db,c,j->cmd-SQL_QUERY1); break;
+    case SQL_DELETE:   /* DELETE_OK / DELETE_FAIL ; l’historique part en ON DELETE CASCADE */
+        deleteAccount(db,j->arg[0],c);
+        lbInvalidate();                /* ses scores / parties disparaissent */
+        j->ok=1;
+        break;
     }
-    return c;
+    IoThread *io=&g_io[c->io];
+    pthread_mutex_lock(&io->doneLock);
+    j->next=io->done;
+    io->done=j;
+    pthread_mutex_unlock(&io->doneLock);
+    uint64_t one=1;
+    if(write(io->wakefd,&one,sizeof(one))<0) perror("eventfd");
+}
+
+static void sqlSubmit(Conn *c,int cmd,const char *a0,const char *a1,const char *a2)
+{
+    const char *a[3]={a0,a1,a2};
+    size_t n=0;
+    for(int i=0;i<3;i++) n+=(a[i]?strlen(a[i]):0)+1;
+    SqlJob *j=calloc(1,sizeof(*j)+n);
+    if(!j){ connSend(c,"DB unavailable\n",15); return; }
+    char *p=j->buf;
+    for(int i=0;i<3;i++){
+        size_t l=a[i]?strlen(a[i]):0;
+        j->arg[i]=p;
+        memcpy(p,a[i]?a[i]:"",l+1);
+        p+=l+1;
+    }
+    j->job.run=sqlRun;
+    j->c=connAcquire(c);
+    j->cmd=cmd;
+    c->dbBusy=1;
+    dbSubmit(&j->job);
 }
-static void close_db(MYSQL *c){ if(c) mysql_close(c); }
 
-static int db_createGame(const char *p1,const char *p2)
+/* thread I/O : effet de la commande sur la connexion ; -1 ⇒ fermer */
+static int sqlApply(SqlJob *j)
 {
-    MYSQL *c=open_db(); if(!c) return 0;
-    char sql[256];
-    snprintf(sql,sizeof(sql),
-        "INSERT INTO game(name,status) "
-        "VALUES('Duel %s vs %s','in_progress')",p1,p2);
-    if(mysql_query(c,sql))
-        fprintf(stderr,"db_createGame: %s\n",mysql_error(c));
-    int id=(int)mysql_insert_id(c);
-    close_db(c); return id;
+    Conn *c=j->c;
+    if(j->cmd==SQL_LOGIN && j->ok){
+        const char *proto=j->arg[2];
+        if(strcmp(proto,"BIN1")==0 || strcmp(proto,"BIN2")==0){
+            c->bin=proto[3]-'0';          /* BIN2 : + tick/ms par trame */
+            char r[16];
+            connSend(c,r,snprintf(r,sizeof(r),"PROTO:%s\n",proto));
+        }
+        connSetName(c,j->name);
+        c->logged=1;
+        lobbyJoin(c);
+    }
+    /* closeConn() retire le joueur du lobby et ferme la socket */
+    if(j->cmd==SQL_DELETE && j->ok) return -1;
+    return 0;
 }
 
-static void db_finishGame(int idGame,const char *winner,const char *loser)
+/* eventfd du thread I/O : applique les commandes SQL terminées et
+ * reprend les lignes restées en attente derrière elles            */
+static void sqlFinish(IoThread *io)
 {
-    MYSQL *c=open_db(); if(!c) return;
-    char sql[512];
+    uint64_t n;
+    if(read(io->wakefd,&n,sizeof(n))<0 && errno!=EAGAIN) perror("eventfd");
+    pthread_mutex_lock(&io->doneLock);
+    SqlJob *j=io->done;
+    io->done=NULL;
+    pthread_mutex_unlock(&io->doneLock);
+    while(j){
+        SqlJob *next=j->next;
+        Conn *c=j->c;
+        c->dbBusy=0;
+        metCmd(c->cmdKind,metNow()-c->cmdStart);   /* aller-retour worker compris */
+        /* fermée entre-temps : il ne reste que le handle à rendre */
+        if(!__atomic_load_n(&c->closed,__ATOMIC_ACQUIRE) &&
+           (sqlApply(j)<0 || runLines(c)<0))
+            closeConn(io,c);
+        connRelease(c);
+        free(j);
+        j=next;
+    }
+}
 
-    /* 1. terminer la partie */
-    if(winner){
-        snprintf(sql,sizeof(sql),
-            "UPDATE game SET status='finished', "
-            "winner_id=(SELECT id_player FROM players WHERE username='%s') "
-            "WHERE id_game=%d",winner,idGame);
-    }else{
-        snprintf(sql,sizeof(sql),
-            "UPDATE game SET status='finished' WHERE id_game=%d",idGame);
+int handleClient(Conn *c, char *buf)
+{
+    char *user = c->user;
+
+    char *sp;                              /* strtok_r : threads I/O concurrents */
+    char *cmd=strtok_r(buf,":",&sp);
+    if(!cmd) return 0;
+
+    if(strcmp(cmd,"REGISTER")==0){
+        char *u=strtok_r(NULL,":",&sp);
+        char *e=strtok_r(NULL,":",&sp);
+        char *p=strtok_r(NULL,":",&sp);
+        if(u&&e&&p) sqlSubmit(c,SQL_REGISTER,u,e,p);
+    }
+    else if(strcmp(cmd,"LOGIN")==0){
+        char *u=strtok_r(NULL,":",&sp);
+        char *p=strtok_r(NULL,":",&sp);
+        char *proto=strtok_r(NULL,":",&sp);   /* LOGIN:u:p[:BIN1|BIN2] */
+        /* c->user est la clé de l’index par nom : pas de re-login en place */
+        if(c->logged){ connSend(c,"Already logged in\n",18); return 0; }
+        if(u&&p) sqlSubmit(c,SQL_LOGIN,u,p,proto);
+    }
+
+    else if(strcmp(cmd,"CHAT")==0 && c->logged){
+        char *txt=strtok_r(NULL,"",&sp);
+        if(txt&&*txt){
+            char out[BUFFER_SIZE];
+            snprintf(out,sizeof(out),"CHAT:%s:%s\n",user,txt);
+            broadcastMessage(out);
+        }
     }
-    mysql_query(c,sql);
+    else if(strcmp(cmd,"QUERY1")==0){ if(lbServe(c,0)<0) sqlSubmit(c,SQL_QUERY1,NULL,NULL,NULL); }
+    else if(strcmp(cmd,"QUERY2")==0){ if(lbServe(c,1)<0) sqlSubmit(c,SQL_QUERY2,NULL,NULL,NULL); }
+    else if(strcmp(cmd,"QUERY3")==0){ if(lbServe(c,2)<0) sqlSubmit(c,SQL_QUERY3,NULL,NULL,NULL); }
+
+    else if(strcmp(cmd,"INVITE")==0 && c->logged){
+        char *t=strtok_r(NULL,":",&sp);
+        char *hz=strtok_r(NULL,":",&sp);   /* facultatif : cadence du duel */
+        if(connBusy(c)){
+            char r[32+USERNAME_LEN];
+            connSend(c,r,snprintf(r,sizeof(r),"INVITE_RESULT:%s:BUSY\n",user));
+        }
+        /* INVITE_REQUEST à l’invité seul */
+        else if(t) createInvitation(user,t,matchStride(hz? strtol(hz,NULL,10):0));
+    }
+    else if(strcmp(cmd,"INVITE_RESP")==0 && c->logged){
+        char *inviter=strtok_r(NULL,":",&sp);
+        char *resp   =strtok_r(NULL,":",&sp);
+        if(inviter&&resp)
+            handleInviteAnswer(inviter,user,
+                               strcmp(resp,"ACCEPT")==0);
+    }
+    else if(strcmp(cmd,"MOVE")==0 && c->logged){
+        char *sx=strtok_r(NULL,":",&sp);
+        char *sy=strtok_r(NULL,":",&sp);
+        if(sx&&sy)
+            gamePost(c,(GameInput){ .kind=IN_MOVE,
+                                    .x=atof(sx), .y=atof(sy) });
+    }
+    else if(strcmp(cmd,"ACK")==0 && c->logged && c->bin){
+        char *sq=strtok_r(NULL,":",&sp);
+        if(sq) ackSnapshot(c,(uint32_t)strtoul(sq,NULL,10));
+    }
+    else if(strcmp(cmd,"FIRE")==0 && c->logged){
+        char *sx=strtok_r(NULL,":",&sp);
+        char *sy=strtok_r(NULL,":",&sp);
+        char *sdx=strtok_r(NULL,":",&sp);
+        char *sdy=strtok_r(NULL,":",&sp);
+        if(sx&&sy&&sdx&&sdy)
+            gamePost(c,(GameInput){ .kind=IN_FIRE,
+                                    .x=atof(sx), .y=atof(sy),
+                                    .dx=atof(sdx), .dy=atof(sdy) });
+    }
+    else if(strcmp(cmd,"LIST")==0 && c->logged) lobbySnapshot(c);
 
-    /* si match nul (winner==NULL) on s’arrête */
-    if(!winner){ close_db(c); return; }
+    /* arène : ARENA:<n> rejoint la file de n joueurs, ARENA_LEAVE la quitte */
+    else if(strcmp(cmd,"ARENA")==0 && c->logged){
+        char *sn=strtok_r(NULL,":",&sp);
+        arenaJoin(c,sn?atoi(sn):0);
+    }
+    else if(strcmp(cmd,"ARENA_LEAVE")==0 && c->logged) arenaLeave(c);
+
+    /* spectateur : SPECTATE:<id de partie | nom d’un joueur> */
+    else if(strcmp(cmd,"SPECTATE")==0 && c->logged)
+        spectateJoin(c,strtok_r(NULL,":",&sp));
+    else if(strcmp(cmd,"SPECTATE_LEAVE")==0 && c->logged){
+        spectateLeave(c);
+        connSend(c,"SPECTATE_END\n",13);
+    }
 
-    /* 2. entrée history gagnant */
-    snprintf(sql,sizeof(sql),
-        "INSERT INTO history(id_player,id_game,kills,deaths,score)"
-        " VALUES((SELECT id_player FROM players WHERE username='%s'),"
-        "%d,1,0,%d)",winner,idGame,WIN_SCORE);
-    mysql_query(c,sql);
+    /* canal UDP (udp.c) : UDP donne le jeton, UDP_OFF revient à TCP */
+    else if(strcmp(cmd,"UDP")==0 && c->logged) udpGrant(c);
+    else if(strcmp(cmd,"UDP_OFF")==0 && c->logged) udpClose(c);
 
-    /* 3. entrée history perdant */
-    snprintf(sql,sizeof(sql),
-        "INSERT INTO history(id_player,id_game,kills,deaths,score)"
-        " VALUES((SELECT id_player FROM players WHERE username='%s'),"
-        "%d,0,1,0)",loser,idGame);
-    mysql_query(c,sql);
+    /* match enregistré : REPLAY:<id>[:<vitesse 1..16>], REPLAY_STOP */
+    else if(strcmp(cmd,"REPLAY")==0 && c->logged){
+        char *id=strtok_r(NULL,":",&sp);
+        replayStart(c,id,strtok_r(NULL,":",&sp));
+    }
+    else if(strcmp(cmd,"REPLAY_STOP")==0 && c->logged){
+        if(replayStop(c)) connSend(c,"REPLAY_END\n",11);
+    }
 
-    /* 4. incrément score total */
-    snprintf(sql,sizeof(sql),
-        "UPDATE players SET total_score=total_score+%d "
-        "WHERE username='%s'",WIN_SCORE,winner);
-    mysql_query(c,sql);
+    /* relevé Prometheus, réservé aux comptes de DOGFIGHT_ADMINS */
+    else if(strcmp(cmd,"STATS")==0 && c->logged){
+        size_t len;
+        char *txt=metIsAdmin(user)?metRender(&len):NULL;
+        if(!txt){ connSend(c,"STATS_DENIED\n",13); return 0; }
+        OutBuf *b=malloc(sizeof(OutBuf)+len+24);
+        if(b){
+            b->refs=1;
+            b->len=(uint32_t)snprintf(b->data,len+24,"STATS_BEGIN\n%.*sSTATS_END\n",
+                                      (int)len,txt);
+            b->type=OUT_STATS_BEGIN;
+            connQueueBuf(c,b,MSG_CTRL);
+            outRelease(b);
+            connFlush(c);
+        }
+        free(txt);
+    }
 
-    close_db(c);
+    else if (strcmp(cmd,"DELETE_ME")==0 && c->logged)
+    {
+        /* fermeture au retour du worker (sqlApply) */
+        sqlSubmit(c,SQL_DELETE,user,NULL,NULL);
+    }
+    /* ----------- LOGOUT (unique) ----------- */
+    else if (strcmp(cmd,"LOGOUT")==0 && c->logged)
+    {
+        /* 1) on le retire du lobby (et ses invitations en cours) */
+        lobbyLeave(c);
+        dropInvitesOf(user);
+        arenaLeave(c);
+        spectateLeave(c);
+        replayStop(c);
+        c->logged = 0;
+
+        /* 2) petit accusé côté client */
+        connSend(c,"LOGOUT_OK\n",10);
+
+        /* 3) fermeture propre par le thread I/O */
+        return -1;
+    }
+    return 0;
 }
 
+/* =========================================================
+ *          Connexion MySQL
+ * =======================================================*/
+static MYSQL *open_db(void)
+{
+    MYSQL *c=mysql_init(NULL);
+    if(!c) return NULL;
+    if(!mysql_real_connect(c,DB_HOST,DB_USER,DB_PASS,
+                           DB_NAME,DB_PORT,NULL,0)){
+        fprintf(stderr,"DB connect: %s\n",mysql_error(c));
+        mysql_close(c);
+        return NULL;
+    }
+    return c;
+}
 /* ----------------------------------------------------------
  *  Fonctions SQL (register/login/queries) dans fichier séparé
  * ---------------------------------------------------------*/
+#include "leaderboard.c"
 #include "db_helpers.c"
+#include "persist.c"
@@ -0,0 +1,552 @@
+/* ==================================================================
+ *          SIMULATION D’UN MATCH  – cœur déterministe, sans I/O
+ *
+ *  Toutes les règles d’un match (duel à 2, arène jusqu’à
+ *  SIM_MAX_PLAYERS) tiennent ici : état pur (SimState), entrées
+ *  (MOVE / FIRE) appliquées dans l’ordre reçu, pas fixe simStep()
+ *  de stride/60 s (1 à SIM_MAX_STRIDE : 60 à 10 Hz) ; les vitesses
+ *  restent par 1/60 s et un tir est testé sur tout son trajet du pas,
+ *  sans effet tunnel quand le pas s’allonge. Rien n’est écrit sur une
+ *  socket ni en base : chaque appel renvoie ses événements (FIRE_ACK,
+ *  HIT, GAME_OVER) et c’est server.c qui les traduit en messages.
+ *   – même état + même suite d’entrées ⇒ mêmes événements, même état
+ *     final, quel que soit le noyau projectiles (AVX / SSE / scalaire)
+ *   – aucun appel à l’horloge ni au hasard
+ *
+ *  Mode accéléré autonome (bancs d’essai, fuzzing, rejeu hors ligne) :
+ *      gcc -O2 -DSIM_FASTFORWARD sim.c -o simff -lm
+ *      ./simff -m 1000 -t 100000        entrées aléatoires + invariants
+ *      ./simff -n 64 -m 100             arène de 64 (-x : sans grille,
+ *                                       même empreinte attendue)
+ *      ./simff -k 3                     pas de 3/60 s (20 Hz)
+ *      ./simff -n 64 -a                 entrées hostiles (±1e30, hors
+ *                                       plateau) : ni crash ni invariant
+ *      ./simff -r inputs.txt            rejeu : « pas MOVE slot x y »,
+ *                                       « pas FIRE slot x y dx dy »
+ * ================================================================== */
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef MAX_PROJECTILES                 /* autonome : valeurs du serveur */
+#define MAX_PROJECTILES      512
+#define MAX_ACTIVE_MISSILES  5
+#define PLANE_SIZE           40
+#define PROJECTILE_SIZE      20
+#define BOARD_WIDTH          560
+#define BOARD_HEIGHT         540
+#define MAX_HEALTH           100
+#define DMG_PER_HIT          10
+#endif
+
+#define SIM_MAX_PLAYERS 64                      /* 2 : duel, au-delà : arène */
+#define SIM_MAX_STRIDE  6                       /* pas le plus long : 10 Hz  */
+#define SIM_MAX_EVENTS  (MAX_PROJECTILES + SIM_MAX_PLAYERS + 4) /* par pas */
+
+/* Projectiles d’une partie, en colonnes pour les noyaux SIMD
+ * (proj_simd.c) ; lignes triées par id, propriétaire = slot du tireur */
+#define PROJ_WORDS  ((MAX_PROJECTILES + 63) / 64)   /* masques de bits */
+typedef struct {
+    float    x [MAX_PROJECTILES] __attribute__((aligned(32)));
+    float    y [MAX_PROJECTILES] __attribute__((aligned(32)));
+    float    dx[MAX_PROJECTILES] __attribute__((aligned(32)));
+    float    dy[MAX_PROJECTILES] __attribute__((aligned(32)));
+    uint32_t id[MAX_PROJECTILES];
+    uint8_t  owner[MAX_PROJECTILES];
+    int      count;
+} ProjSoA;
+
+/* Noyaux déplacement / collisions */
+#include "proj_simd.c"
+
+typedef struct {
+    int      nPlayers;                 /* 2..SIM_MAX_PLAYERS          */
+    int      stride;                   /* pas = stride/60 s           */
+    float    posX[SIM_MAX_PLAYERS], posY[SIM_MAX_PLAYERS];
+    int      hp[SIM_MAX_PLAYERS];      /* 0 : éliminé (arène)         */
+    ProjSoA  proj;
+    uint32_t nextProjId;
+    uint64_t steps;                    /* pas simulés depuis simInit  */
+    int      over;                     /* GAME_OVER déjà émis         */
+} SimState;
+
+enum { SIN_MOVE, SIN_FIRE };
+typedef struct {
+    uint8_t kind, slot;
+    float   x, y, dx, dy;              /* dx, dy : FIRE seulement     */
+} SimInput;
+
+enum { SEV_FIRE_ACK, SEV_HIT, SEV_GAME_OVER };
+typedef struct {
+    uint8_t  kind;
+    int8_t   slot;                     /* tireur / touché / gagnant (-1 : nul) */
+    int      hp;                       /* HIT : points restants       */
+    uint32_t id;                       /* FIRE_ACK : id du projectile */
+    float    x, y, dx, dy;
+} SimEvent;
+
+typedef struct {
+    SimEvent ev[SIM_MAX_EVENTS];
+    int      n;
+} SimEvents;
+
+static void simEmit(SimEvents *out, SimEvent e)
+{
+    if (out && out->n < SIM_MAX_EVENTS) out->ev[out->n++] = e;
+}
+
+/* duel : face à face ; arène : en cercle autour du centre */
+void simInit(SimState *s, int nPlayers, int stride)
+{
+    memset(s, 0, sizeof(*s));
+    s->nPlayers = nPlayers < 2 ? 2 : nPlayers > SIM_MAX_PLAYERS ? SIM_MAX_PLAYERS : nPlayers;
+    s->stride   = stride < 1 ? 1 : stride > SIM_MAX_STRIDE ? SIM_MAX_STRIDE : stride;
+    s->nextProjId = 1;
+    for (int i = 0; i < s->nPlayers; i++) s->hp[i] = MAX_HEALTH;
+    if (s->nPlayers == 2) {
+        s->posX[0] = PLANE_SIZE;
+        s->posY[0] = BOARD_HEIGHT/2.0f;
+        s->posX[1] = BOARD_WIDTH-PLANE_SIZE;
+        s->posY[1] = BOARD_HEIGHT/2.0f;
+        return;
+    }
+    const float r = (BOARD_HEIGHT < BOARD_WIDTH ? BOARD_HEIGHT : BOARD_WIDTH)/2.0f - PLANE_SIZE;
+    for (int i = 0; i < s->nPlayers; i++) {
+        float a = 6.2831853f * (float)i / (float)s->nPlayers;
+        s->posX[i] = BOARD_WIDTH/2.0f  + r * cosf(a);
+        s->posY[i] = BOARD_HEIGHT/2.0f + r * sinf(a);
+    }
+}
+
+/* MOVE : position imposée ; FIRE : refusé au-delà de
+ * MAX_ACTIVE_MISSILES par joueur (aucun événement dans ce cas).
+ * Un joueur éliminé ne bouge ni ne tire plus ; valeurs non finies
+ * ignorées (un trajet NaN ne toucherait ni ne sortirait jamais).
+ * Positions ramenées sur le plateau, tir plus rapide qu’un plateau
+ * par 1/60 s ignoré : rien d’énorme n’atteint la grille ni le STATE. */
+#define SIM_MAX_SPEED  BOARD_WIDTH
+
+static float clampf(float v, float hi)
+{
+    return v < 0 ? 0 : v > hi ? hi : v;
+}
+
+void simInput(SimState *s, const SimInput *in, SimEvents *out)
+{
+    if (s->over || in->slot >= s->nPlayers || s->hp[in->slot] <= 0) return;
+    if (!isfinite(in->x) || !isfinite(in->y) || !isfinite(in->dx) || !isfinite(in->dy)) return;
+    float x = clampf(in->x, BOARD_WIDTH), y = clampf(in->y, BOARD_HEIGHT);
+    if (in->kind == SIN_MOVE) {
+        s->posX[in->slot] = x;
+        s->posY[in->slot] = y;
+        return;
+    }
+    if (fabsf(in->dx) > SIM_MAX_SPEED || fabsf(in->dy) > SIM_MAX_SPEED) return;
+    ProjSoA *p = &s->proj;
+    int cnt = 0;
+    for (int k = 0; k < p->count; k++) cnt += p->owner[k] == in->slot;
+    if (cnt >= MAX_ACTIVE_MISSILES || p->count >= MAX_PROJECTILES) return;
+
+    int k = p->count++;
+    p->id[k] = s->nextProjId++;
+    p->owner[k] = in->slot;
+    p->x[k] = x; p->y[k] = y; p->dx[k] = in->dx; p->dy[k] = in->dy;
+    simEmit(out, (SimEvent){ .kind = SEV_FIRE_ACK, .slot = (int8_t)in->slot, .id = p->id[k],
+                             .x = x, .y = y, .dx = in->dx, .dy = in->dy });
+}
+
+/* ---------------------------------------------------------------
+ *  Arène : grille uniforme (broad-phase). Une case de GRID_CELL ≥
+ *  PLANE_SIZE + PROJECTILE_SIZE : la boîte de touche d’un avion
+ *  couvre au plus 2×2 cases ; un projectile regarde les cases de la
+ *  boîte englobant son trajet du pas.
+ *  Grille refaite à chaque pas (tri par comptage), cases bornées au
+ *  plateau des deux côtés : tout recouvrement reste dans une case
+ *  commune. Coût O(avions + projectiles + paires proches).
+ * ------------------------------------------------------------- */
+#define GRID_CELL  64
+#define GRID_W     ((BOARD_WIDTH  + GRID_CELL - 1) / GRID_CELL)
+#define GRID_H     ((BOARD_HEIGHT + GRID_CELL - 1) / GRID_CELL)
+
+typedef struct {
+    uint16_t start[GRID_W * GRID_H + 1];  /* slots de la case c : [start[c], start[c+1]) */
+    uint8_t  slot[SIM_MAX_PLAYERS * 4];   /* par case, slots croissants */
+} SimGrid;
+
+/* bornes testées avant la conversion : (int) d’un float hors de
+ * portée est indéfini (INT_MIN sur x86, case négative)             */
+static int gridCol(float x)
+{
+    if (!(x > 0)) return 0;                /* NaN compris */
+    if (!(x < GRID_W * GRID_CELL)) return GRID_W - 1;
+    int c = (int)(x * (1.0f / GRID_CELL));
+    return c < GRID_W ? c : GRID_W - 1;
+}
+
+static int gridRow(float y)
+{
+    if (!(y > 0)) return 0;
+    if (!(y < GRID_H * GRID_CELL)) return GRID_H - 1;
+    int r = (int)(y * (1.0f / GRID_CELL));
+    return r < GRID_H ? r : GRID_H - 1;
+}
+
+static void gridBuild(SimGrid *g, const SimState *s, const PlaneBox *b)
+{
+    uint16_t at[GRID_W * GRID_H + 1] = { 0 };
+    for (int pass = 0; pass < 2; pass++) {
+        for (int t = 0; t < s->nPlayers; t++) {
+            if (s->hp[t] <= 0) continue;
+            int c0 = gridCol(b[t].lox), c1 = gridCol(b[t].hix);
+            int r0 = gridRow(b[t].loy), r1 = gridRow(b[t].hiy);
+            for (int r = r0; r <= r1; r++)
+                for (int c = c0; c <= c1; c++) {
+                    if (pass) g->slot[at[r * GRID_W + c]++] = (uint8_t)t;
+                    else      at[r * GRID_W + c + 1]++;
+                }
+        }
+        if (pass) break;
+        for (int c = 0; c < GRID_W * GRID_H; c++) at[c + 1] += at[c];
+        memcpy(g->start, at, sizeof(g->start));
+    }
+}
+
+#ifdef SIM_FASTFORWARD
+static int g_simBrute;                     /* -x : tous les avions, pour comparer */
+#endif
+
+/* instant d’entrée (0..1) du trajet dans b, sweepBox() ayant conclu
+ * au contact : sert seulement à classer les avions touchés          */
+static float sweepEnter(float x0, float y0, float ddx, float ddy, const PlaneBox *b)
+{
+    float t = 0;
+    if (ddx > 0) t = MAXF(t, (b->lox - x0) / ddx);
+    if (ddx < 0) t = MAXF(t, (b->hix - x0) / ddx);
+    if (ddy > 0) t = MAXF(t, (b->loy - y0) / ddy);
+    if (ddy < 0) t = MAXF(t, (b->hiy - y0) / ddy);
+    return t;
+}
+
+/* touches d’un pas d’arène, avant le déplacement : un projectile touche
+ * le premier avion vivant, hors son tireur, rencontré sur son trajet
+ * (à égalité, le plus petit slot)                                      */
+static void arenaHits(SimState *s, uint64_t dead[PROJ_WORDS], SimEvents *out)
+{
+    PlaneBox b[SIM_MAX_PLAYERS];
+    SimGrid  g;
+    planeBoxes(s->posX, s->posY, b, s->nPlayers);
+    gridBuild(&g, s, b);
+    memset(dead, 0, PROJ_WORDS * sizeof(uint64_t));
+    const float k = (float)s->stride;
+    ProjSoA *p = &s->proj;
+    for (int i = 0; i < p->count; i++) {
+        /* mêmes opérations que les noyaux : même point d’arrivée */
+        float x0 = p->x[i], y0 = p->y[i];
+        float ddx = p->dx[i] * k, ddy = p->dy[i] * k;
+        float x1 = x0 + ddx, y1 = y0 + ddy;
+        int c0 = gridCol(MINF(x0, x1)), c1 = gridCol(MAXF(x0, x1));
+        int r0 = gridRow(MINF(y0, y1)), r1 = gridRow(MAXF(y0, y1));
+        int best = -1;
+        float bestT = 2;
+        for (int r = r0; r <= r1; r++)
+            for (int c = c0; c <= c1; c++) {
+                int q = g.start[r * GRID_W + c], end = g.start[r * GRID_W + c + 1];
+#ifdef SIM_FASTFORWARD
+                uint8_t all[SIM_MAX_PLAYERS];
+                const uint8_t *cand = g.slot;
+                if (g_simBrute) {              /* une seule « case » : tout le monde */
+                    if (r != r0 || c != c0) continue;
+                    for (int t = 0; t < s->nPlayers; t++) all[t] = (uint8_t)t;
+                    cand = all; q = 0; end = s->nPlayers;
+                }
+#else
+                const uint8_t *cand = g.slot;
+#endif
+                for (; q < end; q++) {
+                    int t = cand[q];
+                    if (t == p->owner[i] || s->hp[t] <= 0) continue;
+                    if (!sweepBox(x0, y0, x1, y1, ddx, ddy, &b[t])) continue;
+                    float e = sweepEnter(x0, y0, ddx, ddy, &b[t]);
+                    if (e < bestT || (e == bestT && t < best)) { best = t; bestT = e; }
+                }
+            }
+        if (best < 0) continue;
+        dead[i >> 6] |= 1ULL << (i & 63);
+        s->hp[best] -= DMG_PER_HIT;
+        if (s->hp[best] < 0) s->hp[best] = 0;
+        simEmit(out, (SimEvent){ .kind = SEV_HIT, .slot = (int8_t)best, .hp = s->hp[best] });
+    }
+}
+
+/* duel : masques du noyau SIMD, un projectile ne touche que
+ * l’adversaire de son tireur ; touches dans l’ordre des projectiles */
+static void duelHits(SimState *s, uint64_t dead[PROJ_WORDS], SimEvents *out)
+{
+    ProjSoA *p = &s->proj;
+    uint64_t hit[2][PROJ_WORDS];
+    projStep(p, s->posX, s->posY, s->stride, hit, dead);
+    for (int wd = 0; wd < PROJ_WORDS; wd++) {
+        uint64_t m = hit[0][wd] | hit[1][wd];
+        while (m) {
+            int i = wd*64 + __builtin_ctzll(m);
+            m &= m - 1;
+            if (i >= p->count) break;
+            int t = !p->owner[i];
+            if (!(hit[t][wd] >> (i & 63) & 1)) continue;
+            dead[wd] |= 1ULL << (i & 63);
+            s->hp[t] -= DMG_PER_HIT;
+            if (s->hp[t] < 0) s->hp[t] = 0;
+            simEmit(out, (SimEvent){ .kind = SEV_HIT, .slot = (int8_t)t, .hp = s->hp[t] });
+        }
+    }
+}
+
+/* un pas de stride/60 s ; 0 si le match vient de se terminer */
+int simStep(SimState *s, SimEvents *out)
+{
+    if (s->over) return 0;
+    s->steps++;
+
+    /* --- déplacement projectiles + collisions (proj_simd.c) --- */
+    ProjSoA *p = &s->proj;
+    uint64_t dead[PROJ_WORDS];
+    if (s->nPlayers == 2) duelHits(s, dead, out);
+    else {
+        uint64_t gone[PROJ_WORDS];
+        arenaHits(s, dead, out);                /* trajets depuis l’ancienne position */
+        projMove(p, s->stride, gone);
+        for (int wd = 0; wd < PROJ_WORDS; wd++) dead[wd] |= gone[wd];
+    }
+
+    int any = 0;
+    for (int wd = 0; wd < PROJ_WORDS; wd++) any |= dead[wd] != 0;
+    if (any) projCompact(p, dead);
+
+    /* --- fin du match : un seul avion (ou aucun) encore en vol --- */
+    int alive = 0, last = -1;
+    for (int i = 0; i < s->nPlayers; i++)
+        if (s->hp[i] > 0) { alive++; last = i; }
+    if (alive > 1) return 1;
+    s->over = 1;
+    simEmit(out, (SimEvent){ .kind = SEV_GAME_OVER, .slot = (int8_t)(alive ? last : -1) });
+    return 0;
+}
+
+#ifdef SIM_FASTFORWARD
+/* ==================================================================
+ *     Mode accéléré : aucun sommeil entre les pas, pas de réseau
+ * ================================================================== */
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t g_rng;
+
+static uint32_t rnd(void)                       /* xorshift64*, graine -s */
+{
+    g_rng ^= g_rng >> 12; g_rng ^= g_rng << 25; g_rng ^= g_rng >> 27;
+    return (uint32_t)((g_rng * 2685821657736338717ULL) >> 32);
+}
+
+static uint64_t fnv(uint64_t h, const void *p, size_t n)
+{
+    const unsigned char *c = p;
+    while (n--) h = (h ^ *c++) * 1099511628211ULL;
+    return h;
+}
+
+/* empreinte de l’état visible (sans le bourrage des colonnes) */
+static uint64_t simHash(uint64_t h, const SimState *s)
+{
+    size_t n = (size_t)s->nPlayers;
+    h = fnv(h, s->posX, n * sizeof(float)); h = fnv(h, s->posY, n * sizeof(float));
+    h = fnv(h, s->hp, n * sizeof(int));
+    const ProjSoA *p = &s->proj;
+    h = fnv(h, &p->count, sizeof(p->count));
+    h = fnv(h, p->x, p->count * sizeof(float)); h = fnv(h, p->y, p->count * sizeof(float));
+    h = fnv(h, p->id, p->count * sizeof(uint32_t));
+    return h;
+}
+
+static uint64_t eventHash(uint64_t h, const SimEvents *ev)
+{
+    for (int i = 0; i < ev->n; i++) {
+        const SimEvent *e = &ev->ev[i];
+        int32_t v[4] = { e->kind, e->slot, e->hp, (int32_t)e->id };
+        float   f[4] = { e->x, e->y, e->dx, e->dy };
+        h = fnv(h, v, sizeof(v)); h = fnv(h, f, sizeof(f));
+    }
+    return h;
+}
+
+static void simCheck(const SimState *s, uint64_t match)
+{
+    const ProjSoA *p = &s->proj;
+    int own[SIM_MAX_PLAYERS] = { 0 }, bad = p->count < 0 || p->count > MAX_PROJECTILES;
+    for (int i = 0; !bad && i < s->nPlayers; i++)
+        bad = s->hp[i] < 0 || s->hp[i] > MAX_HEALTH || !(s->posX[i] >= 0)
+           || !(s->posX[i] <= BOARD_WIDTH) || !(s->posY[i] >= 0) || !(s->posY[i] <= BOARD_HEIGHT);
+    for (int k = 0; !bad && k < p->count; k++) {
+        bad = p->owner[k] >= s->nPlayers || (k && p->id[k] <= p->id[k-1]);
+        if (!bad) bad = ++own[p->owner[k]] > MAX_ACTIVE_MISSILES;
+    }
+    if (bad) {
+        fprintf(stderr, "invariant violé : match %llu, pas %llu\n",
+                (unsigned long long)match, (unsigned long long)s->steps);
+        exit(1);
+    }
+}
+
+/* -a : une entrée sur huit reçoit une coordonnée hostile (client
+ * malveillant : FIRE:1e30, MOVE hors plateau) ; tirages en plus,
+ * donc empreinte différente de la série normale                   */
+static int g_simHostile;
+
+static float hostile(void)
+{
+    static const float v[] = { 1e30f, -1e30f, 3e9f, -3e9f, 4.0f * BOARD_WIDTH, -1.0f };
+    return v[rnd() % (sizeof(v) / sizeof(v[0]))];
+}
+
+/* entrées aléatoires façon joueur : bouge souvent ; en duel tire vers
+ * l’autre, en arène vers un adversaire tiré au sort                  */
+static int randomInputs(SimState *s, SimInput *in)
+{
+    int n = 0;
+    for (int slot = 0; slot < s->nPlayers; slot++) {
+        /* un tirage par instruction : ordre d’évaluation fixé */
+        if (rnd() % 4 == 0) {
+            float x = (float)(rnd() % BOARD_WIDTH);
+            float y = (float)(rnd() % BOARD_HEIGHT);
+            in[n++] = (SimInput){ SIN_MOVE, (uint8_t)slot, x, y, 0, 0 };
+        }
+        if (rnd() % 20 == 0) {
+            float dx = slot ? -20.0f : 20.0f;
+            float dy = (float)((int)(rnd() % 7) - 3);
+            if (s->nPlayers > 2) {
+                int t = (int)(rnd() % (uint32_t)s->nPlayers);
+                float vx = s->posX[t] - s->posX[slot], vy = s->posY[t] - s->posY[slot];
+                float d = sqrtf(vx * vx + vy * vy);
+                if (d > 1) { dx = 20.0f * vx / d; dy = 20.0f * vy / d; }
+            }
+            in[n++] = (SimInput){ SIN_FIRE, (uint8_t)slot, s->posX[slot], s->posY[slot],
+                                  dx, dy };
+        }
+    }
+    for (int i = 0; g_simHostile && i < n; i++)
+        if (rnd() % 8 == 0) {
+            float *f[4] = { &in[i].x, &in[i].y, &in[i].dx, &in[i].dy };
+            *f[rnd() % 4] = hostile();
+        }
+    return n;
+}
+
+static void printEvents(uint64_t step, const SimEvents *ev)
+{
+    for (int i = 0; i < ev->n; i++) {
+        const SimEvent *e = &ev->ev[i];
+        if (e->kind == SEV_FIRE_ACK)
+            printf("%llu FIRE_ACK %d %u %.0f %.0f %.0f %.0f\n", (unsigned long long)step,
+                   e->slot, e->id, e->x, e->y, e->dx, e->dy);
+        else if (e->kind == SEV_HIT)
+            printf("%llu HIT %d %d\n", (unsigned long long)step, e->slot, e->hp);
+        else
+            printf("%llu GAME_OVER %d\n", (unsigned long long)step, e->slot);
+    }
+}
+
+/* rejeu : entrées appliquées avant le pas indiqué, événements sur stdout */
+static int replay(FILE *f, int players, int stride)
+{
+    SimState *s = malloc(sizeof(SimState));
+    SimEvents *ev = malloc(sizeof(SimEvents));
+    if (!s || !ev) return 1;
+    simInit(s, players, stride);
+    char line[256], kind[16];
+    unsigned long long at;
+    int slot, alive = 1;
+    while (alive && fgets(line, sizeof(line), f)) {
+        SimInput in = { 0 };
+        if (line[0] == '#' || sscanf(line, "%llu %15s %d %f %f %f %f", &at, kind, &slot,
+                                     &in.x, &in.y, &in.dx, &in.dy) < 5) continue;
+        in.kind = strcmp(kind, "FIRE") == 0 ? SIN_FIRE : SIN_MOVE;
+        in.slot = (uint8_t)slot;
+        while (alive && s->steps < at) {
+            ev->n = 0;
+            alive = simStep(s, ev);
+            printEvents(s->steps, ev);
+        }
+        ev->n = 0;
+        simInput(s, &in, ev);
+        printEvents(s->steps, ev);
+    }
+    printf("# %llu pas, hp", (unsigned long long)s->steps);
+    for (int i = 0; i < s->nPlayers; i++) printf("%c%d", i ? '/' : ' ', s->hp[i]);
+    printf(", empreinte %016llx\n", (unsigned long long)simHash(1469598103934665603ULL, s));
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t matches = 100, ticks = 100000, seed = 1;
+    const char *replayFile = NULL;
+    int opt, players = 2, stride = 1;
+    while ((opt = getopt(argc, argv, "m:t:s:r:n:k:xa")) != -1)
+        switch (opt) {
+        case 'm': matches = strtoull(optarg, NULL, 10); break;
+        case 't': ticks   = strtoull(optarg, NULL, 10); break;
+        case 's': seed    = strtoull(optarg, NULL, 10); break;
+        case 'r': replayFile = optarg;                  break;
+        case 'n': players = atoi(optarg);               break;
+        case 'k': stride  = atoi(optarg);               break;
+        case 'x': g_simBrute = 1;                       break;
+        case 'a': g_simHostile = 1;                     break;
+        default:
+            fprintf(stderr, "usage: %s [-m matchs] [-t pas max/match] [-s graine] "
+                            "[-n joueurs] [-k pas en 1/60 s] [-x] [-a] [-r entrées.txt | -r -]\n",
+                    argv[0]);
+            return 2;
+        }
+    projKernelInit();
+    if (replayFile) {
+        FILE *f = strcmp(replayFile, "-") ? fopen(replayFile, "r") : stdin;
+        if (!f) { perror(replayFile); return 1; }
+        return replay(f, players, stride);
+    }
+
+    SimState *s = malloc(sizeof(SimState));
+    SimEvents *ev = malloc(sizeof(SimEvents));
+    if (!s || !ev) return 1;
+    g_rng = seed * 0x9E3779B97F4A7C15ULL | 1;
+    uint64_t steps = 0, hits = 0, ended = 0, hash = 1469598103934665603ULL;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (uint64_t m = 0; m < matches; m++) {
+        simInit(s, players, stride);
+        for (uint64_t t = 0; t < ticks; t++) {
+            SimInput in[2 * SIM_MAX_PLAYERS];
+            int n = randomInputs(s, in);
+            ev->n = 0;
+            for (int i = 0; i < n; i++) simInput(s, &in[i], ev);
+            int alive = simStep(s, ev);
+            for (int i = 0; i < ev->n; i++) hits += ev->ev[i].kind == SEV_HIT;
+            hash = eventHash(hash, ev);
+            simCheck(s, m);
+            if (!alive) { ended++; break; }
+        }
+        steps += s->steps;
+        hash = simHash(hash, s);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("{ \"matches\": %llu, \"ended\": %llu, \"steps\": %llu, \"hits\": %llu, "
+           "\"seconds\": %.3f, \"steps_per_s\": %.0f, \"hash\": \"%016llx\" }\n",
+           (unsigned long long)matches, (unsigned long long)ended,
+           (unsigned long long)steps, (unsigned long long)hits,
+           sec, sec > 0 ? steps / sec : 0.0, (unsigned long long)hash);
+    return 0;
+}
+#endif
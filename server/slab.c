@@ -0,0 +1,98 @@
+/* ==================================================================
+ *          SLABS  – registres extensibles à handles stables
+ *
+ *  Un slab range des éléments de taille fixe par tranches de 2^shift,
+ *  allouées à la demande jusqu’à un maximum fixé au démarrage
+ *  (configuration). Un handle est un simple indice : l’élément ne
+ *  bouge jamais, la table des tranches n’est jamais réallouée, donc
+ *  slabAt() se passe de verrou.
+ *   – slabAlloc / slabFree en O(1) : liste libre chaînée par indices
+ *   – ctor appelé une seule fois par élément, à la création de sa
+ *     tranche (mutex qui doivent survivre aux réutilisations)
+ * ================================================================== */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    size_t          size;             /* pas entre éléments (64 octets) */
+    int             shift;            /* 2^shift éléments par tranche   */
+    int             max;              /* handles possibles (arrondi)    */
+    int             limit;            /* éléments vivants au plus       */
+    char          **chunks;           /* table fixe, max >> shift cases */
+    int            *links;            /* suivant dans la liste libre    */
+    int             nChunks;
+    int             freeHead;         /* -1 : liste vide                */
+    int             used;
+    pthread_mutex_t lock;
+    void          (*ctor)(void*);
+} Slab;
+
+static int slabInit(Slab *s, size_t size, int shift, int max, void (*ctor)(void*))
+{
+    memset(s, 0, sizeof(*s));
+    s->size     = (size + 63) & ~(size_t)63;
+    s->shift    = shift;
+    s->max      = (max + (1 << shift) - 1) & ~((1 << shift) - 1);
+    s->limit    = max;
+    s->chunks   = calloc((size_t)(s->max >> shift), sizeof(char*));
+    s->links    = malloc((size_t)s->max * sizeof(int));
+    s->freeHead = -1;
+    s->ctor     = ctor;
+    pthread_mutex_init(&s->lock, NULL);
+    return s->chunks && s->links ? 0 : -1;
+}
+
+static inline void *slabAt(const Slab *s, int h)
+{
+    return s->chunks[h >> s->shift] + (size_t)(h & ((1 << s->shift) - 1)) * s->size;
+}
+
+/* handles déjà distribués au moins une fois : [0, slabSpan) */
+static inline int slabSpan(const Slab *s)
+{
+    return __atomic_load_n(&s->nChunks, __ATOMIC_ACQUIRE) << s->shift;
+}
+
+/* nouvelle tranche chaînée dans la liste libre (lock tenu) */
+static int slabGrow(Slab *s)
+{
+    if (s->nChunks == s->max >> s->shift) return -1;
+    size_t n = (size_t)1 << s->shift;
+    char *c = aligned_alloc(64, n * s->size);
+    if (!c) return -1;
+    memset(c, 0, n * s->size);
+    int base = s->nChunks << s->shift;
+    for (size_t i = 0; i < n; i++) {
+        if (s->ctor) s->ctor(c + i * s->size);
+        s->links[base + i] = i + 1 < n ? base + (int)i + 1 : s->freeHead;
+    }
+    s->chunks[s->nChunks] = c;
+    __atomic_store_n(&s->nChunks, s->nChunks + 1, __ATOMIC_RELEASE);
+    s->freeHead = base;
+    return 0;
+}
+
+/* handle libre, -1 si le maximum configuré est atteint */
+static int slabAlloc(Slab *s)
+{
+    pthread_mutex_lock(&s->lock);
+    if (s->used >= s->limit || (s->freeHead < 0 && slabGrow(s) < 0)) {
+        pthread_mutex_unlock(&s->lock);
+        return -1;
+    }
+    int h = s->freeHead;
+    s->freeHead = s->links[h];
+    s->used++;
+    pthread_mutex_unlock(&s->lock);
+    return h;
+}
+
+static void slabFree(Slab *s, int h)
+{
+    pthread_mutex_lock(&s->lock);
+    s->links[h] = s->freeHead;
+    s->freeHead = h;
+    s->used--;
+    pthread_mutex_unlock(&s->lock);
+}
@@ -0,0 +1,238 @@
+/* ==================================================================
+ *          CANAL UDP  – MOVE et STATE hors du flux TCP (optionnel)
+ *
+ *  Sur TCP, un segment perdu retient tous les STATE suivants (blocage
+ *  en tête de ligne). Un client connecté peut demander un jeton et
+ *  faire passer ses MOVE et ses états par datagrammes, où seul le plus
+ *  récent compte ; FIRE, FIRE_ACK, HIT, GAME_OVER et le lobby restent
+ *  sur TCP. Little-endian ; jeton = id de connexion << 32 | secret.
+ *
+ *    TCP  UDP               → UDP_TOKEN:<jeton hex>:<port>
+ *    UDP  'H' u64 jeton     → TCP UDP_OK (à répéter jusque-là)
+ *    UDP  'M' u64 jeton u32 seq i16 x i16 y    MOVE, seq croissant
+ *    UDP  'A' u64 jeton u32 seq                ACK d’une trame binaire
+ *    TCP  UDP_OFF           → retour au tout-TCP
+ *
+ *  Serveur → client : un état par datagramme, mêmes octets que sur TCP
+ *  (trame 0xFF… ou TICK:…\nSTATE:…\n) ; le client garde le plus récent
+ *  (seq de trame ou tick). Au-delà de UDP_MAX_PAYLOAD, l’état part par
+ *  TCP. Envois groupés : un sendmmsg par partie et par tick. Un état
+ *  perdu sans changement derrière est renvoyé (trame non acquittée,
+ *  client texte ou spectateur) tous les RATE_DIV_MAX ticks.
+ *
+ *  DOGFIGHT_UDP_LOSS=<pour cent> jette des datagrammes au hasard, dans
+ *  les deux sens (essais de perte sur loopback).
+ * ================================================================== */
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define UDP_BATCH        64        /* datagrammes par sendmmsg/recvmmsg */
+#define UDP_MAX_PAYLOAD  1400      /* sous la MTU : pas de fragmentation */
+#define UDP_IN_MAX       32        /* plus grand datagramme client      */
+#define UDP_SOCKBUF      (1 << 20)
+
+static int      g_udpFd = -1;
+static int      g_udpPort;
+static unsigned g_udpLoss;         /* pour cent, DOGFIGHT_UDP_LOSS      */
+
+/* pair d’une connexion : adresse IPv4 << 16 | port (ordre réseau),
+ * 0 = canal fermé ; lu/écrit atomiquement (thread UDP / physique)   */
+static uint64_t udpPeerPack(const struct sockaddr_in *a)
+{
+    return (uint64_t)a->sin_addr.s_addr << 16 | a->sin_port;
+}
+
+static void udpPeerAddr(uint64_t p, struct sockaddr_in *a)
+{
+    memset(a, 0, sizeof(*a));
+    a->sin_family      = AF_INET;
+    a->sin_addr.s_addr = (uint32_t)(p >> 16);
+    a->sin_port        = (uint16_t)p;
+}
+
+/* perte simulée (xorshift par thread) */
+static int udpLost(void)
+{
+    static __thread uint32_t s;
+    if (!g_udpLoss) return 0;
+    if (!s) s = (uint32_t)metNow() | 1;
+    s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+    if (s % 100 >= g_udpLoss) return 0;
+    MET_ADD(udpLost, 1);
+    return 1;
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Envoi : lot rempli pendant sendState, vidé en un sendmmsg      */
+/* ─────────────────────────────────────────────────────────────── */
+typedef struct {
+    int                n;
+    struct mmsghdr     msg[UDP_BATCH];
+    struct iovec       iov[UDP_BATCH];
+    struct sockaddr_in to [UDP_BATCH];
+    OutBuf            *buf[UDP_BATCH];  /* une référence chacun       */
+} UdpBatch;
+
+/* EAGAIN : datagrammes perdus, le prochain état les remplace */
+static void udpFlush(UdpBatch *u)
+{
+    int done = 0;
+    while (done < u->n) {
+        int r = sendmmsg(g_udpFd, u->msg + done, u->n - done, MSG_DONTWAIT);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            MET_ADD(udpLost, u->n - done);
+            break;
+        }
+        done += r;
+    }
+    MET_ADD(udpOut, done);
+    for (int i = 0; i < u->n; i++) outRelease(u->buf[i]);
+    u->n = 0;
+}
+
+/* état pour c par datagramme si son canal est ouvert et que b tient
+ * dans un datagramme ; 0 : à mettre en file TCP comme avant         */
+static int udpQueue(UdpBatch *u, Conn *c, OutBuf *b)
+{
+    uint64_t peer = __atomic_load_n(&c->udpPeer, __ATOMIC_ACQUIRE);
+    if (!peer || !b || b->len > UDP_MAX_PAYLOAD) return 0;
+    if (udpLost()) return 1;
+    if (u->n == UDP_BATCH) udpFlush(u);
+    int i = u->n++;
+    udpPeerAddr(peer, &u->to[i]);
+    u->buf[i] = b;
+    __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+    u->iov[i] = (struct iovec){ b->data, b->len };
+    u->msg[i].msg_hdr = (struct msghdr){ .msg_name    = &u->to[i],
+                                         .msg_namelen = sizeof(u->to[i]),
+                                         .msg_iov     = &u->iov[i],
+                                         .msg_iovlen  = 1 };
+    return 1;
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Session : jeton demandé sur TCP (thread I/O de c)              */
+/* ─────────────────────────────────────────────────────────────── */
+void udpGrant(Conn *c)
+{
+    if (g_udpFd < 0) { connSend(c, "UDP_FAIL\n", 9); return; }
+    uint64_t tok = __atomic_load_n(&c->udpToken, __ATOMIC_ACQUIRE);
+    if (!tok) {
+        uint32_t secret;
+        if (getrandom(&secret, sizeof(secret), 0) != sizeof(secret))
+            secret = (uint32_t)metNow();
+        tok = (uint64_t)c->id << 32 | secret;
+        __atomic_store_n(&c->udpToken, tok, __ATOMIC_RELEASE);
+    }
+    char r[64];
+    connSend(c, r, snprintf(r, sizeof(r), "UDP_TOKEN:%016llx:%d\n",
+                            (unsigned long long)tok, g_udpPort));
+}
+
+void udpClose(Conn *c)
+{
+    __atomic_store_n(&c->udpPeer, 0, __ATOMIC_RELEASE);
+}
+
+/* ─────────────────────────────────────────────────────────────── */
+/*  Réception : un thread, recvmmsg par lots                       */
+/* ─────────────────────────────────────────────────────────────── */
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void udpInput(const uint8_t *p, size_t len, const struct sockaddr_in *from)
+{
+    MET_ADD(udpIn, 1);
+    if (len < 9 || udpLost()) return;
+    uint64_t tok = get32(p + 1) | (uint64_t)get32(p + 5) << 32;
+    Conn *c = connById((uint32_t)(tok >> 32));
+    if (!c) return;
+    if (!c->logged || tok != __atomic_load_n(&c->udpToken, __ATOMIC_ACQUIRE)) {
+        connRelease(c);
+        return;
+    }
+    uint64_t peer = udpPeerPack(from);
+    int bound = peer == __atomic_load_n(&c->udpPeer, __ATOMIC_ACQUIRE);
+
+    switch (p[0]) {
+    case 'H':                                     /* (re)liaison */
+        __atomic_store_n(&c->udpPeer, peer, __ATOMIC_RELEASE);
+        connSend(c, "UDP_OK\n", 7);
+        break;
+    case 'M': {
+        if (len < 17 || !bound) break;
+        uint32_t seq = get32(p + 9);
+        if ((int32_t)(seq - c->udpMoveSeq) <= 0) { MET_ADD(udpStale, 1); break; }
+        c->udpMoveSeq = seq;                      /* thread UDP seul */
+        gamePost(c, (GameInput){ .kind = IN_MOVE,
+                                 .x = (int16_t)(p[13] | p[14] << 8),
+                                 .y = (int16_t)(p[15] | p[16] << 8) });
+        break;
+    }
+    case 'A':
+        if (len >= 13 && bound && c->bin) ackSnapshot(c, get32(p + 9));
+        break;
+    }
+    connRelease(c);
+}
+
+static void *udpLoop(void *arg)
+{
+    (void)arg;
+    static uint8_t     data[UDP_BATCH][UDP_IN_MAX];
+    struct mmsghdr     msg[UDP_BATCH];
+    struct iovec       iov[UDP_BATCH];
+    struct sockaddr_in from[UDP_BATCH];
+    while (1) {
+        for (int i = 0; i < UDP_BATCH; i++) {
+            iov[i] = (struct iovec){ data[i], UDP_IN_MAX };
+            msg[i].msg_hdr = (struct msghdr){ .msg_name    = &from[i],
+                                              .msg_namelen = sizeof(from[i]),
+                                              .msg_iov     = &iov[i],
+                                              .msg_iovlen  = 1 };
+        }
+        int n = recvmmsg(g_udpFd, msg, UDP_BATCH, MSG_WAITFORONE, NULL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("recvmmsg"); return NULL;
+        }
+        for (int i = 0; i < n; i++)
+            udpInput(data[i], msg[i].msg_len, &from[i]);
+    }
+}
+
+/* socket UDP sur le port du jeu ; en cas d’échec tout reste sur TCP */
+static void udpInit(int port, unsigned loss)
+{
+    g_udpLoss = loss > 100 ? 100 : loss;
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in a = { .sin_family      = AF_INET,
+                             .sin_addr.s_addr = INADDR_ANY,
+                             .sin_port        = htons(port) };
+    int sz = UDP_SOCKBUF;
+    pthread_t tid;
+    if (fd < 0 || bind(fd, (struct sockaddr*)&a, sizeof(a)) != 0) {
+        perror("udp");
+        if (fd >= 0) close(fd);
+        return;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sz, sizeof(sz));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &sz, sizeof(sz));
+    g_udpFd = fd; g_udpPort = port;
+    if (pthread_create(&tid, NULL, udpLoop, NULL) != 0) {
+        close(fd); g_udpFd = -1;
+        return;
+    }
+    pthread_detach(tid);
+    if (g_udpLoss) printf("UDP : %u %% de pertes simulées\n", g_udpLoss);
+}